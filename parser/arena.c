@@ -0,0 +1,63 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* data NULL to allocate bytes here */
+int
+arena_init(struct arena_t* arena, void* data, long long bytes)
+{
+    memset(arena, 0, sizeof(struct arena_t));
+    if (bytes < 0)
+    {
+        return 1;
+    }
+    if (data == NULL)
+    {
+        data = malloc(bytes > 0 ? bytes : 1);
+        if (data == NULL)
+        {
+            return 1;
+        }
+        arena->owned = 1;
+    }
+    arena->data = (char*)data;
+    arena->bytes = bytes;
+    return 0;
+}
+
+int
+arena_deinit(struct arena_t* arena)
+{
+    if (arena->owned)
+    {
+        free(arena->data);
+    }
+    memset(arena, 0, sizeof(struct arena_t));
+    return 0;
+}
+
+/* ARENA_ALIGN aligned from the start of data, NULL when it does not
+   fit */
+void*
+arena_alloc(struct arena_t* arena, long long bytes)
+{
+    long long used;
+
+    used = (arena->used + ARENA_ALIGN - 1) & ~(long long)(ARENA_ALIGN - 1);
+    if ((bytes < 0) || (used > arena->bytes) ||
+        (bytes > arena->bytes - used))
+    {
+        return NULL;
+    }
+    arena->used = used + bytes;
+    return arena->data + used;
+}
+
+int
+arena_reset(struct arena_t* arena)
+{
+    arena->used = 0;
+    return 0;
+}
@@ -0,0 +1,28 @@
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#define ARENA_ALIGN     16
+
+/* bump allocator over one block, nothing is freed on its own, the whole
+   block is given back by arena_reset
+   data is the caller's or, when arena_init was handed NULL, allocated
+   once there and freed by arena_deinit */
+struct arena_t
+{
+    char* data;
+    long long bytes;
+    long long used;
+    int owned;
+};
+
+int
+arena_init(struct arena_t* arena, void* data, long long bytes);
+int
+arena_deinit(struct arena_t* arena);
+void*
+arena_alloc(struct arena_t* arena, long long bytes);
+int
+arena_reset(struct arena_t* arena);
+
+#endif
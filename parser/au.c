@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "sps.h"
+#include "pps.h"
+#include "au.h"
+
+/* reads from the current position of fd */
+int
+au_reader_init(struct au_reader_t* reader, int fd)
+{
+    memset(reader, 0, sizeof(struct au_reader_t));
+    return nal_stream_init(&(reader->stream), fd);
+}
+
+int
+au_reader_deinit(struct au_reader_t* reader)
+{
+    nal_stream_deinit(&(reader->stream));
+    params_deinit(&(reader->params));
+    memset(reader, 0, sizeof(struct au_reader_t));
+    return 0;
+}
+
+/* nonzero when the nal begins a new unit, params should already hold the
+   sets the nal refers to, *sps is set for a slice with a known sps */
+int
+au_split_nal(struct au_split_t* split, const struct params_t* params,
+             char* data, int bytes, int nal_unit_type,
+             const struct sps_t** sps)
+{
+    int rv;
+    int starts;
+    struct bits_t bits;
+    struct slice_t slice;
+    const struct pps_t* pps;
+
+    *sps = NULL;
+    if (((nal_unit_type >= 6) && (nal_unit_type <= 9)) ||
+        ((nal_unit_type >= 14) && (nal_unit_type <= 18)))
+    {
+        starts = split->have_vcl;
+        if (starts)
+        {
+            split->have_vcl = 0;
+        }
+        return starts;
+    }
+    if ((nal_unit_type < 1) || (nal_unit_type > 5))
+    {
+        /* end of sequence or stream, filler and the rest stay with the
+           unit they follow */
+        return 0;
+    }
+    if ((nal_unit_type != 1) && (nal_unit_type != 5))
+    {
+        /* data partitions b and c follow their a */
+        split->have_vcl = 1;
+        return 0;
+    }
+    bits_init_nal(&bits, data, bytes);
+    memset(&slice, 0, sizeof(slice));
+    rv = parse_slice_header(&bits, params->sps, params->pps, &slice);
+    if (rv != 0)
+    {
+        /* no usable pps or sps, only a slice at the first macroblock
+           can start a picture */
+        starts = split->have_vcl && (slice.first_mb_in_slice == 0);
+    }
+    else
+    {
+        starts = split->have_vcl &&
+                 (!split->have_slice ||
+                  slice_first_of_picture(&(split->slice), &slice));
+        if (slice.redundant_pic_cnt == 0)
+        {
+            split->slice = slice;
+            split->have_slice = 1;
+        }
+        pps = params->pps[slice.pic_parameter_set_id];
+        *sps = params->sps[pps->seq_parameter_set_id];
+    }
+    split->have_vcl = 1;
+    return starts;
+}
+
+/* nonzero when nal begins a new unit, keeps the parameter sets, width
+   and height are set for a slice with a known sps */
+static int
+au_nal_starts_unit(struct au_reader_t* reader, struct nal_unit_t* nal,
+                   int* width, int* height)
+{
+    int id;
+    int starts;
+    const struct sps_t* sps;
+
+    *width = 0;
+    *height = 0;
+    if ((nal->nal_unit_type == 7) || (nal->nal_unit_type == 8))
+    {
+        params_parse(&(reader->params), nal->data, nal->bytes,
+                     nal->nal_unit_type, &id);
+    }
+    starts = au_split_nal(&(reader->split), &(reader->params), nal->data,
+                          nal->bytes, nal->nal_unit_type, &sps);
+    if (sps != NULL)
+    {
+        *width = sps->width;
+        *height = sps->height;
+    }
+    return starts;
+}
+
+/* nal with every byte since the one before it */
+static int
+au_append(char* data, long long data_bytes, long long* bytes,
+          const char* src, long long src_bytes)
+{
+    if (*bytes + src_bytes > data_bytes)
+    {
+        return 1;
+    }
+    memcpy(data + *bytes, src, src_bytes);
+    *bytes += src_bytes;
+    return 0;
+}
+
+/* copy the next access unit into data
+   returns 0, 1 at the end of the stream, 2 on a stream error or 3 when
+   the unit does not fit in data_bytes */
+int
+au_reader_next(struct au_reader_t* reader, char* data, long long data_bytes,
+               long long* bytes)
+{
+    int rv;
+    int width;
+    int height;
+    struct nal_unit_t nal;
+
+    *bytes = 0;
+    if (reader->have_pending)
+    {
+        reader->have_pending = 0;
+        nal = reader->pending;
+        if (au_append(data, data_bytes, bytes, nal.lead,
+                      (nal.data + nal.bytes) - nal.lead) != 0)
+        {
+            return 3;
+        }
+        if (reader->pending_width > 0)
+        {
+            reader->width = reader->pending_width;
+            reader->height = reader->pending_height;
+        }
+    }
+    for (;;)
+    {
+        rv = nal_stream_next(&(reader->stream), &nal);
+        if (rv == NAL_STREAM_ERROR)
+        {
+            return 2;
+        }
+        if (rv == NAL_STREAM_END)
+        {
+            break;
+        }
+        if (rv == NAL_STREAM_FRAME)
+        {
+            continue;
+        }
+        if (rv == NAL_STREAM_SEGMENT_END)
+        {
+            if ((*bytes > 0) &&
+                (au_append(data, data_bytes, bytes, nal.lead,
+                           nal.lead_bytes) != 0))
+            {
+                return 3;
+            }
+            continue;
+        }
+        if (au_nal_starts_unit(reader, &nal, &width, &height) &&
+            (*bytes > 0))
+        {
+            reader->pending = nal;
+            reader->pending_width = width;
+            reader->pending_height = height;
+            reader->have_pending = 1;
+            reader->unit_count++;
+            return 0;
+        }
+        if (au_append(data, data_bytes, bytes, nal.lead,
+                      (nal.data + nal.bytes) - nal.lead) != 0)
+        {
+            return 3;
+        }
+        if (width > 0)
+        {
+            reader->width = width;
+            reader->height = height;
+        }
+    }
+    if (*bytes < 1)
+    {
+        return 1;
+    }
+    reader->unit_count++;
+    return 0;
+}
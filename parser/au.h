@@ -0,0 +1,49 @@
+
+#ifndef _AU_H_
+#define _AU_H_
+
+#include "stream.h"
+#include "params.h"
+#include "slice.h"
+
+/* the access unit boundary decision on its own, 7.4.1.2.3
+   after a vcl nal the next unit starts at a nal of type 6 to 9 or 14 to
+   18 or at the first slice of a new primary picture, 7.4.1.2.4
+   for readers that keep their own parameter sets */
+struct au_split_t
+{
+    int have_vcl;               /* the unit being built has a slice */
+    int have_slice;
+    struct slice_t slice;       /* last primary slice */
+};
+
+/* whole access units of an Annex B or BEEF stream split by au_split_nal,
+   a unit is copied out with the start codes and every byte between its
+   nals so the decoder sees what the stream had */
+struct au_reader_t
+{
+    struct nal_stream_t stream;
+    struct params_t params;
+    struct nal_unit_t pending;  /* first nal of the next unit */
+    int have_pending;
+    int pending_width;
+    int pending_height;
+    struct au_split_t split;
+    int width;                  /* of the last unit, from its sps */
+    int height;
+    long long unit_count;
+};
+
+int
+au_split_nal(struct au_split_t* split, const struct params_t* params,
+             char* data, int bytes, int nal_unit_type,
+             const struct sps_t** sps);
+int
+au_reader_init(struct au_reader_t* reader, int fd);
+int
+au_reader_deinit(struct au_reader_t* reader);
+int
+au_reader_next(struct au_reader_t* reader, char* data, long long data_bytes,
+               long long* bytes);
+
+#endif
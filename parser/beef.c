@@ -0,0 +1,399 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "utils.h"
+#include "beef.h"
+
+#define BEEF1_HEADER_BYTES  16
+
+/* crc32 0xEDB88320 */
+static const unsigned int g_crc_table[256] =
+{
+    0x00000000u, 0x77073096u, 0xEE0E612Cu, 0x990951BAu,
+    0x076DC419u, 0x706AF48Fu, 0xE963A535u, 0x9E6495A3u,
+    0x0EDB8832u, 0x79DCB8A4u, 0xE0D5E91Eu, 0x97D2D988u,
+    0x09B64C2Bu, 0x7EB17CBDu, 0xE7B82D07u, 0x90BF1D91u,
+    0x1DB71064u, 0x6AB020F2u, 0xF3B97148u, 0x84BE41DEu,
+    0x1ADAD47Du, 0x6DDDE4EBu, 0xF4D4B551u, 0x83D385C7u,
+    0x136C9856u, 0x646BA8C0u, 0xFD62F97Au, 0x8A65C9ECu,
+    0x14015C4Fu, 0x63066CD9u, 0xFA0F3D63u, 0x8D080DF5u,
+    0x3B6E20C8u, 0x4C69105Eu, 0xD56041E4u, 0xA2677172u,
+    0x3C03E4D1u, 0x4B04D447u, 0xD20D85FDu, 0xA50AB56Bu,
+    0x35B5A8FAu, 0x42B2986Cu, 0xDBBBC9D6u, 0xACBCF940u,
+    0x32D86CE3u, 0x45DF5C75u, 0xDCD60DCFu, 0xABD13D59u,
+    0x26D930ACu, 0x51DE003Au, 0xC8D75180u, 0xBFD06116u,
+    0x21B4F4B5u, 0x56B3C423u, 0xCFBA9599u, 0xB8BDA50Fu,
+    0x2802B89Eu, 0x5F058808u, 0xC60CD9B2u, 0xB10BE924u,
+    0x2F6F7C87u, 0x58684C11u, 0xC1611DABu, 0xB6662D3Du,
+    0x76DC4190u, 0x01DB7106u, 0x98D220BCu, 0xEFD5102Au,
+    0x71B18589u, 0x06B6B51Fu, 0x9FBFE4A5u, 0xE8B8D433u,
+    0x7807C9A2u, 0x0F00F934u, 0x9609A88Eu, 0xE10E9818u,
+    0x7F6A0DBBu, 0x086D3D2Du, 0x91646C97u, 0xE6635C01u,
+    0x6B6B51F4u, 0x1C6C6162u, 0x856530D8u, 0xF262004Eu,
+    0x6C0695EDu, 0x1B01A57Bu, 0x8208F4C1u, 0xF50FC457u,
+    0x65B0D9C6u, 0x12B7E950u, 0x8BBEB8EAu, 0xFCB9887Cu,
+    0x62DD1DDFu, 0x15DA2D49u, 0x8CD37CF3u, 0xFBD44C65u,
+    0x4DB26158u, 0x3AB551CEu, 0xA3BC0074u, 0xD4BB30E2u,
+    0x4ADFA541u, 0x3DD895D7u, 0xA4D1C46Du, 0xD3D6F4FBu,
+    0x4369E96Au, 0x346ED9FCu, 0xAD678846u, 0xDA60B8D0u,
+    0x44042D73u, 0x33031DE5u, 0xAA0A4C5Fu, 0xDD0D7CC9u,
+    0x5005713Cu, 0x270241AAu, 0xBE0B1010u, 0xC90C2086u,
+    0x5768B525u, 0x206F85B3u, 0xB966D409u, 0xCE61E49Fu,
+    0x5EDEF90Eu, 0x29D9C998u, 0xB0D09822u, 0xC7D7A8B4u,
+    0x59B33D17u, 0x2EB40D81u, 0xB7BD5C3Bu, 0xC0BA6CADu,
+    0xEDB88320u, 0x9ABFB3B6u, 0x03B6E20Cu, 0x74B1D29Au,
+    0xEAD54739u, 0x9DD277AFu, 0x04DB2615u, 0x73DC1683u,
+    0xE3630B12u, 0x94643B84u, 0x0D6D6A3Eu, 0x7A6A5AA8u,
+    0xE40ECF0Bu, 0x9309FF9Du, 0x0A00AE27u, 0x7D079EB1u,
+    0xF00F9344u, 0x8708A3D2u, 0x1E01F268u, 0x6906C2FEu,
+    0xF762575Du, 0x806567CBu, 0x196C3671u, 0x6E6B06E7u,
+    0xFED41B76u, 0x89D32BE0u, 0x10DA7A5Au, 0x67DD4ACCu,
+    0xF9B9DF6Fu, 0x8EBEEFF9u, 0x17B7BE43u, 0x60B08ED5u,
+    0xD6D6A3E8u, 0xA1D1937Eu, 0x38D8C2C4u, 0x4FDFF252u,
+    0xD1BB67F1u, 0xA6BC5767u, 0x3FB506DDu, 0x48B2364Bu,
+    0xD80D2BDAu, 0xAF0A1B4Cu, 0x36034AF6u, 0x41047A60u,
+    0xDF60EFC3u, 0xA867DF55u, 0x316E8EEFu, 0x4669BE79u,
+    0xCB61B38Cu, 0xBC66831Au, 0x256FD2A0u, 0x5268E236u,
+    0xCC0C7795u, 0xBB0B4703u, 0x220216B9u, 0x5505262Fu,
+    0xC5BA3BBEu, 0xB2BD0B28u, 0x2BB45A92u, 0x5CB36A04u,
+    0xC2D7FFA7u, 0xB5D0CF31u, 0x2CD99E8Bu, 0x5BDEAE1Du,
+    0x9B64C2B0u, 0xEC63F226u, 0x756AA39Cu, 0x026D930Au,
+    0x9C0906A9u, 0xEB0E363Fu, 0x72076785u, 0x05005713u,
+    0x95BF4A82u, 0xE2B87A14u, 0x7BB12BAEu, 0x0CB61B38u,
+    0x92D28E9Bu, 0xE5D5BE0Du, 0x7CDCEFB7u, 0x0BDBDF21u,
+    0x86D3D2D4u, 0xF1D4E242u, 0x68DDB3F8u, 0x1FDA836Eu,
+    0x81BE16CDu, 0xF6B9265Bu, 0x6FB077E1u, 0x18B74777u,
+    0x88085AE6u, 0xFF0F6A70u, 0x66063BCAu, 0x11010B5Cu,
+    0x8F659EFFu, 0xF862AE69u, 0x616BFFD3u, 0x166CCF45u,
+    0xA00AE278u, 0xD70DD2EEu, 0x4E048354u, 0x3903B3C2u,
+    0xA7672661u, 0xD06016F7u, 0x4969474Du, 0x3E6E77DBu,
+    0xAED16A4Au, 0xD9D65ADCu, 0x40DF0B66u, 0x37D83BF0u,
+    0xA9BCAE53u, 0xDEBB9EC5u, 0x47B2CF7Fu, 0x30B5FFE9u,
+    0xBDBDF21Cu, 0xCABAC28Au, 0x53B39330u, 0x24B4A3A6u,
+    0xBAD03605u, 0xCDD70693u, 0x54DE5729u, 0x23D967BFu,
+    0xB3667A2Eu, 0xC4614AB8u, 0x5D681B02u, 0x2A6F2B94u,
+    0xB40BBE37u, 0xC30C8EA1u, 0x5A05DF1Bu, 0x2D02EF8Du
+};
+
+unsigned int
+beef_crc32(unsigned int crc, const char* data, long long bytes)
+{
+    long long offset;
+
+    crc = ~crc;
+    for (offset = 0; offset < bytes; offset++)
+    {
+        crc = g_crc_table[(crc ^ data[offset]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/* header at data in either version
+   returns its size, 0 if data_bytes is too short to tell or -1 when data
+   is not a BEEF header */
+int
+beef_parse_header(const char* data, long long data_bytes,
+                  struct beef_frame_t* frame)
+{
+    int val[3];
+    struct beef2_header_t header;
+
+    memset(frame, 0, sizeof(struct beef_frame_t));
+    if (data_bytes < BEEF1_HEADER_BYTES)
+    {
+        return 0;
+    }
+    if (strncmp(data, "BEEF", 4) == 0)
+    {
+        memcpy(val, data + 4, sizeof(val));
+        if (val[2] < 0)
+        {
+            return -1;
+        }
+        frame->version = 1;
+        frame->width = val[0];
+        frame->height = val[1];
+        frame->bytes = val[2];
+        return BEEF1_HEADER_BYTES;
+    }
+    if ((strncmp(data, "BEF2", 4) != 0) && (strncmp(data, "BFIX", 4) != 0))
+    {
+        return -1;
+    }
+    if (data_bytes < (long long)sizeof(header))
+    {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    if ((header.header_bytes < (int)sizeof(header)) ||
+        (header.bytes_follow < 0))
+    {
+        return -1;
+    }
+    if (data_bytes < header.header_bytes)
+    {
+        return 0;
+    }
+    frame->version = 2;
+    frame->footer = data[1] == 'F';
+    frame->width = header.width;
+    frame->height = header.height;
+    frame->bytes = header.bytes_follow;
+    frame->timestamp_us = header.timestamp_us;
+    frame->flags = header.flags;
+    frame->checksum = header.checksum;
+    return header.header_bytes;
+}
+
+/* read a header at the file position, the payload is next
+   returns 0, 1 at the end of the frames, 2 when there is no BEEF header
+   and the position is undefined or 3 when the header is cut short */
+int
+beef_read_header(int fd, struct beef_frame_t* frame)
+{
+    int rv;
+    int bytes;
+    int more;
+    int header_bytes;
+    char data[256];
+
+    bytes = 0;
+    more = BEEF1_HEADER_BYTES;
+    for (;;)
+    {
+        rv = read(fd, data + bytes, more);
+        if ((rv == 0) && (bytes == 0))
+        {
+            return 1;
+        }
+        if (rv != more)
+        {
+            return 3;
+        }
+        bytes += more;
+        rv = beef_parse_header(data, bytes, frame);
+        if (rv != 0)
+        {
+            break;
+        }
+        /* v2, the known part first then what header_bytes adds */
+        more = sizeof(struct beef2_header_t) - bytes;
+        if (more < 1)
+        {
+            memcpy(&header_bytes, data + 4, 4);
+            if (header_bytes > (int)sizeof(data))
+            {
+                return 2;
+            }
+            more = header_bytes - bytes;
+        }
+    }
+    if (rv < 0)
+    {
+        return 2;
+    }
+    if (frame->footer)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+/* frames of a v2 file from its footer, the file position is undefined
+   after, returns 0 when the footer is there and sound */
+int
+beef_read_index(int fd, struct frame_index_t* index)
+{
+    long long end;
+    long long bytes;
+    struct beef_frame_t frame;
+    struct beef2_trailer_t trailer;
+    struct frame_entry_t* frames;
+
+    end = lseek(fd, 0, SEEK_END);
+    if (end < (long long)sizeof(trailer))
+    {
+        return 1;
+    }
+    if ((pread(fd, &trailer, sizeof(trailer), end - sizeof(trailer)) !=
+         sizeof(trailer)) ||
+        (strncmp(trailer.text, "BFTR", 4) != 0) ||
+        (trailer.count < 0) || (trailer.index_offset < 0) ||
+        (lseek(fd, trailer.index_offset, SEEK_SET) != trailer.index_offset))
+    {
+        return 1;
+    }
+    bytes = (long long)trailer.count * sizeof(struct frame_entry_t);
+    if ((beef_read_header(fd, &frame) != 1) || !frame.footer ||
+        (frame.bytes != bytes))
+    {
+        return 1;
+    }
+    frames = (struct frame_entry_t*)malloc(bytes > 0 ? bytes : 1);
+    if (frames == NULL)
+    {
+        return 1;
+    }
+    if ((read(fd, frames, bytes) != bytes) ||
+        (beef_crc32(0, (const char*)frames, bytes) != frame.checksum))
+    {
+        free(frames);
+        return 1;
+    }
+    free(index->frames);
+    index->frames = frames;
+    index->count = trailer.count;
+    index->alloc = trailer.count;
+    return 0;
+}
+
+/* a header and what follows it in one writev */
+static int
+beef_write_block(struct beef_writer_t* writer, const char* text,
+                 const struct frame_entry_t* entry, unsigned int checksum,
+                 const char* data, long long bytes, const char* tail,
+                 int tail_bytes)
+{
+    struct beef2_header_t header;
+    struct iovec iov[3];
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.text, text, 4);
+    header.header_bytes = sizeof(header);
+    header.width = entry->width;
+    header.height = entry->height;
+    header.bytes_follow = entry->bytes;
+    header.timestamp_us = entry->timestamp_us;
+    header.flags = entry->flags;
+    header.checksum = checksum;
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (char*)data;
+    iov[1].iov_len = bytes;
+    iov[2].iov_base = (char*)tail;
+    iov[2].iov_len = tail_bytes;
+    if (write_iov(writer->fd, iov, 3) != 0)
+    {
+        writer->error = 1;
+        return 1;
+    }
+    writer->offset += sizeof(header) + bytes + tail_bytes;
+    return 0;
+}
+
+/* frames go to fd from its current position */
+int
+beef_writer_init(struct beef_writer_t* writer, int fd)
+{
+    memset(writer, 0, sizeof(struct beef_writer_t));
+    writer->fd = fd;
+    writer->offset = lseek(fd, 0, SEEK_CUR);
+    if (writer->offset < 0)
+    {
+        /* a pipe, footer offsets count from here */
+        writer->offset = 0;
+    }
+    return 0;
+}
+
+/* one frame of Annex B, the flags come from its nal types */
+int
+beef_writer_frame(struct beef_writer_t* writer, const char* data,
+                  long long bytes, int width, int height,
+                  long long timestamp_us)
+{
+    int index;
+    int idr_frame;
+    struct frame_entry_t* entry;
+
+    if (writer->error)
+    {
+        return 1;
+    }
+    idr_frame = -1;
+    if (writer->index.count > 0)
+    {
+        idr_frame = writer->index.frames[writer->index.count - 1].idr_frame;
+    }
+    if (nal_index_build(&(writer->nals), data, bytes) < 0)
+    {
+        writer->error = 1;
+        return 1;
+    }
+    entry = frame_index_add(&(writer->index));
+    if (entry == NULL)
+    {
+        writer->error = 1;
+        return 1;
+    }
+    entry->offset = writer->offset;
+    entry->bytes = bytes;
+    entry->timestamp_us = timestamp_us;
+    entry->width = width;
+    entry->height = height;
+    if ((writer->index.count > 1) &&
+        ((entry[-1].width != width) || (entry[-1].height != height)))
+    {
+        entry->flags |= FRAME_FLAG_RES_CHANGE;
+    }
+    for (index = 0; index < writer->nals.count; index++)
+    {
+        switch (writer->nals.nals[index].nal_unit_type)
+        {
+            case 5:
+                entry->flags |= FRAME_FLAG_IDR;
+                idr_frame = writer->index.count - 1;
+                break;
+            case 7:
+                entry->flags |= FRAME_FLAG_SPS;
+                break;
+            case 8:
+                entry->flags |= FRAME_FLAG_PPS;
+                break;
+            default:
+                break;
+        }
+    }
+    entry->idr_frame = idr_frame;
+    return beef_write_block(writer, "BEF2", entry, beef_crc32(0, data, bytes),
+                            data, bytes, NULL, 0);
+}
+
+/* write the footer index and trailer, nothing when no frame was written,
+   the writer is done after this */
+int
+beef_writer_finish(struct beef_writer_t* writer)
+{
+    int error;
+    long long bytes;
+    struct frame_entry_t entry;
+    struct beef2_trailer_t trailer;
+
+    if (writer->index.count > 0)
+    {
+        bytes = (long long)writer->index.count *
+                sizeof(struct frame_entry_t);
+        memset(&entry, 0, sizeof(entry));
+        entry.bytes = bytes;
+        memset(&trailer, 0, sizeof(trailer));
+        memcpy(trailer.text, "BFTR", 4);
+        trailer.count = writer->index.count;
+        trailer.index_offset = writer->offset;
+        if (!writer->error)
+        {
+            beef_write_block(writer, "BFIX", &entry,
+                             beef_crc32(0, (const char*)writer->index.frames,
+                                        bytes),
+                             (const char*)writer->index.frames, bytes,
+                             (const char*)&trailer, sizeof(trailer));
+        }
+    }
+    error = writer->error;
+    frame_index_deinit(&(writer->index));
+    nal_index_deinit(&(writer->nals));
+    return error;
+}
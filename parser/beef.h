@@ -0,0 +1,75 @@
+
+#ifndef _BEEF_H_
+#define _BEEF_H_
+
+#include "utils.h"
+#include "frame_index.h"
+
+/* a BEEF capture is a list of frames, each a header and bytes_follow
+   bytes of Annex B
+   v1 header   "BEEF" width height bytes_follow, 16 bytes
+   v2 header   "BEF2" header_bytes width height bytes_follow(64)
+               timestamp_us(64) flags crc32, 40 bytes
+   a v2 file ends with a "BFIX" block that has the same header and holds
+   one frame_entry_t per frame, then a 16 byte trailer "BFTR" count
+   offset of the BFIX header */
+struct beef2_header_t
+{
+    char text[4];
+    int header_bytes;       /* readers skip what they do not know */
+    int width;
+    int height;
+    long long bytes_follow;
+    long long timestamp_us; /* capture time */
+    int flags;              /* FRAME_FLAG_ */
+    unsigned int checksum;  /* crc32 of the payload */
+};
+
+struct beef2_trailer_t
+{
+    char text[4];
+    int count;
+    long long index_offset;
+};
+
+/* either header version, v1 leaves timestamp_us, flags and checksum 0 */
+struct beef_frame_t
+{
+    int version;            /* 1 or 2 */
+    int footer;             /* the BFIX block, no frames follow */
+    int width;
+    int height;
+    long long bytes;
+    long long timestamp_us;
+    int flags;
+    unsigned int checksum;
+};
+
+struct beef_writer_t
+{
+    int fd;
+    int error;
+    long long offset;
+    struct frame_index_t index;
+    struct nal_index_t nals;
+};
+
+unsigned int
+beef_crc32(unsigned int crc, const char* data, long long bytes);
+int
+beef_parse_header(const char* data, long long data_bytes,
+                  struct beef_frame_t* frame);
+int
+beef_read_header(int fd, struct beef_frame_t* frame);
+int
+beef_read_index(int fd, struct frame_index_t* index);
+int
+beef_writer_init(struct beef_writer_t* writer, int fd);
+int
+beef_writer_frame(struct beef_writer_t* writer, const char* data,
+                  long long bytes, int width, int height,
+                  long long timestamp_us);
+int
+beef_writer_finish(struct beef_writer_t* writer);
+
+#endif
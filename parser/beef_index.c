@@ -0,0 +1,75 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_index.h"
+
+static void
+print_frame(const struct frame_index_t* index, int frame)
+{
+    const struct frame_entry_t* entry;
+
+    entry = index->frames + frame;
+    printf("frame %d offset %lld bytes %lld width %d height %d "
+           "timestamp_us %lld flags%s%s%s%s idr_frame %d\n",
+           frame, entry->offset, entry->bytes, entry->width, entry->height,
+           entry->timestamp_us,
+           entry->flags & FRAME_FLAG_IDR ? " idr" : "",
+           entry->flags & FRAME_FLAG_SPS ? " sps" : "",
+           entry->flags & FRAME_FLAG_PPS ? " pps" : "",
+           entry->flags & FRAME_FLAG_RES_CHANGE ? " res_change" : "",
+           entry->idr_frame);
+}
+
+/* beef_index file        build or check file.idx, list resolution changes
+   beef_index file frame  show one frame */
+int
+main(int argc, char** argv)
+{
+    int index;
+    int frame;
+    int idr_count;
+    struct frame_index_t findex;
+
+    if (argc < 2)
+    {
+        printf("usage: beef_index file [frame]\n");
+        return 1;
+    }
+    if (frame_index_open(&findex, argv[1]) != 0)
+    {
+        printf("error indexing %s\n", argv[1]);
+        return 1;
+    }
+    if (argc > 2)
+    {
+        frame = atoi(argv[2]);
+        if ((frame < 0) || (frame >= findex.count))
+        {
+            printf("frame %d out of range, %d frames\n", frame, findex.count);
+            frame_index_deinit(&findex);
+            return 1;
+        }
+        print_frame(&findex, frame);
+        frame_index_deinit(&findex);
+        return 0;
+    }
+    idr_count = 0;
+    for (index = 0; index < findex.count; index++)
+    {
+        if (findex.frames[index].flags & FRAME_FLAG_IDR)
+        {
+            idr_count++;
+        }
+        if ((index == 0) ||
+            (findex.frames[index].flags & FRAME_FLAG_RES_CHANGE))
+        {
+            print_frame(&findex, index);
+        }
+    }
+    printf("frames %d idr frames %d file_bytes %lld\n",
+           findex.count, idr_count, findex.file_bytes);
+    frame_index_deinit(&findex);
+    return 0;
+}
@@ -5,28 +5,29 @@
 
 #include "bits.h"
 
-static const int g_len_table[256] =
-{
-    1, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
-    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8
+/* bits in the ue(v) code of 0 to 255 */
+static const int g_ue_bits_table[256] =
+{
+     1,  3,  3,  5,  5,  5,  5,  7,  7,  7,  7,  7,  7,  7,  7,  9,
+     9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 13,
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 17
 };
 
 int
-bits_init(struct bits_t* bits, char* data, int data_bytes)
+bits_init(struct bits_t* bits, char* data, long long data_bytes)
 {
     memset(bits, 0, sizeof(struct bits_t));
     bits->data = data;
@@ -35,84 +36,319 @@ bits_init(struct bits_t* bits, char* data, int data_bytes)
 }
 
 int
-in_uint(struct bits_t* bits, int num_bits)
+bits_init_nal(struct bits_t* bits, char* data, long long data_bytes)
 {
-    int rv;
-    int shift_pos;
-    long long mask;
+    bits_init(bits, data, data_bytes);
+    bits->emulation = 1;
+    return 0;
+}
 
-    if (bits->error)
+/* point data at the segment holding offset, empty segments are passed
+   over, going back restarts from the first segment */
+static void
+bits_iov_locate(struct bits_t* bits)
+{
+    if (bits->offset < bits->seg_start)
     {
-        return 0;
+        bits->iov_index = 0;
+        bits->seg_start = 0;
+        bits->seg_bytes = bits->iov[0].iov_len;
     }
-    if (num_bits < 1)
+    while ((bits->offset >= bits->seg_start + bits->seg_bytes) &&
+           (bits->iov_index + 1 < bits->iov_count))
     {
-        return 0;
+        bits->seg_start += bits->seg_bytes;
+        bits->iov_index++;
+        bits->seg_bytes = bits->iov[bits->iov_index].iov_len;
     }
-    if (num_bits > 32)
+    bits->data = (char*)(bits->iov[bits->iov_index].iov_base);
+}
+
+int
+bits_init_iov(struct bits_t* bits, const struct iovec* iov, int iov_count)
+{
+    int index;
+
+    bits_init(bits, NULL, 0);
+    if (iov_count < 1)
     {
         return 0;
     }
-    while (bits->bits_left < num_bits)
+    bits->iov = iov;
+    bits->iov_count = iov_count;
+    for (index = 0; index < iov_count; index++)
+    {
+        bits->data_bytes += iov[index].iov_len;
+    }
+    bits->seg_bytes = iov[0].iov_len;
+    bits_iov_locate(bits);
+    return 0;
+}
+
+int
+bits_init_nal_iov(struct bits_t* bits, const struct iovec* iov,
+                  int iov_count)
+{
+    bits_init_iov(bits, iov, iov_count);
+    bits->emulation = 1;
+    return 0;
+}
+
+/* fewer than 8 bytes left, load what is there one byte at a time */
+int
+bits_refill_tail(struct bits_t* bits)
+{
+    unsigned long long byte_data;
+
+    while ((bits->bits_left <= 56) && (bits->offset < bits->data_bytes))
+    {
+        byte_data = bits->data[bits->offset] & 0xFF;
+        bits->cache |= byte_data << (56 - bits->bits_left);
+        bits->offset++;
+        bits->bits_left += 8;
+    }
+    return 0;
+}
+
+/* refill from escaped nal bytes, 8 bytes with no zero byte among them
+   can not hold an emulation_prevention_three_byte and load as one word,
+   anything else goes a byte at a time
+   0x000000, 0x000001 or 0x000002 ends the data */
+int
+bits_refill_nal(struct bits_t* bits)
+{
+    int bytes;
+    unsigned long long word;
+    unsigned long long byte_data;
+
+    while ((bits->bits_left <= 56) && (bits->offset < bits->data_bytes))
     {
-        if (bits->offset >= bits->data_bytes)
+        if ((bits->zero_count < 2) && (bits->offset + 8 <= bits->data_bytes))
         {
-            bits->error = 1;
-            return 0;
+            word = bits_load_be64(bits->data + bits->offset);
+            if (((word - 0x0101010101010101ull) & ~word &
+                 0x8080808080808080ull) == 0)
+            {
+                bits->cache |= word >> bits->bits_left;
+                bytes = (64 - bits->bits_left) >> 3;
+                bits->offset += bytes;
+                bits->bits_left += bytes << 3;
+                bits->zero_count = 0;
+                break;
+            }
+        }
+        byte_data = bits->data[bits->offset] & 0xFF;
+        if ((bits->zero_count == 2) && (byte_data < 0x03))
+        {
+            bits->data_bytes = bits->offset;
+            break;
         }
-        bits->byte_data <<= 8;
-        bits->byte_data |= bits->data[bits->offset] & 0xFF;
+        if ((bits->zero_count == 2) && (byte_data == 0x03))
+        {
+            bits->epb_pos[bits->epb_bytes & 7] = bits->offset -
+                                                 bits->epb_bytes;
+            bits->epb_bytes++;
+            bits->offset++;
+            bits->zero_count = 0;
+            continue;
+        }
+        bits->cache |= byte_data << (56 - bits->bits_left);
         bits->offset++;
         bits->bits_left += 8;
+        bits->zero_count = byte_data == 0 ? bits->zero_count + 1 : 0;
     }
-    shift_pos = bits->bits_left - num_bits;
-    bits->bits_left -= num_bits;
-    mask = 1;
-    mask = (mask << num_bits) - 1;
-    rv = (bits->byte_data >> shift_pos) & mask;
-    return rv;
+    return 0;
 }
 
+/* refill from a segment list, words load while 8 bytes remain in the
+   current segment, the bytes around a boundary go one at a time
+   zero_count carries over so a 0x000003 split between segments is
+   still dropped */
 int
-in_ueint(struct bits_t* bits)
+bits_refill_iov(struct bits_t* bits)
 {
-    int rv;
-    int zero_count;
+    int bytes;
+    long long seg_offset;
+    unsigned long long word;
+    unsigned long long byte_data;
 
-    zero_count = 0;
-    rv = in_uint(bits, 1);
-    while (rv == 0)
+    while ((bits->bits_left <= 56) && (bits->offset < bits->data_bytes))
     {
-        if (bits->error)
+        if (bits->offset >= bits->seg_start + bits->seg_bytes)
         {
-            return 0;
+            bits_iov_locate(bits);
         }
-        zero_count++;
-        rv = in_uint(bits, 1);
+        seg_offset = bits->offset - bits->seg_start;
+        if ((!bits->emulation || (bits->zero_count < 2)) &&
+            (seg_offset + 8 <= bits->seg_bytes))
+        {
+            word = bits_load_be64(bits->data + seg_offset);
+            if (!bits->emulation ||
+                (((word - 0x0101010101010101ull) & ~word &
+                  0x8080808080808080ull) == 0))
+            {
+                bits->cache |= word >> bits->bits_left;
+                bytes = (64 - bits->bits_left) >> 3;
+                bits->offset += bytes;
+                bits->bits_left += bytes << 3;
+                bits->zero_count = 0;
+                break;
+            }
+        }
+        byte_data = bits->data[seg_offset] & 0xFF;
+        if (!bits->emulation)
+        {
+            bits->cache |= byte_data << (56 - bits->bits_left);
+            bits->offset++;
+            bits->bits_left += 8;
+            continue;
+        }
+        if (bits->zero_count == 2)
+        {
+            if (byte_data < 0x03)
+            {
+                bits->data_bytes = bits->offset;
+                break;
+            }
+            if (byte_data == 0x03)
+            {
+                bits->epb_pos[bits->epb_bytes & 7] = bits->offset -
+                                                     bits->epb_bytes;
+                bits->epb_bytes++;
+                bits->offset++;
+                bits->zero_count = 0;
+                continue;
+            }
+        }
+        bits->cache |= byte_data << (56 - bits->bits_left);
+        bits->offset++;
+        bits->bits_left += 8;
+        bits->zero_count = byte_data == 0 ? bits->zero_count + 1 : 0;
     }
-    rv = ((rv << zero_count) | in_uint(bits, zero_count)) - 1;
-    return rv;
+    return 0;
 }
 
-int
-in_seint(struct bits_t* bits)
+/* byte of data at offset, in a segment list offset is not before the
+   current segment */
+static int
+bits_byte_at(const struct bits_t* bits, long long offset)
 {
-    int rv;
+    int index;
+    long long seg_start;
 
-    rv = in_ueint(bits);
-    rv = rv & 1 ? -(rv / 2) : (rv + 1) / 2;
-    return rv;
+    if (bits->iov == NULL)
+    {
+        return bits->data[offset] & 0xFF;
+    }
+    index = bits->iov_index;
+    seg_start = bits->seg_start;
+    while (offset >= seg_start + (long long)(bits->iov[index].iov_len))
+    {
+        seg_start += bits->iov[index].iov_len;
+        index++;
+    }
+    return ((char*)(bits->iov[index].iov_base))[offset - seg_start] & 0xFF;
 }
 
-int
-out_uint(struct bits_t* bits, int val, int num_bits)
+/* bit position in the escaped nal of the next unread bit, dropped bytes
+   still in the cache window are not counted */
+long long
+bits_nal_tell(const struct bits_t* bits)
 {
     int index;
+    long long pos;
+    long long epb_bytes;
+
+    pos = bits_tell(bits);
+    epb_bytes = bits->epb_bytes;
+    for (index = 0; (index < 8) && (index < bits->epb_bytes); index++)
+    {
+        if (bits->epb_pos[(bits->epb_bytes - 1 - index) & 7] * 8 <= pos)
+        {
+            break;
+        }
+        epb_bytes--;
+    }
+    if ((bits->bits_left == 0) && (bits->zero_count == 2) &&
+        (bits->offset < bits->data_bytes) &&
+        (bits_byte_at(bits, bits->offset) == 0x03))
+    {
+        /* next byte is dropped on the next refill */
+        epb_bytes++;
+    }
+    return pos + epb_bytes * 8;
+}
+
+/* an escaped nal can only be walked from the start */
+static int
+bits_seek_nal(struct bits_t* bits, long long bit_pos)
+{
+    long long skip_bits;
+
+    if (bit_pos < 0)
+    {
+        bits_set_error(bits);
+        return 1;
+    }
+    if (bit_pos < bits_tell(bits))
+    {
+        bits->cache = 0;
+        bits->bits_left = 0;
+        bits->offset = 0;
+        bits->zero_count = 0;
+        bits->epb_bytes = 0;
+        if (bits->iov != NULL)
+        {
+            bits_iov_locate(bits);
+        }
+    }
+    skip_bits = bit_pos - bits_tell(bits);
+    while ((skip_bits > 32) && !bits->error)
+    {
+        bits_read(bits, 32);
+        skip_bits -= 32;
+    }
+    if ((skip_bits > 0) && !bits->error)
+    {
+        bits_read(bits, skip_bits);
+    }
+    return bits->error;
+}
+
+int
+bits_seek(struct bits_t* bits, long long bit_pos)
+{
     int shift_pos;
-    int bits_write_back;
-    long long byte_data;
-    long long mask;
 
+    if (bits->emulation)
+    {
+        return bits_seek_nal(bits, bit_pos);
+    }
+    if ((bit_pos < 0) || (bit_pos > bits->data_bytes * 8))
+    {
+        bits_set_error(bits);
+        return 1;
+    }
+    bits->cache = 0;
+    bits->bits_left = 0;
+    bits->offset = bit_pos >> 3;
+    if (bits->iov != NULL)
+    {
+        bits_iov_locate(bits);
+    }
+    shift_pos = bit_pos & 7;
+    if (shift_pos > 0)
+    {
+        bits_refill(bits);
+        bits->cache <<= shift_pos;
+        bits->bits_left -= shift_pos;
+    }
+    return 0;
+}
+
+int
+in_uint(struct bits_t* bits, int num_bits)
+{
     if (bits->error)
     {
         return 0;
@@ -125,67 +361,246 @@ out_uint(struct bits_t* bits, int val, int num_bits)
     {
         return 0;
     }
-    while (bits->bits_left < num_bits)
+    return (int)bits_read(bits, num_bits);
+}
+
+unsigned int
+in_uint32(struct bits_t* bits)
+{
+    return bits_read(bits, 32);
+}
+
+/* codes longer than the cache, count the prefix across refills */
+static int
+in_ueint_long(struct bits_t* bits)
+{
+    int zero_count;
+    int count;
+    unsigned int val;
+
+    zero_count = 0;
+    for (;;)
     {
-        if (bits->offset >= bits->data_bytes)
+        bits_refill(bits);
+        if (bits->bits_left < 1)
         {
-            bits->error = 1;
+            bits_set_error(bits);
             return 0;
         }
-        bits->byte_data <<= 8;
-        bits->byte_data |= bits->data[bits->offset] & 0xFF;
-        bits->offset++;
-        bits->bits_left += 8;
+        count = bits->bits_left;
+        if (bits->cache != 0)
+        {
+            count = __builtin_clzll(bits->cache);
+            if (count > bits->bits_left)
+            {
+                count = bits->bits_left;
+            }
+        }
+        zero_count += count;
+        if (zero_count > 31)
+        {
+            bits_set_error(bits);
+            return 0;
+        }
+        if (count < bits->bits_left)
+        {
+            bits_skip(bits, count);
+            break;
+        }
+        bits_skip(bits, count);
     }
-    shift_pos = bits->bits_left - num_bits;
-    bits_write_back = bits->bits_left;
-    bits->bits_left -= num_bits;
-    mask = 1;
-    mask = (mask << num_bits) - 1;
-    bits->byte_data &= ~(mask << shift_pos);
-    bits->byte_data |= (val & mask) << shift_pos;
-    index = -1;
-    byte_data = bits->byte_data;
-    while (bits_write_back > 0)
+    bits_read(bits, 1);
+    val = 0;
+    if (zero_count > 0)
     {
-        bits->data[bits->offset + index] = byte_data;
-        byte_data >>= 8;
-        bits_write_back -= 8;
-        index--;
+        val = bits_read(bits, zero_count);
     }
-    return 0;
+    return (int)(((1u << zero_count) | val) - 1);
+}
+
+/* the prefix length comes from one count leading zeros on the cache */
+static inline int
+ueint(struct bits_t* bits)
+{
+    int code_bits;
+    unsigned long long code;
+
+    if (bits->bits_left < 57)
+    {
+        bits_refill(bits);
+    }
+    if (bits->cache != 0)
+    {
+        code_bits = 2 * __builtin_clzll(bits->cache) + 1;
+        if (code_bits <= bits->bits_left)
+        {
+            code = bits->cache >> (64 - code_bits);
+            bits->cache <<= code_bits;
+            bits->bits_left -= code_bits;
+            return (int)(code - 1);
+        }
+    }
+    return in_ueint_long(bits);
+}
+
+static inline int
+seint(struct bits_t* bits)
+{
+    unsigned int val;
+
+    val = ueint(bits);
+    return val & 1 ? (int)((val + 1) / 2) : -(int)(val / 2);
 }
 
 int
-out_ueint(struct bits_t* bits, int val)
+in_ueint(struct bits_t* bits)
 {
-    int len;
+    if (bits->error)
+    {
+        return 0;
+    }
+    return ueint(bits);
+}
+
+int
+in_seint(struct bits_t* bits)
+{
+    if (bits->error)
+    {
+        return 0;
+    }
+    return seint(bits);
+}
+
+/* decode count consecutive ue(v) into vals, returns bits->error */
+int
+in_ueint_array(struct bits_t* bits, int* vals, int count)
+{
+    int index;
 
-    if (val == 0)
+    for (index = 0; index < count; index++)
     {
-        out_uint(bits, 1, 1);
+        vals[index] = ueint(bits);
     }
-    else
+    return bits->error;
+}
+
+/* decode count consecutive se(v) into vals, returns bits->error */
+int
+in_seint_array(struct bits_t* bits, int* vals, int count)
+{
+    int index;
+
+    for (index = 0; index < count; index++)
+    {
+        vals[index] = seint(bits);
+    }
+    return bits->error;
+}
+
+/* more_rbsp_data(), nonzero when another 1 bit follows the next 1 bit,
+   else the next 1 is rbsp_stop_one_bit, bits does not move */
+int
+bits_more_rbsp_data(const struct bits_t* bits)
+{
+    int ones;
+    struct bits_t lbits;
+
+    lbits = *bits;
+    ones = 0;
+    while (ones < 2)
     {
-        val++;
-        if (val >= 0x01000000)
+        if (bits_peek(&lbits, 8) == 0)
         {
-            len = 24 + g_len_table[val >> 24];
+            /* no 1 in the next byte, if there is one */
+            bits_skip(&lbits, 8);
         }
-        else if (val >= 0x00010000)
+        else
         {
-            len = 16 + g_len_table[val >> 16];
+            ones += bits_read(&lbits, 1);
         }
-        else if (val >= 0x00000100)
+        if (lbits.error || (bits_tell(&lbits) > (lbits.data_bytes << 3)))
         {
-            len = 8 + g_len_table[val >> 8];
+            break;
         }
-        else 
+    }
+    return ones > 1;
+}
+
+/* overwrite num_bits at the read position and move past them */
+int
+out_uint(struct bits_t* bits, int val, int num_bits)
+{
+    int chunk;
+    int shift_pos;
+    int mask;
+    unsigned int uval;
+    long long bit_pos;
+    long long end_pos;
+    char* byte;
+
+    if (bits->error)
+    {
+        return 0;
+    }
+    if (num_bits < 1)
+    {
+        return 0;
+    }
+    if (num_bits > 32)
+    {
+        return 0;
+    }
+    bit_pos = bits_tell(bits);
+    end_pos = bit_pos + num_bits;
+    if (bits->emulation || (bits->iov != NULL) ||
+        (end_pos > bits->data_bytes * 8))
+    {
+        bits_set_error(bits);
+        return 0;
+    }
+    uval = val;
+    while (num_bits > 0)
+    {
+        byte = bits->data + (bit_pos >> 3);
+        chunk = 8 - (bit_pos & 7);
+        if (chunk > num_bits)
         {
-            len = g_len_table[val];
+            chunk = num_bits;
         }
-        out_uint(bits, val, 2 * len - 1);
+        shift_pos = 8 - (bit_pos & 7) - chunk;
+        mask = ((1 << chunk) - 1) << shift_pos;
+        *byte = (*byte & ~mask) |
+                (((uval >> (num_bits - chunk)) << shift_pos) & mask);
+        bit_pos += chunk;
+        num_bits -= chunk;
+    }
+    bits_seek(bits, end_pos);
+    return 0;
+}
+
+/* bits in the ue(v) code of val */
+static inline int
+ue_code_bits(unsigned int val)
+{
+    if (val < 256)
+    {
+        return g_ue_bits_table[val];
+    }
+    return 2 * (64 - __builtin_clzll((unsigned long long)val + 1)) - 1;
+}
+
+int
+out_ueint(struct bits_t* bits, int val)
+{
+    int len;
+
+    len = (ue_code_bits(val) + 1) / 2;
+    if (len > 1)
+    {
+        out_uint(bits, 0, len - 1);
     }
+    out_uint(bits, val + 1, len);
     return 0;
 }
 
@@ -203,3 +618,207 @@ out_seint(struct bits_t* bits, int val)
     return 0;
 }
 
+int
+wbits_init(struct wbits_t* wbits, long long data_bytes)
+{
+    memset(wbits, 0, sizeof(struct wbits_t));
+    if (data_bytes < 64)
+    {
+        data_bytes = 64;
+    }
+    wbits->data = (char*)malloc(data_bytes);
+    if (wbits->data == NULL)
+    {
+        wbits->error = 1;
+        return 1;
+    }
+    wbits->data_bytes = data_bytes;
+    return 0;
+}
+
+int
+wbits_deinit(struct wbits_t* wbits)
+{
+    free(wbits->data);
+    memset(wbits, 0, sizeof(struct wbits_t));
+    return 0;
+}
+
+/* make room for at least bytes more bytes after offset */
+int
+wbits_grow(struct wbits_t* wbits, long long bytes)
+{
+    long long data_bytes;
+    char* data;
+
+    if (wbits->error)
+    {
+        return 1;
+    }
+    data_bytes = wbits->data_bytes;
+    while (data_bytes - wbits->offset < bytes)
+    {
+        data_bytes = data_bytes < 64 ? 64 : data_bytes * 2;
+    }
+    data = (char*)realloc(wbits->data, data_bytes);
+    if (data == NULL)
+    {
+        wbits->error = 1;
+        return 1;
+    }
+    wbits->data = data;
+    wbits->data_bytes = data_bytes;
+    return 0;
+}
+
+/* store the full accumulator */
+int
+wbits_store_word(struct wbits_t* wbits)
+{
+    unsigned long long val;
+
+    if (wbits->data_bytes - wbits->offset < 8)
+    {
+        if (wbits_grow(wbits, 8) != 0)
+        {
+            return 1;
+        }
+    }
+    val = wbits->acc;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    val = __builtin_bswap64(val);
+#endif
+    memcpy(wbits->data + wbits->offset, &val, 8);
+    wbits->offset += 8;
+    return 0;
+}
+
+int
+put_ueint(struct wbits_t* wbits, unsigned int val)
+{
+    put_bits(wbits, (unsigned long long)val + 1, ue_code_bits(val));
+    return 0;
+}
+
+int
+put_seint(struct wbits_t* wbits, int val)
+{
+    if (val <= 0)
+    {
+        put_ueint(wbits, -(unsigned int)val * 2);
+    }
+    else
+    {
+        put_ueint(wbits, (unsigned int)val * 2 - 1);
+    }
+    return 0;
+}
+
+/* rbsp_stop_one_bit then rbsp_alignment_zero_bits */
+int
+put_trailing_bits(struct wbits_t* wbits)
+{
+    put_bits(wbits, 1, 1);
+    if (wbits->acc_bits & 7)
+    {
+        put_bits(wbits, 0, 8 - (wbits->acc_bits & 7));
+    }
+    return 0;
+}
+
+/* store what is left in the accumulator, a partial last byte is zero
+   padded so only flush once the output is byte aligned or complete
+   returns the total bytes in data */
+long long
+wbits_flush(struct wbits_t* wbits)
+{
+    int bytes;
+    unsigned long long val;
+
+    bytes = (wbits->acc_bits + 7) / 8;
+    if (bytes > 0)
+    {
+        if (wbits->data_bytes - wbits->offset < 8)
+        {
+            if (wbits_grow(wbits, 8) != 0)
+            {
+                return wbits->offset;
+            }
+        }
+        val = wbits->acc;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        val = __builtin_bswap64(val);
+#endif
+        memcpy(wbits->data + wbits->offset, &val, 8);
+        wbits->offset += bytes;
+        wbits->acc = 0;
+        wbits->acc_bits = 0;
+    }
+    return wbits->offset;
+}
+
+/* append num_bits of data starting at bit_offset, aligned runs go
+   through memcpy, unaligned ones 64 bits per put_bits */
+int
+wbits_copy(struct wbits_t* wbits, const char* data, long long bit_offset,
+           long long num_bits)
+{
+    int chunk;
+    long long bytes;
+    unsigned int byte_data;
+
+    data += bit_offset >> 3;
+    bit_offset &= 7;
+    if ((bit_offset > 0) && (num_bits > 0))
+    {
+        chunk = 8 - bit_offset;
+        if (chunk > num_bits)
+        {
+            chunk = num_bits;
+        }
+        byte_data = (*data & 0xFF) >> (8 - bit_offset - chunk);
+        put_uint(wbits, byte_data, chunk);
+        num_bits -= chunk;
+        data++;
+    }
+    if ((wbits->acc_bits & 7) == 0)
+    {
+        bytes = num_bits >> 3;
+        if (bytes > 0)
+        {
+            wbits_flush(wbits);
+            if (wbits->data_bytes - wbits->offset < bytes)
+            {
+                if (wbits_grow(wbits, bytes) != 0)
+                {
+                    return 1;
+                }
+            }
+            memcpy(wbits->data + wbits->offset, data, bytes);
+            wbits->offset += bytes;
+            data += bytes;
+            num_bits -= bytes << 3;
+        }
+    }
+    else
+    {
+        while (num_bits >= 64)
+        {
+            put_bits(wbits, bits_load_be64(data), 64);
+            data += 8;
+            num_bits -= 64;
+        }
+        while (num_bits >= 8)
+        {
+            put_uint(wbits, *data & 0xFF, 8);
+            data++;
+            num_bits -= 8;
+        }
+    }
+    if (num_bits > 0)
+    {
+        byte_data = (*data & 0xFF) >> (8 - num_bits);
+        put_uint(wbits, byte_data, num_bits);
+    }
+    return wbits->error;
+}
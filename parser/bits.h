@@ -2,25 +2,183 @@
 #ifndef _BITS_H_
 #define _BITS_H_
 
+#include <string.h>
+#include <sys/uio.h>
+
+/* the reader keeps up to 64 unread bits msb aligned in cache and refills
+   it with a single big endian word load while 8 or more bytes remain in
+   data, bytes past data_bytes are never loaded
+   after an error the reader is drained so every later read returns 0,
+   error_pos keeps the bit in the escaped nal of the read that failed
+   set up with bits_init_nal it reads escaped nal bytes and drops
+   emulation_prevention_three_byte during refill, epb_bytes counts the
+   dropped bytes up to offset, bits_nal_tell maps back to the nal
+   set up with bits_init_iov the data is a list of segments read in order,
+   offset and data_bytes count bytes over all segments, data points at
+   the current segment that starts at seg_start */
 struct bits_t
 {
-    long long byte_data;
+    unsigned long long cache;
     char* data;
-    int data_bytes;
-    int offset;
-    int bits_left;
+    long long data_bytes;
+    long long offset;       /* next byte of data to load into cache */
+    int bits_left;          /* valid bits in cache */
     int error;
+    long long error_pos;
+    int emulation;          /* data is an escaped nal */
+    int zero_count;         /* zero bytes just before offset */
+    long long epb_bytes;
+    long long epb_pos[8];   /* rbsp byte after each recent dropped byte */
+    const struct iovec* iov;
+    int iov_count;
+    int iov_index;
+    long long seg_start;
+    long long seg_bytes;
 };
 
 int
-bits_init(struct bits_t* bits, char* data, int data_bytes);
+bits_init(struct bits_t* bits, char* data, long long data_bytes);
+int
+bits_init_nal(struct bits_t* bits, char* data, long long data_bytes);
+int
+bits_init_iov(struct bits_t* bits, const struct iovec* iov, int iov_count);
+int
+bits_init_nal_iov(struct bits_t* bits, const struct iovec* iov,
+                  int iov_count);
+int
+bits_refill_tail(struct bits_t* bits);
+int
+bits_refill_nal(struct bits_t* bits);
+int
+bits_refill_iov(struct bits_t* bits);
+int
+bits_seek(struct bits_t* bits, long long bit_pos);
+long long
+bits_nal_tell(const struct bits_t* bits);
+
+static inline unsigned long long
+bits_load_be64(const char* data)
+{
+    unsigned long long val;
+
+    memcpy(&val, data, 8);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    val = __builtin_bswap64(val);
+#endif
+    return val;
+}
+
+/* make at least 57 bits available in cache unless the data runs out */
+static inline void
+bits_refill(struct bits_t* bits)
+{
+    int bytes;
+
+    if (bits->bits_left > 56)
+    {
+        return;
+    }
+    if (bits->iov != NULL)
+    {
+        bits_refill_iov(bits);
+        return;
+    }
+    if (bits->emulation)
+    {
+        bits_refill_nal(bits);
+        return;
+    }
+    if (bits->offset + 8 <= bits->data_bytes)
+    {
+        bits->cache |= bits_load_be64(bits->data + bits->offset) >>
+                       bits->bits_left;
+        bytes = (64 - bits->bits_left) >> 3;
+        bits->offset += bytes;
+        bits->bits_left += bytes << 3;
+        return;
+    }
+    bits_refill_tail(bits);
+}
+
+/* position of the next unread bit in the rbsp */
+static inline long long
+bits_tell(const struct bits_t* bits)
+{
+    return (bits->offset - bits->epb_bytes) * 8 - bits->bits_left;
+}
+
+static inline void
+bits_set_error(struct bits_t* bits)
+{
+    if (!bits->error)
+    {
+        bits->error_pos = bits_nal_tell(bits);
+    }
+    bits->error = 1;
+    bits->cache = 0;
+    bits->bits_left = 0;
+    bits->offset = bits->data_bytes;
+}
+
+/* num_bits 1 to 32, bits past the end of data peek as zero */
+static inline unsigned int
+bits_peek(struct bits_t* bits, int num_bits)
+{
+    if (bits->bits_left < num_bits)
+    {
+        bits_refill(bits);
+    }
+    return (unsigned int)(bits->cache >> (64 - num_bits));
+}
+
+/* num_bits 1 to 32 */
+static inline unsigned int
+bits_read(struct bits_t* bits, int num_bits)
+{
+    unsigned int rv;
+
+    if (bits->bits_left < num_bits)
+    {
+        bits_refill(bits);
+        if (bits->bits_left < num_bits)
+        {
+            bits_set_error(bits);
+            return 0;
+        }
+    }
+    rv = (unsigned int)(bits->cache >> (64 - num_bits));
+    bits->cache <<= num_bits;
+    bits->bits_left -= num_bits;
+    return rv;
+}
+
+/* any num_bits >= 0 */
+static inline void
+bits_skip(struct bits_t* bits, long long num_bits)
+{
+    if (num_bits < bits->bits_left)
+    {
+        bits->cache <<= num_bits;
+        bits->bits_left -= num_bits;
+        return;
+    }
+    bits_seek(bits, bits_tell(bits) + num_bits);
+}
 
 int
 in_uint(struct bits_t* bits, int num_bits);
+unsigned int
+in_uint32(struct bits_t* bits);
 int
 in_ueint(struct bits_t* bits);
 int
 in_seint(struct bits_t* bits);
+int
+in_ueint_array(struct bits_t* bits, int* vals, int count);
+int
+in_seint_array(struct bits_t* bits, int* vals, int count);
+int
+bits_more_rbsp_data(const struct bits_t* bits);
 
 int
 out_uint(struct bits_t* bits, int val, int num_bits);
@@ -29,4 +187,72 @@ out_ueint(struct bits_t* bits, int val);
 int
 out_seint(struct bits_t* bits, int val);
 
+/* append only writer, bits collect msb first in a 64 bit accumulator
+   that is stored a whole word at a time, data grows as needed */
+struct wbits_t
+{
+    unsigned long long acc;
+    char* data;
+    long long data_bytes;   /* allocated */
+    long long offset;       /* bytes stored */
+    int acc_bits;           /* 0 to 63 */
+    int error;
+};
+
+int
+wbits_init(struct wbits_t* wbits, long long data_bytes);
+int
+wbits_deinit(struct wbits_t* wbits);
+int
+wbits_grow(struct wbits_t* wbits, long long bytes);
+int
+wbits_store_word(struct wbits_t* wbits);
+long long
+wbits_flush(struct wbits_t* wbits);
+int
+wbits_copy(struct wbits_t* wbits, const char* data, long long bit_offset,
+           long long num_bits);
+
+/* bits written so far */
+static inline long long
+wbits_tell(const struct wbits_t* wbits)
+{
+    return wbits->offset * 8 + wbits->acc_bits;
+}
+
+/* num_bits 1 to 64, val must fit in num_bits */
+static inline void
+put_bits(struct wbits_t* wbits, unsigned long long val, int num_bits)
+{
+    int free_bits;
+    int rem_bits;
+
+    free_bits = 64 - wbits->acc_bits;
+    if (num_bits < free_bits)
+    {
+        wbits->acc |= val << (free_bits - num_bits);
+        wbits->acc_bits += num_bits;
+        return;
+    }
+    rem_bits = num_bits - free_bits;
+    wbits->acc |= val >> rem_bits;
+    wbits_store_word(wbits);
+    wbits->acc = rem_bits > 0 ? val << (64 - rem_bits) : 0;
+    wbits->acc_bits = rem_bits;
+}
+
+/* num_bits 1 to 32 */
+static inline void
+put_uint(struct wbits_t* wbits, unsigned int val, int num_bits)
+{
+    put_bits(wbits, val & (0xFFFFFFFFu >> (32 - num_bits)), num_bits);
+}
+
+int
+put_ueint(struct wbits_t* wbits, unsigned int val);
+int
+put_seint(struct wbits_t* wbits, int val);
+int
+put_trailing_bits(struct wbits_t* wbits);
+
 #endif
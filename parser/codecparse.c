@@ -0,0 +1,254 @@
+
+#include <string.h>
+
+#include "bits.h"
+#include "utils.h"
+#include "codecparse.h"
+
+/* mem is mem_bytes of the caller's to keep the sets in, or NULL to have
+   mem_bytes allocated here once, CP_ARENA_BYTES is enough for any
+   stream that does not keep changing its sets */
+int
+cp_init(struct cp_context_t* ctx, void* mem, long long mem_bytes)
+{
+    memset(ctx, 0, sizeof(struct cp_context_t));
+    if (arena_init(&(ctx->arena), mem, mem_bytes) != 0)
+    {
+        return CP_ERROR_MEMORY;
+    }
+    params_init_arena(&(ctx->params), &(ctx->arena));
+    return CP_OK;
+}
+
+int
+cp_deinit(struct cp_context_t* ctx)
+{
+    params_deinit(&(ctx->params));
+    arena_deinit(&(ctx->arena));
+    return CP_OK;
+}
+
+/* forget every set and give the arena back, for a new stream or after
+   CP_ERROR_MEMORY */
+int
+cp_reset(struct cp_context_t* ctx)
+{
+    params_deinit(&(ctx->params));
+    arena_reset(&(ctx->arena));
+    params_init_arena(&(ctx->params), &(ctx->arena));
+    memset(&(ctx->error), 0, sizeof(struct cp_error_t));
+    ctx->nal_count = 0;
+    return CP_OK;
+}
+
+/* returns code */
+static int
+cp_fail(struct cp_context_t* ctx, int code, int nal_unit_type,
+        long long bit_pos)
+{
+    ctx->error.code = code;
+    ctx->error.nal_unit_type = nal_unit_type;
+    ctx->error.nal_index = ctx->nal_count;
+    ctx->error.byte_offset = bit_pos >> 3;
+    ctx->error.bit_offset = (int)(bit_pos & 7);
+    ctx->nal_count++;
+    return code;
+}
+
+static int
+cp_params_fail(struct cp_context_t* ctx, int nal_unit_type)
+{
+    int code;
+
+    switch (ctx->params.error)
+    {
+        case PARAMS_ERROR_TRUNCATED:
+            code = CP_ERROR_TRUNCATED;
+            break;
+        case PARAMS_ERROR_MEMORY:
+            code = CP_ERROR_MEMORY;
+            break;
+        default:
+            code = CP_ERROR_SYNTAX;
+            break;
+    }
+    return cp_fail(ctx, code, nal_unit_type, ctx->params.error_pos);
+}
+
+static int
+cp_parse_slice(struct cp_context_t* ctx, const char* data, int bytes,
+               struct cp_nal_t* nal)
+{
+    int rv;
+    struct bits_t bits;
+
+    bits_init_nal(&bits, (char*)data, bytes);
+    rv = parse_slice_header(&bits, ctx->params.sps, ctx->params.pps,
+                            &(nal->slice));
+    if (bits.error)
+    {
+        return cp_fail(ctx, CP_ERROR_TRUNCATED, nal->nal_unit_type,
+                       bits.error_pos);
+    }
+    if (rv == 1)
+    {
+        return cp_fail(ctx, CP_ERROR_NO_PARAMS, nal->nal_unit_type,
+                       bits_nal_tell(&bits));
+    }
+    if (rv != 0)
+    {
+        return cp_fail(ctx, CP_ERROR_SYNTAX, nal->nal_unit_type,
+                       bits_nal_tell(&bits));
+    }
+    nal->pps = ctx->params.pps[nal->slice.pic_parameter_set_id];
+    nal->sps = ctx->params.sps[nal->pps->seq_parameter_set_id];
+    return CP_OK;
+}
+
+/* data is one escaped nal without its start code, it is only read
+   sps and pps are kept in ctx for the slices after them
+   returns CP_OK or a CP_ERROR_, cp_last_error says where */
+int
+cp_parse_nal(struct cp_context_t* ctx, const char* data, int bytes,
+             struct cp_nal_t* nal)
+{
+    int rv;
+    int id;
+    int event;
+
+    if ((data == NULL) || (bytes < 0) || (nal == NULL))
+    {
+        return cp_fail(ctx, CP_ERROR_ARGS, 0, 0);
+    }
+    memset(nal, 0, sizeof(struct cp_nal_t));
+    if (bytes < 1)
+    {
+        return cp_fail(ctx, CP_ERROR_TRUNCATED, 0, 0);
+    }
+    nal->nal_ref_idc = (data[0] >> 5) & 3;
+    nal->nal_unit_type = data[0] & 0x1F;
+    if (data[0] & 0x80)
+    {
+        return cp_fail(ctx, CP_ERROR_FORBIDDEN_BIT, nal->nal_unit_type, 0);
+    }
+    switch (nal->nal_unit_type)
+    {
+        case 1:
+        case 5:
+            rv = cp_parse_slice(ctx, data, bytes, nal);
+            if (rv != CP_OK)
+            {
+                return rv;
+            }
+            break;
+        case 7:
+        case 8:
+            event = params_parse(&(ctx->params), (char*)data, bytes,
+                                 nal->nal_unit_type, &id);
+            if (event == PARAMS_ERROR)
+            {
+                return cp_params_fail(ctx, nal->nal_unit_type);
+            }
+            nal->event = event;
+            nal->id = id;
+            if (nal->nal_unit_type == 7)
+            {
+                nal->sps = ctx->params.sps[id];
+            }
+            else
+            {
+                nal->pps = ctx->params.pps[id];
+            }
+            break;
+        default:
+            break;
+    }
+    ctx->nal_count++;
+    return CP_OK;
+}
+
+/* walks an Annex B buffer, *offset starts at 0 and is moved past each
+   nal, *nal and *nal_bytes are the nal without its start code or
+   trailing zeros
+   returns 0 or 1 when there are no more nals */
+int
+cp_next_nal(const char* data, long long data_bytes, long long* offset,
+            const char** nal, int* nal_bytes)
+{
+    int start_code_bytes;
+    const char* end_data;
+    const char* start;
+    const char* end;
+
+    end_data = data + data_bytes;
+    start = find_start_code(data + *offset, end_data, &start_code_bytes);
+    while (start < end_data)
+    {
+        start += start_code_bytes;
+        end = find_start_code(start, end_data, &start_code_bytes);
+        *offset = end - data;
+        while ((end > start) && (end[-1] == 0))
+        {
+            end--;
+        }
+        if (end > start)
+        {
+            *nal = start;
+            *nal_bytes = (int)(end - start);
+            return 0;
+        }
+        start = data + *offset;
+    }
+    *offset = data_bytes;
+    return 1;
+}
+
+/* NULL when the id has not been seen */
+const struct sps_t*
+cp_sps(const struct cp_context_t* ctx, int id)
+{
+    if ((id < 0) || (id >= MAX_SPS))
+    {
+        return NULL;
+    }
+    return ctx->params.sps[id];
+}
+
+const struct pps_t*
+cp_pps(const struct cp_context_t* ctx, int id)
+{
+    if ((id < 0) || (id >= MAX_PPS))
+    {
+        return NULL;
+    }
+    return ctx->params.pps[id];
+}
+
+const struct cp_error_t*
+cp_last_error(const struct cp_context_t* ctx)
+{
+    return &(ctx->error);
+}
+
+const char*
+cp_error_name(int code)
+{
+    switch (code)
+    {
+        case CP_OK:
+            return "ok";
+        case CP_ERROR_ARGS:
+            return "bad argument";
+        case CP_ERROR_MEMORY:
+            return "out of memory";
+        case CP_ERROR_FORBIDDEN_BIT:
+            return "forbidden_zero_bit set";
+        case CP_ERROR_TRUNCATED:
+            return "truncated";
+        case CP_ERROR_SYNTAX:
+            return "value out of range";
+        case CP_ERROR_NO_PARAMS:
+            return "missing sps or pps";
+    }
+    return "unknown";
+}
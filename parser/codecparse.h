@@ -0,0 +1,93 @@
+
+#ifndef _CODECPARSE_H_
+#define _CODECPARSE_H_
+
+#include "sps.h"
+#include "pps.h"
+#include "slice.h"
+#include "params.h"
+#include "arena.h"
+
+/* libcodecparse, h.264 parameter sets and slice headers parsed straight
+   from escaped nals
+   everything lives in a cp_context_t the caller owns, one per stream, so
+   any number of streams can be parsed on as many threads as long as a
+   context is only used by one at a time
+   sets are kept in the context's arena, a set is allocated the first
+   time its id shows up and again only for a longer nal, parsing a nal
+   allocates nothing and nothing is printed */
+
+#define CP_ARENA_BYTES          (256 * 1024)    /* every sps and pps id
+                                                   with room for changes */
+
+/* returns of cp_ calls, also cp_error_t.code */
+#define CP_OK                   0
+#define CP_ERROR_ARGS           -1  /* bad argument */
+#define CP_ERROR_MEMORY         -2  /* the arena is used up, see
+                                       cp_reset */
+#define CP_ERROR_FORBIDDEN_BIT  -3  /* forbidden_zero_bit is set */
+#define CP_ERROR_TRUNCATED      -4  /* read past the end of the nal */
+#define CP_ERROR_SYNTAX         -5  /* a value out of range */
+#define CP_ERROR_NO_PARAMS      -6  /* a slice refers to a pps or sps not
+                                       seen yet */
+
+/* where the last error was found, byte_offset is into the escaped nal
+   handed to cp_parse_nal, counting its header byte, bit_offset is 0 for
+   the msb to 7 */
+struct cp_error_t
+{
+    int code;
+    int nal_unit_type;
+    long long nal_index;        /* nals parsed before this one */
+    long long byte_offset;
+    int bit_offset;
+};
+
+/* what cp_parse_nal made of a nal
+   for an sps or pps event is a PARAMS_ event and id its id, sps or pps
+   points at the set kept in the context
+   for a slice, slice is its header and sps and pps the sets it refers to
+   other nals only get the header fields
+   the pointers stay good until the set is replaced, cp_reset or
+   cp_deinit */
+struct cp_nal_t
+{
+    int nal_ref_idc;
+    int nal_unit_type;
+    int event;
+    int id;
+    const struct sps_t* sps;
+    const struct pps_t* pps;
+    struct slice_t slice;
+};
+
+struct cp_context_t
+{
+    struct arena_t arena;
+    struct params_t params;
+    struct cp_error_t error;
+    long long nal_count;
+};
+
+int
+cp_init(struct cp_context_t* ctx, void* mem, long long mem_bytes);
+int
+cp_deinit(struct cp_context_t* ctx);
+int
+cp_reset(struct cp_context_t* ctx);
+int
+cp_parse_nal(struct cp_context_t* ctx, const char* data, int bytes,
+             struct cp_nal_t* nal);
+int
+cp_next_nal(const char* data, long long data_bytes, long long* offset,
+            const char** nal, int* nal_bytes);
+const struct sps_t*
+cp_sps(const struct cp_context_t* ctx, int id);
+const struct pps_t*
+cp_pps(const struct cp_context_t* ctx, int id);
+const struct cp_error_t*
+cp_last_error(const struct cp_context_t* ctx);
+const char*
+cp_error_name(int code);
+
+#endif
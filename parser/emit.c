@@ -0,0 +1,727 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emit.h"
+
+#define EMIT_GROW_BYTES     (64 * 1024)
+
+static const char g_hex_digits[] = "0123456789abcdef";
+
+static const char g_digit_pairs[] =
+    "000102030405060708091011121314151617181920212223242526272829"
+    "303132333435363738394041424344454647484950515253545556575859"
+    "606162636465666768697071727374757677787980818283848586878889"
+    "90919293949596979899";
+
+static const char* g_format_names[] = { "text", "binary", "jsonl", "csv" };
+
+/* EMIT_ for a -o name, -1 when there is none */
+int
+emit_format(const char* name)
+{
+    int index;
+
+    for (index = 0; index < 4; index++)
+    {
+        if (strcmp(name, g_format_names[index]) == 0)
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+int
+emit_init(struct emit_t* emit, int fd, int format, const char* select)
+{
+    int index;
+
+    memset(emit, 0, sizeof(struct emit_t));
+    emit->fd = fd;
+    emit->format = format;
+    emit->hexdump = format == EMIT_TEXT;
+    emit->select = select;
+    for (index = 0; index < EMIT_MAX_RECORDS; index++)
+    {
+        emit->num_picks[index] = -1;
+    }
+    return 0;
+}
+
+/* write out what is buffered, with fd -1 there is nowhere to write it */
+int
+emit_flush(struct emit_t* emit)
+{
+    int sent;
+    int offset;
+
+    if (emit->fd < 0)
+    {
+        return 0;
+    }
+    offset = 0;
+    while (offset < emit->bytes)
+    {
+        sent = write(emit->fd, emit->buf + offset, emit->bytes - offset);
+        if (sent < 1)
+        {
+            emit->error = 1;
+            break;
+        }
+        offset += sent;
+    }
+    emit->bytes = 0;
+    return emit->error;
+}
+
+int
+emit_deinit(struct emit_t* emit)
+{
+    int index;
+    int error;
+
+    error = emit_flush(emit);
+    for (index = 0; index < EMIT_MAX_RECORDS; index++)
+    {
+        free(emit->picks[index]);
+    }
+    free(emit->buf);
+    memset(emit, 0, sizeof(struct emit_t));
+    return error;
+}
+
+/* room for bytes more at buf + bytes, flushing when there is an fd and
+   growing buf when that is not enough */
+static int
+emit_reserve(struct emit_t* emit, int bytes)
+{
+    int alloc;
+    char* buf;
+
+    if (emit->bytes + bytes <= emit->alloc)
+    {
+        return 0;
+    }
+    if ((emit->bytes > 0) && (emit_flush(emit) != 0))
+    {
+        return 1;
+    }
+    if (emit->bytes + bytes <= emit->alloc)
+    {
+        return 0;
+    }
+    alloc = emit->alloc;
+    if (alloc < 1)
+    {
+        alloc = emit->fd < 0 ? EMIT_GROW_BYTES : EMIT_BUFFER_BYTES;
+    }
+    while (alloc < emit->bytes + bytes)
+    {
+        alloc *= 2;
+    }
+    buf = (char*)realloc(emit->buf, alloc);
+    if (buf == NULL)
+    {
+        emit->error = 1;
+        return 1;
+    }
+    emit->buf = buf;
+    emit->alloc = alloc;
+    return 0;
+}
+
+int
+emit_data(struct emit_t* emit, const char* data, int bytes)
+{
+    if (emit_reserve(emit, bytes) != 0)
+    {
+        return 1;
+    }
+    memcpy(emit->buf + emit->bytes, data, bytes);
+    emit->bytes += bytes;
+    return 0;
+}
+
+int
+emit_str(struct emit_t* emit, const char* text)
+{
+    return emit_data(emit, text, strlen(text));
+}
+
+/* decimal val into text, returns the digits written, at most 20 */
+static int
+format_int(char* text, long long val)
+{
+    int count;
+    int bytes;
+    unsigned long long uval;
+    char digits[24];
+
+    bytes = 0;
+    uval = val;
+    if (val < 0)
+    {
+        text[bytes++] = '-';
+        uval = -uval;
+    }
+    count = sizeof(digits);
+    while (uval >= 100)
+    {
+        count -= 2;
+        memcpy(digits + count, g_digit_pairs + (uval % 100) * 2, 2);
+        uval /= 100;
+    }
+    if (uval >= 10)
+    {
+        count -= 2;
+        memcpy(digits + count, g_digit_pairs + uval * 2, 2);
+    }
+    else
+    {
+        digits[--count] = '0' + uval;
+    }
+    memcpy(text + bytes, digits + count, sizeof(digits) - count);
+    return bytes + sizeof(digits) - count;
+}
+
+int
+emit_int(struct emit_t* emit, long long val)
+{
+    if (emit_reserve(emit, 24) != 0)
+    {
+        return 1;
+    }
+    emit->bytes += format_int(emit->buf + emit->bytes, val);
+    return 0;
+}
+
+/* lower case hex, at least digits of them */
+int
+emit_hex(struct emit_t* emit, unsigned int val, int digits)
+{
+    int count;
+
+    count = 1;
+    while ((count < 8) && ((val >> (count * 4)) != 0))
+    {
+        count++;
+    }
+    if (count < digits)
+    {
+        count = digits;
+    }
+    if (emit_reserve(emit, count) != 0)
+    {
+        return 1;
+    }
+    emit->bytes += count;
+    while (count-- > 0)
+    {
+        emit->buf[emit->bytes - count - 1] =
+            g_hex_digits[count < 8 ? (val >> (count * 4)) & 0xF : 0];
+    }
+    return 0;
+}
+
+/* nonzero when the comma list select has name or record.name */
+static int
+emit_selected(const char* select, const char* record, const char* name)
+{
+    int bytes;
+    int record_bytes;
+    int name_bytes;
+    const char* end;
+
+    record_bytes = strlen(record);
+    name_bytes = strlen(name);
+    while (*select != 0)
+    {
+        end = strchr(select, ',');
+        bytes = end == NULL ? (int)strlen(select) : (int)(end - select);
+        if ((bytes == name_bytes) && (strncmp(select, name, bytes) == 0))
+        {
+            return 1;
+        }
+        if ((bytes == record_bytes + 1 + name_bytes) &&
+            (strncmp(select, record, record_bytes) == 0) &&
+            (select[record_bytes] == '.') &&
+            (strncmp(select + record_bytes + 1, name, name_bytes) == 0))
+        {
+            return 1;
+        }
+        select += bytes;
+        if (*select == ',')
+        {
+            select++;
+        }
+    }
+    return 0;
+}
+
+/* fields of record to format, looked up on first use
+   returns their count or -1 on error */
+static int
+emit_picks(struct emit_t* emit, const struct record_t* record)
+{
+    int index;
+    int count;
+    short* picks;
+
+    if ((record->id < 0) || (record->id >= EMIT_MAX_RECORDS))
+    {
+        return -1;
+    }
+    if (emit->num_picks[record->id] >= 0)
+    {
+        return emit->num_picks[record->id];
+    }
+    picks = (short*)malloc(sizeof(short) * (record->num_fields + 1));
+    if (picks == NULL)
+    {
+        return -1;
+    }
+    count = 0;
+    for (index = 0; index < record->num_fields; index++)
+    {
+        if ((emit->select == NULL) ||
+            emit_selected(emit->select, record->name,
+                          record->fields[index].name))
+        {
+            picks[count++] = index;
+        }
+    }
+    emit->picks[record->id] = picks;
+    emit->num_picks[record->id] = count;
+    return count;
+}
+
+/* nonzero when emit_record would format any field of record */
+int
+emit_wants(struct emit_t* emit, const struct record_t* record)
+{
+    return emit_picks(emit, record) > 0;
+}
+
+static long long
+field_value(const struct field_t* field, const void* obj, int index)
+{
+    const char* data;
+
+    data = (const char*)obj + field->offset;
+    switch (field->kind)
+    {
+        case FIELD_UINT:
+            return *((const unsigned int*)data);
+        case FIELD_INT64:
+            return *((const long long*)data);
+        case FIELD_ARRAY:
+            return *((const int*)(data + index * field->stride));
+        default:
+            return *((const int*)data);
+    }
+}
+
+static int
+field_count(const struct field_t* field, const void* obj)
+{
+    int count;
+
+    count = *((const int*)((const char*)obj + field->count_offset)) +
+            field->count_add;
+    if (count < 0)
+    {
+        return 0;
+    }
+    return count < field->max_count ? count : field->max_count;
+}
+
+/* one text line, name[index] when index is not -1 */
+static int
+emit_text_line(struct emit_t* emit, const struct record_t* record,
+               const struct field_t* field, long long val, int index)
+{
+    int bytes;
+    int name_bytes;
+    char* text;
+
+    name_bytes = strlen(field->name);
+    if (emit_reserve(emit, record->text_indent + record->text_width +
+                           name_bytes + 64) != 0)
+    {
+        return 1;
+    }
+    text = emit->buf + emit->bytes;
+    memset(text, ' ', record->text_indent);
+    bytes = record->text_indent;
+    memcpy(text + bytes, field->name, name_bytes);
+    bytes += name_bytes;
+    if (index >= 0)
+    {
+        text[bytes++] = '[';
+        bytes += format_int(text + bytes, index);
+        text[bytes++] = ']';
+    }
+    do
+    {
+        text[bytes++] = ' ';
+    } while (bytes < record->text_indent + record->text_width);
+    emit->bytes += bytes;
+    if (field->kind == FIELD_HEX)
+    {
+        emit_data(emit, "0x", 2);
+        emit_hex(emit, (unsigned int)val, 3);
+    }
+    else
+    {
+        emit_int(emit, val);
+    }
+    return emit_data(emit, "\n", 1);
+}
+
+static int
+emit_text_record(struct emit_t* emit, const struct record_t* record,
+                 const void* obj, int num_picks)
+{
+    int index;
+    int jndex;
+    int count;
+    const struct field_t* field;
+
+    for (index = 0; index < num_picks; index++)
+    {
+        field = record->fields + emit->picks[record->id][index];
+        if ((field->show != NULL) && !field->show(obj))
+        {
+            continue;
+        }
+        if (field->kind != FIELD_ARRAY)
+        {
+            emit_text_line(emit, record, field, field_value(field, obj, 0),
+                           -1);
+            continue;
+        }
+        count = field_count(field, obj);
+        for (jndex = 0; jndex < count; jndex++)
+        {
+            emit_text_line(emit, record, field,
+                           field_value(field, obj, jndex), jndex);
+        }
+    }
+    return emit->error;
+}
+
+/* a value or array for jsonl and csv, array values split by sep */
+static int
+emit_value(struct emit_t* emit, const struct field_t* field,
+           const void* obj, const char* open, const char* sep,
+           const char* close)
+{
+    int index;
+    int count;
+
+    if (field->kind != FIELD_ARRAY)
+    {
+        return emit_int(emit, field_value(field, obj, 0));
+    }
+    emit_str(emit, open);
+    count = field_count(field, obj);
+    for (index = 0; index < count; index++)
+    {
+        if (index > 0)
+        {
+            emit_str(emit, sep);
+        }
+        emit_int(emit, field_value(field, obj, index));
+    }
+    return emit_str(emit, close);
+}
+
+static int
+emit_jsonl_record(struct emit_t* emit, const struct record_t* record,
+                  const void* obj, int num_picks)
+{
+    int index;
+    const struct field_t* field;
+
+    emit_str(emit, "{\"record\":\"");
+    emit_str(emit, record->name);
+    emit_data(emit, "\"", 1);
+    for (index = 0; index < num_picks; index++)
+    {
+        field = record->fields + emit->picks[record->id][index];
+        if ((field->show != NULL) && !field->show(obj))
+        {
+            continue;
+        }
+        emit_data(emit, ",\"", 2);
+        emit_str(emit, field->name);
+        emit_data(emit, "\":", 2);
+        emit_value(emit, field, obj, "[", ",", "]");
+    }
+    return emit_data(emit, "}\n", 2);
+}
+
+static int
+emit_csv_record(struct emit_t* emit, const struct record_t* record,
+                const void* obj, int num_picks)
+{
+    int index;
+    const struct field_t* field;
+
+    emit_str(emit, record->name);
+    for (index = 0; index < num_picks; index++)
+    {
+        field = record->fields + emit->picks[record->id][index];
+        emit_data(emit, ",", 1);
+        if ((field->show == NULL) || field->show(obj))
+        {
+            emit_value(emit, field, obj, "", ";", "");
+        }
+    }
+    return emit_data(emit, "\n", 1);
+}
+
+static int
+emit_binary_record(struct emit_t* emit, const struct record_t* record,
+                   const void* obj, int num_picks)
+{
+    int index;
+    int jndex;
+    int count;
+    int val;
+    int shown;
+    long long val64;
+    unsigned char id;
+    const struct field_t* field;
+
+    id = record->id;
+    emit_data(emit, (const char*)&id, 1);
+    for (index = 0; index < num_picks; index++)
+    {
+        field = record->fields + emit->picks[record->id][index];
+        shown = (field->show == NULL) || field->show(obj);
+        if (field->kind == FIELD_INT64)
+        {
+            val64 = shown ? field_value(field, obj, 0) : 0;
+            emit_data(emit, (const char*)&val64, 8);
+        }
+        else if (field->kind == FIELD_ARRAY)
+        {
+            count = shown ? field_count(field, obj) : 0;
+            id = count;
+            emit_data(emit, (const char*)&id, 1);
+            for (jndex = 0; jndex < count; jndex++)
+            {
+                val = field_value(field, obj, jndex);
+                emit_data(emit, (const char*)&val, 4);
+            }
+        }
+        else
+        {
+            val = shown ? field_value(field, obj, 0) : 0;
+            emit_data(emit, (const char*)&val, 4);
+        }
+    }
+    return emit->error;
+}
+
+/* csv header lines or binary schemas for the records, before any of
+   them is emitted, nothing for the other formats */
+int
+emit_header(struct emit_t* emit, const struct record_t* const* records,
+            int num_records)
+{
+    int index;
+    int jndex;
+    int num_picks;
+    unsigned char val[4];
+    unsigned short count;
+    const struct record_t* record;
+    const struct field_t* field;
+
+    if ((emit->format != EMIT_CSV) && (emit->format != EMIT_BINARY))
+    {
+        return 0;
+    }
+    for (index = 0; index < num_records; index++)
+    {
+        record = records[index];
+        num_picks = emit_picks(emit, record);
+        if (num_picks < 1)
+        {
+            continue;
+        }
+        if (emit->format == EMIT_CSV)
+        {
+            emit_data(emit, "#", 1);
+            emit_str(emit, record->name);
+        }
+        else
+        {
+            val[0] = EMIT_BINARY_SCHEMA;
+            val[1] = record->id;
+            count = num_picks;
+            memcpy(val + 2, &count, 2);
+            emit_data(emit, (const char*)val, 4);
+            emit_data(emit, record->name, strlen(record->name) + 1);
+        }
+        for (jndex = 0; jndex < num_picks; jndex++)
+        {
+            field = record->fields + emit->picks[record->id][jndex];
+            if (emit->format == EMIT_CSV)
+            {
+                emit_data(emit, ",", 1);
+                emit_str(emit, field->name);
+            }
+            else
+            {
+                val[0] = field->kind;
+                emit_data(emit, (const char*)val, 1);
+                emit_data(emit, field->name, strlen(field->name) + 1);
+            }
+        }
+        if (emit->format == EMIT_CSV)
+        {
+            emit_data(emit, "\n", 1);
+        }
+    }
+    if ((emit->format == EMIT_CSV) && emit->hexdump)
+    {
+        emit_str(emit, "#data,bytes,hex\n");
+    }
+    return emit->error;
+}
+
+/* the selected fields of obj, a struct record describes */
+int
+emit_record(struct emit_t* emit, const struct record_t* record,
+            const void* obj)
+{
+    int num_picks;
+
+    num_picks = emit_picks(emit, record);
+    if (num_picks < 0)
+    {
+        emit->error = 1;
+        return 1;
+    }
+    if (num_picks == 0)
+    {
+        return 0;
+    }
+    switch (emit->format)
+    {
+        case EMIT_BINARY:
+            return emit_binary_record(emit, record, obj, num_picks);
+        case EMIT_JSONL:
+            return emit_jsonl_record(emit, record, obj, num_picks);
+        case EMIT_CSV:
+            return emit_csv_record(emit, record, obj, num_picks);
+        default:
+            return emit_text_record(emit, record, obj, num_picks);
+    }
+}
+
+/* 16 bytes a line with offset and text, as fhexdump */
+static int
+emit_text_hexdump(struct emit_t* emit, const unsigned char* data, int bytes)
+{
+    int index;
+    int offset;
+    int line_bytes;
+    char* text;
+
+    for (offset = 0; offset < bytes; offset += 16)
+    {
+        line_bytes = bytes - offset < 16 ? bytes - offset : 16;
+        if (emit_reserve(emit, 16 + 16 * 4) != 0)
+        {
+            return 1;
+        }
+        emit_hex(emit, offset, 4);
+        text = emit->buf + emit->bytes;
+        *(text++) = ' ';
+        for (index = 0; index < 16; index++)
+        {
+            if (index < line_bytes)
+            {
+                *(text++) = g_hex_digits[data[offset + index] >> 4];
+                *(text++) = g_hex_digits[data[offset + index] & 0xF];
+            }
+            else
+            {
+                *(text++) = ' ';
+                *(text++) = ' ';
+            }
+            *(text++) = ' ';
+        }
+        for (index = 0; index < line_bytes; index++)
+        {
+            *(text++) = (data[offset + index] >= 0x20) &&
+                        (data[offset + index] < 0x7F) ?
+                        data[offset + index] : '.';
+        }
+        *(text++) = '\n';
+        emit->bytes = text - emit->buf;
+    }
+    return 0;
+}
+
+static int
+emit_hex_bytes(struct emit_t* emit, const unsigned char* data, int bytes)
+{
+    int index;
+    char* text;
+
+    if (emit_reserve(emit, bytes * 2) != 0)
+    {
+        return 1;
+    }
+    text = emit->buf + emit->bytes;
+    for (index = 0; index < bytes; index++)
+    {
+        *(text++) = g_hex_digits[data[index] >> 4];
+        *(text++) = g_hex_digits[data[index] & 0xF];
+    }
+    emit->bytes += bytes * 2;
+    return 0;
+}
+
+/* raw bytes when hexdump is set, a hexdump in text, a data record in the
+   other formats */
+int
+emit_hexdump(struct emit_t* emit, const char* data, int bytes)
+{
+    unsigned char val[5];
+
+    if (!emit->hexdump || (bytes < 0))
+    {
+        return 0;
+    }
+    switch (emit->format)
+    {
+        case EMIT_BINARY:
+            val[0] = EMIT_BINARY_DATA;
+            memcpy(val + 1, &bytes, 4);
+            emit_data(emit, (const char*)val, 5);
+            return emit_data(emit, data, bytes);
+        case EMIT_JSONL:
+            emit_str(emit, "{\"record\":\"data\",\"bytes\":");
+            emit_int(emit, bytes);
+            emit_str(emit, ",\"hex\":\"");
+            emit_hex_bytes(emit, (const unsigned char*)data, bytes);
+            return emit_data(emit, "\"}\n", 3);
+        case EMIT_CSV:
+            emit_str(emit, "data,");
+            emit_int(emit, bytes);
+            emit_data(emit, ",", 1);
+            emit_hex_bytes(emit, (const unsigned char*)data, bytes);
+            return emit_data(emit, "\n", 1);
+        default:
+            return emit_text_hexdump(emit, (const unsigned char*)data,
+                                     bytes);
+    }
+}
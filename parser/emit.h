@@ -0,0 +1,114 @@
+
+#ifndef _EMIT_H_
+#define _EMIT_H_
+
+#include <stddef.h>
+
+/* output formats */
+#define EMIT_TEXT           0   /* name value lines, one record after
+                                   another */
+#define EMIT_BINARY         1   /* see below */
+#define EMIT_JSONL          2   /* one object per record with a "record"
+                                   member naming it */
+#define EMIT_CSV            3   /* a #record,field,... header line per
+                                   record then record,value,... rows,
+                                   array values are ; separated */
+
+/* EMIT_BINARY, host byte order
+   schema  0xFF, u8 record id, u16 field count, record name, then for each
+           field u8 kind, field name, names are nul terminated
+   record  u8 record id, then for each field of its schema an int32, an
+           int64 for FIELD_INT64 or a u8 count and that many int32 for
+           FIELD_ARRAY
+   data    0xFE, u32 bytes, the bytes */
+#define EMIT_BINARY_SCHEMA  0xFF
+#define EMIT_BINARY_DATA    0xFE
+
+#define EMIT_MAX_RECORDS    16
+#define EMIT_BUFFER_BYTES   (1024 * 1024)
+
+/* field kinds */
+#define FIELD_INT           0
+#define FIELD_UINT          1
+#define FIELD_HEX           2   /* 0x%3.3x in text, a number elsewhere */
+#define FIELD_INT64         3
+#define FIELD_ARRAY         4   /* ints, name[index] in text */
+
+/* one value of a record, offset is into the struct handed to
+   emit_record, show returns 0 to leave the field out of this record */
+struct field_t
+{
+    const char* name;
+    int kind;
+    int offset;
+    int (*show)(const void* obj);
+    int count_offset;   /* FIELD_ARRAY, of the int holding the count */
+    int count_add;      /* FIELD_ARRAY, added to that count */
+    int max_count;      /* FIELD_ARRAY */
+    int stride;         /* FIELD_ARRAY, bytes from one value to the next */
+};
+
+#define EMIT_FIELD(_name, _kind, _type, _member, _show) \
+    { _name, _kind, (int)offsetof(_type, _member), _show, 0, 0, 0, 0 }
+#define EMIT_ARRAY(_name, _type, _member, _stride, _count, _add, _max, \
+                   _show) \
+    { _name, FIELD_ARRAY, (int)offsetof(_type, _member), _show, \
+      (int)offsetof(_type, _count), _add, _max, _stride }
+
+/* a kind of record, id is unique below EMIT_MAX_RECORDS */
+struct record_t
+{
+    const char* name;
+    int id;
+    const struct field_t* fields;
+    int num_fields;
+    int text_indent;    /* spaces before the name */
+    int text_width;     /* name padded to this */
+};
+
+/* formats into buf and writes it to fd when full, with fd -1 buf grows
+   instead and the caller takes bytes from it
+   select is a comma list of field or record.field names, only those are
+   formatted, NULL for all, a record left with no field is not emitted */
+struct emit_t
+{
+    int fd;
+    int format;
+    int hexdump;        /* nonzero for emit_hexdump output */
+    int error;
+    char* buf;
+    int bytes;
+    int alloc;
+    const char* select;
+    short* picks[EMIT_MAX_RECORDS];     /* field indexes to format */
+    int num_picks[EMIT_MAX_RECORDS];    /* -1 until looked up */
+};
+
+int
+emit_format(const char* name);
+int
+emit_init(struct emit_t* emit, int fd, int format, const char* select);
+int
+emit_deinit(struct emit_t* emit);
+int
+emit_flush(struct emit_t* emit);
+int
+emit_data(struct emit_t* emit, const char* data, int bytes);
+int
+emit_str(struct emit_t* emit, const char* text);
+int
+emit_int(struct emit_t* emit, long long val);
+int
+emit_hex(struct emit_t* emit, unsigned int val, int digits);
+int
+emit_header(struct emit_t* emit, const struct record_t* const* records,
+            int num_records);
+int
+emit_wants(struct emit_t* emit, const struct record_t* record);
+int
+emit_record(struct emit_t* emit, const struct record_t* record,
+            const void* obj);
+int
+emit_hexdump(struct emit_t* emit, const char* data, int bytes);
+
+#endif
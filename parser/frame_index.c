@@ -0,0 +1,316 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stream.h"
+#include "frame_index.h"
+#include "beef.h"
+
+#define FRAME_INDEX_VERSION 2
+
+struct frame_index_header_t
+{
+    char text[4];           /* "BIDX" */
+    int version;
+    int entry_bytes;
+    int count;
+    long long file_bytes;
+    long long mtime_sec;
+    long long mtime_nsec;
+};
+
+static int
+frame_index_stat(struct frame_index_t* index, int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+    {
+        return 1;
+    }
+    index->file_bytes = st.st_size;
+    index->mtime_sec = st.st_mtim.tv_sec;
+    index->mtime_nsec = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/* a zeroed entry at the end */
+struct frame_entry_t*
+frame_index_add(struct frame_index_t* index)
+{
+    int alloc;
+    struct frame_entry_t* frames;
+
+    if (index->count >= index->alloc)
+    {
+        alloc = index->alloc < 1024 ? 1024 : index->alloc * 2;
+        frames = (struct frame_entry_t*)
+                 realloc(index->frames, alloc * sizeof(struct frame_entry_t));
+        if (frames == NULL)
+        {
+            return NULL;
+        }
+        index->frames = frames;
+        index->alloc = alloc;
+    }
+    frames = index->frames + index->count;
+    memset(frames, 0, sizeof(struct frame_entry_t));
+    index->count++;
+    return frames;
+}
+
+/* one pass over a BEEF file from its start, the nal types of each frame
+   set the flags, the file position is left at the end
+   returns the number of frames or -1 on error */
+int
+frame_index_build(struct frame_index_t* index, int fd)
+{
+    int rv;
+    int idr_frame;
+    struct nal_stream_t stream;
+    struct nal_unit_t nal;
+    struct frame_entry_t* entry;
+
+    index->count = 0;
+    if (frame_index_stat(index, fd) != 0)
+    {
+        return -1;
+    }
+    if (lseek(fd, 0, SEEK_SET) != 0)
+    {
+        return -1;
+    }
+    if (nal_stream_init(&stream, fd) != 0)
+    {
+        nal_stream_deinit(&stream);
+        return -1;
+    }
+    if (stream.format != NAL_STREAM_BEEF)
+    {
+        nal_stream_deinit(&stream);
+        return -1;
+    }
+    entry = NULL;
+    idr_frame = -1;
+    while ((rv = nal_stream_next(&stream, &nal)) != NAL_STREAM_END)
+    {
+        if (rv == NAL_STREAM_ERROR)
+        {
+            nal_stream_deinit(&stream);
+            return -1;
+        }
+        if (rv == NAL_STREAM_FRAME)
+        {
+            entry = frame_index_add(index);
+            if (entry == NULL)
+            {
+                nal_stream_deinit(&stream);
+                return -1;
+            }
+            entry->offset = stream.frame_offset;
+            entry->bytes = stream.frame_bytes;
+            entry->timestamp_us = stream.timestamp_us;
+            entry->width = stream.width;
+            entry->height = stream.height;
+            if ((index->count > 1) &&
+                ((entry[-1].width != entry->width) ||
+                 (entry[-1].height != entry->height)))
+            {
+                entry->flags |= FRAME_FLAG_RES_CHANGE;
+            }
+            entry->idr_frame = idr_frame;
+        }
+        else if ((rv == NAL_STREAM_NAL) && (entry != NULL))
+        {
+            switch (nal.nal_unit_type)
+            {
+                case 5:
+                    entry->flags |= FRAME_FLAG_IDR;
+                    idr_frame = index->count - 1;
+                    entry->idr_frame = idr_frame;
+                    break;
+                case 7:
+                    entry->flags |= FRAME_FLAG_SPS;
+                    break;
+                case 8:
+                    entry->flags |= FRAME_FLAG_PPS;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    nal_stream_deinit(&stream);
+    return index->count;
+}
+
+/* read the sidecar at path, it has to match the size and mtime already
+   in index, returns 0 when it does */
+int
+frame_index_load(struct frame_index_t* index, const char* path)
+{
+    int fd;
+    long long bytes;
+    struct frame_index_header_t header;
+    struct frame_entry_t* frames;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return 1;
+    }
+    if ((read(fd, &header, sizeof(header)) != sizeof(header)) ||
+        (strncmp(header.text, "BIDX", 4) != 0) ||
+        (header.version != FRAME_INDEX_VERSION) ||
+        (header.entry_bytes != sizeof(struct frame_entry_t)) ||
+        (header.count < 0) ||
+        (header.file_bytes != index->file_bytes) ||
+        (header.mtime_sec != index->mtime_sec) ||
+        (header.mtime_nsec != index->mtime_nsec))
+    {
+        close(fd);
+        return 1;
+    }
+    bytes = (long long)header.count * sizeof(struct frame_entry_t);
+    frames = (struct frame_entry_t*)malloc(bytes > 0 ? bytes : 1);
+    if (frames == NULL)
+    {
+        close(fd);
+        return 1;
+    }
+    if (read(fd, frames, bytes) != bytes)
+    {
+        free(frames);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    free(index->frames);
+    index->frames = frames;
+    index->count = header.count;
+    index->alloc = header.count;
+    return 0;
+}
+
+/* written to path.tmp and renamed so a reader never sees half an index */
+int
+frame_index_save(const struct frame_index_t* index, const char* path)
+{
+    int fd;
+    long long bytes;
+    int error;
+    char* tmp_path;
+    struct frame_index_header_t header;
+
+    tmp_path = (char*)malloc(strlen(path) + 8);
+    if (tmp_path == NULL)
+    {
+        return 1;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR |
+              S_IRGRP | S_IROTH);
+    if (fd == -1)
+    {
+        free(tmp_path);
+        return 1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.text, "BIDX", 4);
+    header.version = FRAME_INDEX_VERSION;
+    header.entry_bytes = sizeof(struct frame_entry_t);
+    header.count = index->count;
+    header.file_bytes = index->file_bytes;
+    header.mtime_sec = index->mtime_sec;
+    header.mtime_nsec = index->mtime_nsec;
+    bytes = (long long)index->count * sizeof(struct frame_entry_t);
+    error = write(fd, &header, sizeof(header)) != sizeof(header);
+    if (!error && (bytes > 0))
+    {
+        error = write(fd, index->frames, bytes) != bytes;
+    }
+    error |= close(fd) != 0;
+    if (!error)
+    {
+        error = rename(tmp_path, path) != 0;
+    }
+    if (error)
+    {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return error;
+}
+
+/* index for the BEEF file at path from its v2 footer or from path.idx,
+   a missing or stale sidecar is rebuilt and saved, failing to save is
+   not an error */
+int
+frame_index_open(struct frame_index_t* index, const char* path)
+{
+    int fd;
+    char* idx_path;
+
+    memset(index, 0, sizeof(struct frame_index_t));
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return 1;
+    }
+    idx_path = (char*)malloc(strlen(path) + 8);
+    if ((idx_path == NULL) || (frame_index_stat(index, fd) != 0))
+    {
+        free(idx_path);
+        close(fd);
+        return 1;
+    }
+    sprintf(idx_path, "%s.idx", path);
+    if (beef_read_index(fd, index) == 0)
+    {
+        /* BEEF v2 carries its own */
+        free(idx_path);
+        close(fd);
+        return 0;
+    }
+    if (frame_index_load(index, idx_path) != 0)
+    {
+        if (frame_index_build(index, fd) < 0)
+        {
+            free(idx_path);
+            close(fd);
+            return 1;
+        }
+        frame_index_save(index, idx_path);
+    }
+    free(idx_path);
+    close(fd);
+    return 0;
+}
+
+int
+frame_index_deinit(struct frame_index_t* index)
+{
+    free(index->frames);
+    memset(index, 0, sizeof(struct frame_index_t));
+    return 0;
+}
+
+/* put fd at the BEEF header of frame */
+int
+frame_index_seek(const struct frame_index_t* index, int fd, int frame)
+{
+    if ((frame < 0) || (frame >= index->count))
+    {
+        return 1;
+    }
+    if (lseek(fd, index->frames[frame].offset, SEEK_SET) !=
+        index->frames[frame].offset)
+    {
+        return 1;
+    }
+    return 0;
+}
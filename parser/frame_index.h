@@ -0,0 +1,63 @@
+
+#ifndef _FRAME_INDEX_H_
+#define _FRAME_INDEX_H_
+
+#define FRAME_FLAG_IDR          1
+#define FRAME_FLAG_SPS          2
+#define FRAME_FLAG_PPS          4
+#define FRAME_FLAG_RES_CHANGE   8   /* width or height differ from the
+                                       frame before */
+
+/* one BEEF frame, stored as is in the sidecar and the BEEF v2 footer */
+struct frame_entry_t
+{
+    long long offset;       /* of the BEEF header in the file */
+    long long bytes;        /* bytes_follow */
+    long long timestamp_us; /* 0 before BEEF v2 */
+    int width;
+    int height;
+    int flags;
+    int idr_frame;          /* last frame at or before with an idr, -1 if
+                               none */
+};
+
+/* every frame of a BEEF file, saved next to it as <file>.idx with the
+   file size and mtime it was built from so a stale index is noticed */
+struct frame_index_t
+{
+    struct frame_entry_t* frames;
+    int count;
+    int alloc;
+    long long file_bytes;
+    long long mtime_sec;
+    long long mtime_nsec;
+};
+
+struct frame_entry_t*
+frame_index_add(struct frame_index_t* index);
+int
+frame_index_build(struct frame_index_t* index, int fd);
+int
+frame_index_load(struct frame_index_t* index, const char* path);
+int
+frame_index_save(const struct frame_index_t* index, const char* path);
+int
+frame_index_open(struct frame_index_t* index, const char* path);
+int
+frame_index_deinit(struct frame_index_t* index);
+int
+frame_index_seek(const struct frame_index_t* index, int fd, int frame);
+
+/* frame to start decoding at to show frame, -1 if there is no idr
+   before it */
+static inline int
+frame_index_idr(const struct frame_index_t* index, int frame)
+{
+    if ((frame < 0) || (frame >= index->count))
+    {
+        return -1;
+    }
+    return index->frames[frame].idr_frame;
+}
+
+#endif
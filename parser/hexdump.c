@@ -0,0 +1,52 @@
+
+#include <stdio.h>
+
+#include "hexdump.h"
+
+void
+fhexdump(FILE* out, const void *p, int len)
+{
+    unsigned char *line;
+    int i;
+    int thisline;
+    int offset;
+
+    line = (unsigned char *)p;
+    offset = 0;
+
+    while (offset < len)
+    {
+        fprintf(out, "%04x ", offset);
+        thisline = len - offset;
+
+        if (thisline > 16)
+        {
+            thisline = 16;
+        }
+
+        for (i = 0; i < thisline; i++)
+        {
+            fprintf(out, "%02x ", line[i]);
+        }
+
+        for (; i < 16; i++)
+        {
+            fprintf(out, "   ");
+        }
+
+        for (i = 0; i < thisline; i++)
+        {
+            fprintf(out, "%c", (line[i] >= 0x20 && line[i] < 0x7f) ? line[i] : '.');
+        }
+
+        fprintf(out, "\n");
+        offset += thisline;
+        line += thisline;
+    }
+}
+
+void
+hexdump(const void *p, int len)
+{
+    fhexdump(stdout, p, len);
+}
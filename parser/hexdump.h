@@ -0,0 +1,14 @@
+
+#ifndef _HEXDUMP_H_
+#define _HEXDUMP_H_
+
+#include <stdio.h>
+
+/* debug dumps for the tools, kept out of libcodecparse so the library
+   never writes to stdout */
+void
+fhexdump(FILE* out, const void *p, int len);
+void
+hexdump(const void *p, int len);
+
+#endif
@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "sps.h"
+#include "pps.h"
+#include "params.h"
+#include "arena.h"
+#include "utils.h"
+
+int
+params_init(struct params_t* params)
+{
+    memset(params, 0, sizeof(struct params_t));
+    return 0;
+}
+
+/* arena must outlive params */
+int
+params_init_arena(struct params_t* params, struct arena_t* arena)
+{
+    params_init(params);
+    params->arena = arena;
+    return 0;
+}
+
+static void*
+params_alloc(struct params_t* params, long long bytes)
+{
+    if (params->arena != NULL)
+    {
+        return arena_alloc(params->arena, bytes);
+    }
+    return malloc(bytes);
+}
+
+static void
+params_free(struct params_t* params, void* data)
+{
+    if (params->arena == NULL)
+    {
+        free(data);
+    }
+}
+
+/* returns PARAMS_ERROR */
+static int
+params_fail(struct params_t* params, int error, long long pos)
+{
+    params->error = error;
+    params->error_pos = pos;
+    return PARAMS_ERROR;
+}
+
+static int
+params_slot_same(const struct params_slot_t* slot, unsigned long long hash,
+                 const char* data, int bytes)
+{
+    return (slot->nal != NULL) && (slot->hash == hash) &&
+           (slot->nal_bytes == bytes) &&
+           (memcmp(slot->nal, data, bytes) == 0);
+}
+
+static int
+params_slot_set(struct params_t* params, struct params_slot_t* slot,
+                unsigned long long hash, const char* data, int bytes)
+{
+    int alloc;
+    char* nal;
+
+    if ((slot->nal == NULL) || (bytes > slot->nal_alloc))
+    {
+        /* room to grow a little, an arena cannot give the old one back */
+        alloc = (bytes + 63) & ~63;
+        if (alloc == 0)
+        {
+            alloc = 64;
+        }
+        nal = (char*)params_alloc(params, alloc);
+        if (nal == NULL)
+        {
+            return 1;
+        }
+        params_free(params, slot->nal);
+        slot->nal = nal;
+        slot->nal_alloc = alloc;
+    }
+    memcpy(slot->nal, data, bytes);
+    slot->nal_bytes = bytes;
+    slot->hash = hash;
+    return 0;
+}
+
+static void
+params_slot_free(struct params_t* params, struct params_slot_t* slot)
+{
+    params_free(params, slot->nal);
+    memset(slot, 0, sizeof(struct params_slot_t));
+}
+
+/* a pps with 8x8 scaling lists counts them by the chroma_format_idc of
+   its sps, parse the ones on sps id again from their nal */
+static void
+params_reparse_pps(struct params_t* params, int id)
+{
+    int index;
+    struct bits_t bits;
+    struct pps_t pps;
+    struct pps_t* old;
+    struct params_slot_t* slot;
+
+    for (index = 0; index < params->num_pps; index++)
+    {
+        old = params->pps[params->pps_ids[index]];
+        if ((old->seq_parameter_set_id != id) ||
+            !old->transform_8x8_mode_flag ||
+            !old->pic_scaling_matrix_present_flag)
+        {
+            continue;
+        }
+        slot = params->pps_slot + params->pps_ids[index];
+        bits_init_nal(&bits, slot->nal, slot->nal_bytes);
+        memset(&pps, 0, sizeof(pps));
+        if ((parse_pps(&bits, params->sps, &pps) == 0) && !bits.error)
+        {
+            *old = pps;
+        }
+    }
+}
+
+/* keep sps for its id with the nal it came from, *id is set */
+static int
+params_store_sps(struct params_t* params, const struct sps_t* sps,
+                 unsigned long long hash, const char* data, int bytes)
+{
+    int id;
+    int event;
+    struct sps_t* old;
+
+    id = sps->seq_parameter_set_id;
+    if ((id < 0) || (id >= MAX_SPS))
+    {
+        return params_fail(params, PARAMS_ERROR_SYNTAX, 0);
+    }
+    old = params->sps[id];
+    if (old == NULL)
+    {
+        old = (struct sps_t*)params_alloc(params, sizeof(struct sps_t));
+        if (old == NULL)
+        {
+            return params_fail(params, PARAMS_ERROR_MEMORY, 0);
+        }
+        params->sps[id] = old;
+        params->sps_ids[params->num_sps++] = id;
+        event = PARAMS_NEW;
+    }
+    else if ((old->width != sps->width) || (old->height != sps->height))
+    {
+        event = PARAMS_RES_CHANGE;
+    }
+    else
+    {
+        event = PARAMS_CHANGED;
+    }
+    *old = *sps;
+    if (params_slot_set(params, params->sps_slot + id, hash, data,
+                        bytes) != 0)
+    {
+        return params_fail(params, PARAMS_ERROR_MEMORY, 0);
+    }
+    params_reparse_pps(params, id);
+    return event;
+}
+
+static int
+params_store_pps(struct params_t* params, const struct pps_t* pps,
+                 unsigned long long hash, const char* data, int bytes)
+{
+    int id;
+    int event;
+
+    id = pps->pic_parameter_set_id;
+    if ((id < 0) || (id >= MAX_PPS))
+    {
+        return params_fail(params, PARAMS_ERROR_SYNTAX, 0);
+    }
+    event = PARAMS_CHANGED;
+    if (params->pps[id] == NULL)
+    {
+        params->pps[id] = (struct pps_t*)params_alloc(params,
+                                                      sizeof(struct pps_t));
+        if (params->pps[id] == NULL)
+        {
+            return params_fail(params, PARAMS_ERROR_MEMORY, 0);
+        }
+        params->pps_ids[params->num_pps++] = id;
+        event = PARAMS_NEW;
+    }
+    *(params->pps[id]) = *pps;
+    if (params_slot_set(params, params->pps_slot + id, hash, data,
+                        bytes) != 0)
+    {
+        return params_fail(params, PARAMS_ERROR_MEMORY, 0);
+    }
+    return event;
+}
+
+/* a set that did not parse, truncated when the reader ran out */
+static int
+params_parse_fail(struct params_t* params, const struct bits_t* bits)
+{
+    if (bits->error)
+    {
+        return params_fail(params, PARAMS_ERROR_TRUNCATED, bits->error_pos);
+    }
+    return params_fail(params, PARAMS_ERROR_SYNTAX, bits_nal_tell(bits));
+}
+
+/* data is the escaped nal of an sps or pps, *id is set to its id unless
+   PARAMS_ERROR is returned, a set that does not parse is not kept
+   returns a PARAMS_ event, on PARAMS_ERROR error and error_pos say why
+   and where */
+int
+params_parse(struct params_t* params, char* data, int bytes,
+             int nal_unit_type, int* id)
+{
+    int index;
+    unsigned long long hash;
+    struct bits_t bits;
+    struct sps_t sps;
+    struct pps_t pps;
+
+    hash = nal_hash(data, bytes);
+    if (nal_unit_type == 7)
+    {
+        for (index = 0; index < params->num_sps; index++)
+        {
+            *id = params->sps_ids[index];
+            if (params_slot_same(params->sps_slot + *id, hash, data, bytes))
+            {
+                params->same_count++;
+                return PARAMS_SAME;
+            }
+        }
+        params->parse_count++;
+        bits_init_nal(&bits, data, bytes);
+        memset(&sps, 0, sizeof(sps));
+        if ((parse_sps(&bits, &sps) != 0) || bits.error)
+        {
+            return params_parse_fail(params, &bits);
+        }
+        *id = sps.seq_parameter_set_id;
+        return params_store_sps(params, &sps, hash, data, bytes);
+    }
+    if (nal_unit_type == 8)
+    {
+        for (index = 0; index < params->num_pps; index++)
+        {
+            *id = params->pps_ids[index];
+            if (params_slot_same(params->pps_slot + *id, hash, data, bytes))
+            {
+                params->same_count++;
+                return PARAMS_SAME;
+            }
+        }
+        params->parse_count++;
+        bits_init_nal(&bits, data, bytes);
+        memset(&pps, 0, sizeof(pps));
+        if ((parse_pps(&bits, params->sps, &pps) != 0) || bits.error)
+        {
+            return params_parse_fail(params, &bits);
+        }
+        *id = pps.pic_parameter_set_id;
+        return params_store_pps(params, &pps, hash, data, bytes);
+    }
+    return params_fail(params, PARAMS_ERROR_NAL_TYPE, 3);
+}
+
+/* dst ends up with the same sets as src, sets dst already has with the
+   same bytes are not copied, the counts in dst are kept */
+int
+params_copy(struct params_t* dst, const struct params_t* src)
+{
+    int index;
+    int id;
+    const struct params_slot_t* slot;
+
+    for (id = 0; id < MAX_SPS; id++)
+    {
+        if (src->sps[id] == NULL)
+        {
+            params_free(dst, dst->sps[id]);
+            dst->sps[id] = NULL;
+            params_slot_free(dst, dst->sps_slot + id);
+            continue;
+        }
+        slot = src->sps_slot + id;
+        if ((dst->sps[id] != NULL) &&
+            params_slot_same(dst->sps_slot + id, slot->hash, slot->nal,
+                             slot->nal_bytes))
+        {
+            continue;
+        }
+        if (dst->sps[id] == NULL)
+        {
+            dst->sps[id] = (struct sps_t*)params_alloc(dst,
+                                                       sizeof(struct sps_t));
+            if (dst->sps[id] == NULL)
+            {
+                return 1;
+            }
+        }
+        *(dst->sps[id]) = *(src->sps[id]);
+        if (params_slot_set(dst, dst->sps_slot + id, slot->hash, slot->nal,
+                            slot->nal_bytes) != 0)
+        {
+            return 1;
+        }
+    }
+    for (id = 0; id < MAX_PPS; id++)
+    {
+        if (src->pps[id] == NULL)
+        {
+            params_free(dst, dst->pps[id]);
+            dst->pps[id] = NULL;
+            params_slot_free(dst, dst->pps_slot + id);
+            continue;
+        }
+        slot = src->pps_slot + id;
+        if ((dst->pps[id] != NULL) &&
+            params_slot_same(dst->pps_slot + id, slot->hash, slot->nal,
+                             slot->nal_bytes))
+        {
+            /* same bytes can parse differently under a changed sps */
+            *(dst->pps[id]) = *(src->pps[id]);
+            continue;
+        }
+        if (dst->pps[id] == NULL)
+        {
+            dst->pps[id] = (struct pps_t*)params_alloc(dst,
+                                                       sizeof(struct pps_t));
+            if (dst->pps[id] == NULL)
+            {
+                return 1;
+            }
+        }
+        *(dst->pps[id]) = *(src->pps[id]);
+        if (params_slot_set(dst, dst->pps_slot + id, slot->hash, slot->nal,
+                            slot->nal_bytes) != 0)
+        {
+            return 1;
+        }
+    }
+    for (index = 0; index < src->num_sps; index++)
+    {
+        dst->sps_ids[index] = src->sps_ids[index];
+    }
+    dst->num_sps = src->num_sps;
+    for (index = 0; index < src->num_pps; index++)
+    {
+        dst->pps_ids[index] = src->pps_ids[index];
+    }
+    dst->num_pps = src->num_pps;
+    return 0;
+}
+
+int
+params_deinit(struct params_t* params)
+{
+    int index;
+
+    for (index = 0; index < MAX_SPS; index++)
+    {
+        params_free(params, params->sps[index]);
+        params_free(params, params->sps_slot[index].nal);
+    }
+    for (index = 0; index < MAX_PPS; index++)
+    {
+        params_free(params, params->pps[index]);
+        params_free(params, params->pps_slot[index].nal);
+    }
+    memset(params, 0, sizeof(struct params_t));
+    return 0;
+}
@@ -0,0 +1,68 @@
+
+#ifndef _PARAMS_H_
+#define _PARAMS_H_
+
+#define MAX_SPS         32
+#define MAX_PPS         256
+
+/* params_parse events */
+#define PARAMS_ERROR        -1  /* did not parse, nothing kept */
+#define PARAMS_SAME         0   /* same bytes as the set kept for its id */
+#define PARAMS_NEW          1   /* first set for its id */
+#define PARAMS_CHANGED      2   /* replaced a different set */
+#define PARAMS_RES_CHANGE   3   /* replaced an sps of another width or
+                                   height */
+
+/* params_t.error, why the last PARAMS_ERROR */
+#define PARAMS_ERROR_TRUNCATED  1   /* read past the end of the nal */
+#define PARAMS_ERROR_SYNTAX     2   /* a value out of range */
+#define PARAMS_ERROR_MEMORY     3
+#define PARAMS_ERROR_NAL_TYPE   4   /* not an sps or pps */
+
+struct arena_t;
+
+/* the escaped nal a set was parsed from and its hash */
+struct params_slot_t
+{
+    unsigned long long hash;
+    char* nal;
+    int nal_bytes;
+    int nal_alloc;
+};
+
+/* the last sps and pps parsed for each id, NULL where none was seen,
+   slice headers are parsed against these
+   a set is only parsed when its bytes differ from the one kept for its
+   id so resends in front of every idr cost a hash and a compare
+   sets and their nals come from arena when it is set, else from malloc,
+   a slot is only allocated again when a longer nal replaces it */
+struct params_t
+{
+    struct sps_t* sps[MAX_SPS];
+    struct pps_t* pps[MAX_PPS];
+    struct params_slot_t sps_slot[MAX_SPS];
+    struct params_slot_t pps_slot[MAX_PPS];
+    unsigned char sps_ids[MAX_SPS];     /* ids in use, num_sps of them */
+    unsigned char pps_ids[MAX_PPS];
+    int num_sps;
+    int num_pps;
+    long long parse_count;
+    long long same_count;
+    struct arena_t* arena;
+    int error;
+    long long error_pos;        /* bit in the escaped nal it was found at */
+};
+
+int
+params_init(struct params_t* params);
+int
+params_init_arena(struct params_t* params, struct arena_t* arena);
+int
+params_parse(struct params_t* params, char* data, int bytes,
+             int nal_unit_type, int* id);
+int
+params_copy(struct params_t* dst, const struct params_t* src);
+int
+params_deinit(struct params_t* params);
+
+#endif
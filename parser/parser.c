@@ -26,265 +26,1086 @@ slice_type  name of slice
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <getopt.h>
 
 #include "bits.h"
 #include "sps.h"
 #include "pps.h"
+#include "slice.h"
+#include "params.h"
 #include "utils.h"
+#include "stream.h"
+#include "frame_index.h"
+#include "beef.h"
+#include "emit.h"
+#include "stats.h"
+
+struct frame_record_t
+{
+    int version;
+    int width;
+    int height;
+    long long bytes_follow;
+    long long timestamp_us;
+    int flags;
+};
+
+struct nal_record_t
+{
+    int start_code_bytes;
+    int nal_bytes;
+    int nal_unit_type;
+    int params_event;       /* PARAMS_, sps and pps */
+    int params_id;
+    int slice_error;        /* parse_slice_header result, slices */
+};
+
+struct sps_record_t
+{
+    int bits_error;
+    int bytes_left;
+    struct sps_t sps;
+};
 
 static int
-get_next_frame(int fd, char* data, int* bytes, int* width, int* height)
+show_params(const void* obj)
 {
-    struct _header
+    const struct nal_record_t* nal = (const struct nal_record_t*)obj;
+    return (nal->nal_unit_type == 7) || (nal->nal_unit_type == 8);
+}
+
+static int
+show_slice(const void* obj)
+{
+    const struct nal_record_t* nal = (const struct nal_record_t*)obj;
+    return (nal->nal_unit_type == 1) || (nal->nal_unit_type == 5);
+}
+
+static int
+show_slice_groups(const void* obj)
+{
+    return ((const struct pps_t*)obj)->num_slice_groups_minus1 > 0;
+}
+
+static int
+show_map_type_0(const void* obj)
+{
+    const struct pps_t* pps = (const struct pps_t*)obj;
+    return (pps->num_slice_groups_minus1 > 0) &&
+           (pps->slice_group_map_type == 0);
+}
+
+static int
+show_map_type_2(const void* obj)
+{
+    const struct pps_t* pps = (const struct pps_t*)obj;
+    return (pps->num_slice_groups_minus1 > 0) &&
+           (pps->slice_group_map_type == 2);
+}
+
+static int
+show_map_type_3_to_5(const void* obj)
+{
+    const struct pps_t* pps = (const struct pps_t*)obj;
+    return (pps->num_slice_groups_minus1 > 0) &&
+           (pps->slice_group_map_type >= 3) &&
+           (pps->slice_group_map_type <= 5);
+}
+
+static int
+show_map_type_6(const void* obj)
+{
+    const struct pps_t* pps = (const struct pps_t*)obj;
+    return (pps->num_slice_groups_minus1 > 0) &&
+           (pps->slice_group_map_type == 6);
+}
+
+static int
+show_pic_scaling_matrix(const void* obj)
+{
+    return ((const struct pps_t*)obj)->pic_scaling_matrix_present_flag;
+}
+
+#define FRAME_FIELD(_name, _kind) \
+    EMIT_FIELD(#_name, _kind, struct frame_record_t, _name, NULL)
+#define NAL_FIELD(_name, _show) \
+    EMIT_FIELD(#_name, FIELD_INT, struct nal_record_t, _name, _show)
+#define SPS_FIELD(_name, _kind, _member) \
+    EMIT_FIELD(_name, _kind, struct sps_record_t, _member, NULL)
+#define PPS_FIELD(_name, _kind, _show) \
+    EMIT_FIELD(#_name, _kind, struct pps_t, _name, _show)
+#define SLICE_FIELD(_name, _member) \
+    EMIT_FIELD(_name, FIELD_INT, struct slice_t, _member, NULL)
+
+static const struct field_t g_frame_fields[] =
+{
+    FRAME_FIELD(version, FIELD_INT),
+    FRAME_FIELD(width, FIELD_INT),
+    FRAME_FIELD(height, FIELD_INT),
+    FRAME_FIELD(bytes_follow, FIELD_INT64),
+    FRAME_FIELD(timestamp_us, FIELD_INT64),
+    FRAME_FIELD(flags, FIELD_INT)
+};
+
+static const struct field_t g_nal_fields[] =
+{
+    NAL_FIELD(start_code_bytes, NULL),
+    NAL_FIELD(nal_bytes, NULL),
+    NAL_FIELD(nal_unit_type, NULL),
+    NAL_FIELD(params_event, show_params),
+    NAL_FIELD(params_id, show_params),
+    NAL_FIELD(slice_error, show_slice)
+};
+
+static const struct field_t g_sps_fields[] =
+{
+    SPS_FIELD("bits.error", FIELD_INT, bits_error),
+    SPS_FIELD("bytes left", FIELD_INT, bytes_left),
+    SPS_FIELD("forbidden_zero_bit", FIELD_INT, sps.forbidden_zero_bit),
+    SPS_FIELD("nal_ref_idc", FIELD_INT, sps.nal_ref_idc),
+    SPS_FIELD("nal_unit_type", FIELD_INT, sps.nal_unit_type),
+    SPS_FIELD("profile_idc", FIELD_INT, sps.profile_idc),
+    SPS_FIELD("constraint_set0_flag", FIELD_INT, sps.constraint_set0_flag),
+    SPS_FIELD("constraint_set1_flag", FIELD_INT, sps.constraint_set1_flag),
+    SPS_FIELD("constraint_set2_flag", FIELD_INT, sps.constraint_set2_flag),
+    SPS_FIELD("constraint_set3_flag", FIELD_INT, sps.constraint_set3_flag),
+    SPS_FIELD("reserved_zero_4bits", FIELD_INT, sps.reserved_zero_4bits),
+    SPS_FIELD("level_idc", FIELD_INT, sps.level_idc),
+    SPS_FIELD("seq_parameter_set_id", FIELD_INT, sps.seq_parameter_set_id),
+    SPS_FIELD("chroma_format_idc", FIELD_INT, sps.chroma_format_idc),
+    SPS_FIELD("separate_colour_plane_flag", FIELD_INT, sps.separate_colour_plane_flag),
+    SPS_FIELD("bit_depth_luma_minus8", FIELD_INT, sps.bit_depth_luma_minus8),
+    SPS_FIELD("bit_depth_chroma_minus8", FIELD_INT, sps.bit_depth_chroma_minus8),
+    SPS_FIELD("qpprime_y_zero_transform_bypass_flag", FIELD_INT, sps.qpprime_y_zero_transform_bypass_flag),
+    SPS_FIELD("seq_scaling_matrix_present_flag", FIELD_INT, sps.seq_scaling_matrix_present_flag),
+    SPS_FIELD("seq_scaling_list_present_flag", FIELD_HEX, sps.seq_scaling_list_present_flag),
+    SPS_FIELD("log2_max_frame_num_minus4", FIELD_INT, sps.log2_max_frame_num_minus4),
+    SPS_FIELD("pic_order_cnt_type", FIELD_INT, sps.pic_order_cnt_type),
+    SPS_FIELD("log2_max_pic_order_cnt_lsb_minus4", FIELD_INT, sps.log2_max_pic_order_cnt_lsb_minus4),
+    SPS_FIELD("delta_pic_order_always_zero_flag", FIELD_INT, sps.delta_pic_order_always_zero_flag),
+    SPS_FIELD("offset_for_non_ref_pic", FIELD_INT, sps.offset_for_non_ref_pic),
+    SPS_FIELD("offset_for_top_to_bottom_field", FIELD_INT, sps.offset_for_top_to_bottom_field),
+    SPS_FIELD("num_ref_frames_in_pic_order_cnt_cycle", FIELD_INT, sps.num_ref_frames_in_pic_order_cnt_cycle),
+    SPS_FIELD("num_ref_frames", FIELD_INT, sps.num_ref_frames),
+    SPS_FIELD("gaps_in_frame_num_value_allowed_flag", FIELD_INT, sps.gaps_in_frame_num_value_allowed_flag),
+    SPS_FIELD("pic_width_in_mbs_minus_1", FIELD_INT, sps.pic_width_in_mbs_minus_1),
+    SPS_FIELD("pic_height_in_map_units_minus_1", FIELD_INT, sps.pic_height_in_map_units_minus_1),
+    SPS_FIELD("frame_mbs_only_flag", FIELD_INT, sps.frame_mbs_only_flag),
+    SPS_FIELD("mb_adaptive_frame_field_flag", FIELD_INT, sps.mb_adaptive_frame_field_flag),
+    SPS_FIELD("direct_8x8_inference_flag", FIELD_INT, sps.direct_8x8_inference_flag),
+    SPS_FIELD("frame_cropping_flag", FIELD_INT, sps.frame_cropping_flag),
+    SPS_FIELD("frame_crop_left_offset", FIELD_INT, sps.frame_crop_left_offset),
+    SPS_FIELD("frame_crop_right_offset", FIELD_INT, sps.frame_crop_right_offset),
+    SPS_FIELD("frame_crop_top_offset", FIELD_INT, sps.frame_crop_top_offset),
+    SPS_FIELD("frame_crop_bottom_offset", FIELD_INT, sps.frame_crop_bottom_offset),
+    SPS_FIELD("vui_prameters_present_flag", FIELD_INT, sps.vui_prameters_present_flag),
+    SPS_FIELD("aspect_ratio_info_present_flag", FIELD_INT, sps.vui.aspect_ratio_info_present_flag),
+    SPS_FIELD("aspect_ratio_idc", FIELD_INT, sps.vui.aspect_ratio_idc),
+    SPS_FIELD("sar_width", FIELD_INT, sps.vui.sar_width),
+    SPS_FIELD("sar_height", FIELD_INT, sps.vui.sar_height),
+    SPS_FIELD("overscan_info_present_flag", FIELD_INT, sps.vui.overscan_info_present_flag),
+    SPS_FIELD("overscan_appropriate_flag", FIELD_INT, sps.vui.overscan_appropriate_flag),
+    SPS_FIELD("video_signal_type_present_flag", FIELD_INT, sps.vui.video_signal_type_present_flag),
+    SPS_FIELD("video_format", FIELD_INT, sps.vui.video_format),
+    SPS_FIELD("video_full_range_flag", FIELD_INT, sps.vui.video_full_range_flag),
+    SPS_FIELD("colour_description_present_flag", FIELD_INT, sps.vui.colour_description_present_flag),
+    SPS_FIELD("colour_primaries", FIELD_INT, sps.vui.colour_primaries),
+    SPS_FIELD("transfer_characteristics", FIELD_INT, sps.vui.transfer_characteristics),
+    SPS_FIELD("matrix_coefficients", FIELD_INT, sps.vui.matrix_coefficients),
+    SPS_FIELD("chroma_loc_info_present_flag", FIELD_INT, sps.vui.chroma_loc_info_present_flag),
+    SPS_FIELD("chroma_sample_loc_type_top_field", FIELD_INT, sps.vui.chroma_sample_loc_type_top_field),
+    SPS_FIELD("chroma_sample_loc_type_bottom_field", FIELD_INT, sps.vui.chroma_sample_loc_type_bottom_field),
+    SPS_FIELD("timing_info_present_flag", FIELD_INT, sps.vui.timing_info_present_flag),
+    SPS_FIELD("num_units_in_tick", FIELD_UINT, sps.vui.num_units_in_tick),
+    SPS_FIELD("time_scale", FIELD_UINT, sps.vui.time_scale),
+    SPS_FIELD("fixed_frame_rate_flag", FIELD_INT, sps.vui.fixed_frame_rate_flag),
+    SPS_FIELD("nal_hrd_parameters_present_flag", FIELD_INT, sps.vui.nal_hrd_parameters_present_flag),
+    SPS_FIELD("vcl_hrd_parameters_present_flag", FIELD_INT, sps.vui.vcl_hrd_parameters_present_flag),
+    SPS_FIELD("low_delay_hrd_flag", FIELD_INT, sps.vui.low_delay_hrd_flag),
+    SPS_FIELD("pic_struct_present_flag", FIELD_INT, sps.vui.pic_struct_present_flag),
+    SPS_FIELD("bitstream_restriction_flag", FIELD_INT, sps.vui.bitstream_restriction_flag),
+    SPS_FIELD("motion_vectors_over_pic_boundaries_flag", FIELD_INT, sps.vui.motion_vectors_over_pic_boundaries_flag),
+    SPS_FIELD("max_bytes_per_pic_denom", FIELD_INT, sps.vui.max_bytes_per_pic_denom),
+    SPS_FIELD("max_bits_per_mb_denom", FIELD_INT, sps.vui.max_bits_per_mb_denom),
+    SPS_FIELD("log2_max_mv_length_horizontal", FIELD_INT, sps.vui.log2_max_mv_length_horizontal),
+    SPS_FIELD("log2_max_mv_length_vertical", FIELD_INT, sps.vui.log2_max_mv_length_vertical),
+    SPS_FIELD("num_reorder_frames", FIELD_INT, sps.vui.num_reorder_frames),
+    SPS_FIELD("max_dec_frame_buffering", FIELD_INT, sps.vui.max_dec_frame_buffering),
+    SPS_FIELD("width", FIELD_INT, sps.width),
+    SPS_FIELD("height", FIELD_INT, sps.height)
+};
+
+static const struct field_t g_pps_fields[] =
+{
+    PPS_FIELD(pic_parameter_set_id, FIELD_INT, NULL),
+    PPS_FIELD(seq_parameter_set_id, FIELD_INT, NULL),
+    PPS_FIELD(entropy_coding_mode_flag, FIELD_INT, NULL),
+    PPS_FIELD(pic_order_present_flag, FIELD_INT, NULL),
+    PPS_FIELD(num_slice_groups_minus1, FIELD_INT, NULL),
+    PPS_FIELD(slice_group_map_type, FIELD_INT, show_slice_groups),
+    EMIT_ARRAY("run_length_minus1", struct pps_t, run_length_minus1,
+               sizeof(int), num_slice_groups_minus1, 1, MAX_SLICE_GROUPS,
+               show_map_type_0),
+    EMIT_ARRAY("top_left", struct pps_t, top_left, sizeof(int),
+               num_slice_groups_minus1, 0, MAX_SLICE_GROUPS,
+               show_map_type_2),
+    EMIT_ARRAY("bottom_right", struct pps_t, bottom_right, sizeof(int),
+               num_slice_groups_minus1, 0, MAX_SLICE_GROUPS,
+               show_map_type_2),
+    PPS_FIELD(slice_group_change_direction_flag, FIELD_INT, show_map_type_3_to_5),
+    PPS_FIELD(slice_group_change_rate_minus1, FIELD_INT, show_map_type_3_to_5),
+    PPS_FIELD(pic_size_in_map_units_minus1, FIELD_INT, show_map_type_6),
+    PPS_FIELD(num_ref_idx_l0_active_minus1, FIELD_INT, NULL),
+    PPS_FIELD(num_ref_idx_l1_active_minus1, FIELD_INT, NULL),
+    PPS_FIELD(weighted_pred_flag, FIELD_INT, NULL),
+    PPS_FIELD(weighted_bipred_idc, FIELD_INT, NULL),
+    PPS_FIELD(pic_init_qp_minus26, FIELD_INT, NULL),
+    PPS_FIELD(pic_init_qs_minus26, FIELD_INT, NULL),
+    PPS_FIELD(chroma_qp_index_offset, FIELD_INT, NULL),
+    PPS_FIELD(deblocking_filter_control_present_flag, FIELD_INT, NULL),
+    PPS_FIELD(constrained_intra_pred_flag, FIELD_INT, NULL),
+    PPS_FIELD(redundant_pic_cnt_present_flag, FIELD_INT, NULL),
+    PPS_FIELD(transform_8x8_mode_flag, FIELD_INT, NULL),
+    PPS_FIELD(pic_scaling_matrix_present_flag, FIELD_INT, NULL),
+    PPS_FIELD(pic_scaling_list_present_flag, FIELD_HEX, show_pic_scaling_matrix),
+    PPS_FIELD(use_default_scaling_matrix_flag, FIELD_HEX, show_pic_scaling_matrix),
+    PPS_FIELD(second_chroma_qp_index_offset, FIELD_INT, NULL)
+};
+
+static const struct field_t g_slice_fields[] =
+{
+    SLICE_FIELD("header_bits", header_bits),
+    SLICE_FIELD("first_mb_in_slice", first_mb_in_slice),
+    SLICE_FIELD("slice_type", slice_type),
+    SLICE_FIELD("pic_parameter_set_id", pic_parameter_set_id),
+    SLICE_FIELD("frame_num", frame_num),
+    SLICE_FIELD("field_pic_flag", field_pic_flag),
+    SLICE_FIELD("bottom_field_flag", bottom_field_flag),
+    SLICE_FIELD("idr_pic_id", idr_pic_id),
+    SLICE_FIELD("pic_order_cnt_lsb", pic_order_cnt_lsb),
+    SLICE_FIELD("delta_pic_order_cnt_bottom", delta_pic_order_cnt_bottom),
+    SLICE_FIELD("delta_pic_order_cnt[0]", delta_pic_order_cnt[0]),
+    SLICE_FIELD("delta_pic_order_cnt[1]", delta_pic_order_cnt[1]),
+    SLICE_FIELD("redundant_pic_cnt", redundant_pic_cnt),
+    SLICE_FIELD("direct_spatial_mv_pred_flag", direct_spatial_mv_pred_flag),
+    SLICE_FIELD("num_ref_idx_active_override_flag", num_ref_idx_active_override_flag),
+    SLICE_FIELD("num_ref_idx_l0_active_minus1", num_ref_idx_l0_active_minus1),
+    SLICE_FIELD("num_ref_idx_l1_active_minus1", num_ref_idx_l1_active_minus1),
+    SLICE_FIELD("no_output_of_prior_pics_flag", dec_ref_pic_marking.no_output_of_prior_pics_flag),
+    SLICE_FIELD("long_term_reference_flag", dec_ref_pic_marking.long_term_reference_flag),
+    SLICE_FIELD("adaptive_ref_pic_marking_mode_flag", dec_ref_pic_marking.adaptive_ref_pic_marking_mode_flag),
+    EMIT_ARRAY("memory_management_control_operation", struct slice_t,
+               dec_ref_pic_marking.mmco[0].memory_management_control_operation,
+               sizeof(struct mmco_t), dec_ref_pic_marking.num_mmco, 0,
+               MAX_MMCO, NULL),
+    SLICE_FIELD("cabac_init_idc", cabac_init_idc),
+    SLICE_FIELD("slice_qp_delta", slice_qp_delta),
+    SLICE_FIELD("disable_deblocking_filter_idc", disable_deblocking_filter_idc),
+    SLICE_FIELD("slice_alpha_c0_offset_div2", slice_alpha_c0_offset_div2),
+    SLICE_FIELD("slice_beta_offset_div2", slice_beta_offset_div2)
+};
+
+#define NUM_FIELDS(_fields) ((int)(sizeof(_fields) / sizeof(_fields[0])))
+
+static const struct record_t g_frame_record =
+    { "frame", 0, g_frame_fields, NUM_FIELDS(g_frame_fields), 2, 0 };
+static const struct record_t g_nal_record =
+    { "nal", 1, g_nal_fields, NUM_FIELDS(g_nal_fields), 2, 0 };
+static const struct record_t g_sps_record =
+    { "sps", 2, g_sps_fields, NUM_FIELDS(g_sps_fields), 4, 40 };
+static const struct record_t g_pps_record =
+    { "pps", 3, g_pps_fields, NUM_FIELDS(g_pps_fields), 8, 39 };
+static const struct record_t g_slice_record =
+    { "slice", 4, g_slice_fields, NUM_FIELDS(g_slice_fields), 4, 40 };
+
+static const struct record_t* g_records[] =
+{
+    &g_frame_record, &g_nal_record, &g_sps_record, &g_pps_record,
+    &g_slice_record
+};
+
+/* a line of text output, stderr for the other formats */
+static void
+emit_message(struct emit_t* out, const char* text)
+{
+    if (out->format == EMIT_TEXT)
     {
-        char text[4];
-        int width;
-        int height;
-        int bytes_follow;
-    } header;
+        emit_str(out, text);
+        return;
+    }
+    fputs(text, stderr);
+}
+
+/* data is the escaped nal */
+static int
+process_sps(struct emit_t* out, char* data, int bytes)
+{
+    struct sps_record_t record;
+    struct bits_t bits;
 
-    if (read(fd, &header, sizeof(header)) != sizeof(header))
+    bits_init_nal(&bits, data, bytes);
+    memset(&record, 0, sizeof(record));
+    parse_sps(&bits, &(record.sps));
+    record.bits_error = bits.error;
+    record.bytes_left =
+        (int)(bits.data_bytes - (bits_nal_tell(&bits) + 7) / 8);
+    return emit_record(out, &g_sps_record, &record);
+}
+
+/* data is the escaped nal */
+static int
+process_pps(struct emit_t* out, const struct params_t* params, char* data,
+            int bytes)
+{
+    struct pps_t pps;
+    struct bits_t bits;
+
+    bits_init_nal(&bits, data, bytes);
+    memset(&pps, 0, sizeof(pps));
+    parse_pps(&bits, params->sps, &pps);
+    if ((out->format == EMIT_TEXT) && emit_wants(out, &g_pps_record))
+    {
+        emit_str(out, "-------------------------------------------------------------------------------\n"
+                      "[ PPS ]\n");
+    }
+    return emit_record(out, &g_pps_record, &pps);
+}
+
+/* move fd to frame of a BEEF file through its sidecar index, with
+   to_idr set to the last idr at or before frame */
+static int
+seek_frame(struct emit_t* out, int fd, const char* path, int frame,
+           int to_idr)
+{
+    int error;
+    struct frame_index_t findex;
+
+    if (frame_index_open(&findex, path) != 0)
     {
         return 1;
     }
-    if (strncmp(header.text, "BEEF", 4) != 0)
+    if (to_idr)
+    {
+        frame = frame_index_idr(&findex, frame);
+    }
+    error = frame_index_seek(&findex, fd, frame);
+    if ((error == 0) && (out->format == EMIT_TEXT))
     {
-        printf("not BEEF file\n");
-        return 2;
+        emit_str(out, "seek to frame ");
+        emit_int(out, frame);
+        emit_str(out, "\n");
     }
-    if (header.bytes_follow > *bytes)
+    frame_index_deinit(&findex);
+    return error;
+}
+
+static void
+process_frame_header(struct emit_t* out, int version, int width,
+                     int height, long long bytes, long long timestamp_us,
+                     int flags)
+{
+    struct frame_record_t record;
+
+    if (out->format != EMIT_TEXT)
     {
-        return 3;
+        record.version = version;
+        record.width = width;
+        record.height = height;
+        record.bytes_follow = bytes;
+        record.timestamp_us = timestamp_us;
+        record.flags = flags;
+        emit_record(out, &g_frame_record, &record);
+        return;
     }
-    if (read(fd, data, header.bytes_follow) != header.bytes_follow)
+    emit_str(out, "new frame width ");
+    emit_int(out, width);
+    emit_str(out, " height ");
+    emit_int(out, height);
+    emit_str(out, " bytes_follow ");
+    emit_int(out, bytes);
+    emit_str(out, "\n");
+    if (version > 1)
     {
-        return 4;
+        emit_str(out, "  timestamp_us ");
+        emit_int(out, timestamp_us);
+        emit_str(out, " flags 0x");
+        emit_hex(out, flags, 2);
+        emit_str(out, "\n");
     }
-    printf("new frame width %d height %d bytes_follow %d\n", header.width, header.height, header.bytes_follow);
-    *bytes = header.bytes_follow; 
-    *width = header.width;
-    *height = header.height;
-    return 0;
 }
 
+/* data is the escaped nal, parameter sets go into params
+   everything is parsed before anything is emitted, the text format then
+   tells the same in prose */
 static int
-process_sps(char* data, int bytes)
+process_nal(struct emit_t* out, struct params_t* params, char* data,
+            int nal_bytes, int start_code_bytes, int nal_unit_type)
 {
-    struct sps_t sps;
+    int text;
+    struct nal_record_t record;
+    struct slice_t slice;
     struct bits_t bits;
 
-    bits_init(&bits, data, bytes);
-    memset(&sps, 0, sizeof(sps));
-    parse_sps(&bits, &sps);
-
-    printf("    bits.error                              %d\n", bits.error);
-    printf("    bytes left                              %d\n", (int)(bits.data_bytes - bits.offset));
-    printf("    forbidden_zero_bit                      %d\n", sps.forbidden_zero_bit);
-    printf("    nal_ref_idc                             %d\n", sps.nal_ref_idc);
-    printf("    nal_unit_type                           %d\n", sps.nal_unit_type);
-    printf("    profile_idc                             %d\n", sps.profile_idc);
-    printf("    constraint_set0_flag                    %d\n", sps.constraint_set0_flag);
-    printf("    constraint_set1_flag                    %d\n", sps.constraint_set1_flag);
-    printf("    constraint_set2_flag                    %d\n", sps.constraint_set2_flag);
-    printf("    constraint_set3_flag                    %d\n", sps.constraint_set3_flag);
-    printf("    reserved_zero_4bits                     %d\n", sps.reserved_zero_4bits);
-    printf("    level_idc                               %d\n", sps.level_idc);
-    printf("    seq_parameter_set_id                    %d\n", sps.seq_parameter_set_id);
-    printf("    log2_max_frame_num_minus4               %d\n", sps.log2_max_frame_num_minus4);
-    printf("    pic_order_cnt_type                      %d\n", sps.pic_order_cnt_type);
-    printf("    log2_max_pic_order_cnt_lsb_minus4       %d\n", sps.log2_max_pic_order_cnt_lsb_minus4);
-    printf("    delta_pic_order_always_zero_flag        %d\n", sps.delta_pic_order_always_zero_flag);
-    printf("    offset_for_non_ref_pic                  %d\n", sps.offset_for_non_ref_pic);
-    printf("    offset_for_top_to_bottom_field          %d\n", sps.offset_for_top_to_bottom_field);
-    printf("    num_ref_frames_in_pic_order_cnt_cycle   %d\n", sps.num_ref_frames_in_pic_order_cnt_cycle);
-    printf("    num_ref_frames                          %d\n", sps.num_ref_frames);
-    printf("    gaps_in_frame_num_value_allowed_flag    %d\n", sps.gaps_in_frame_num_value_allowed_flag);
-    printf("    pic_width_in_mbs_minus_1                %d\n", sps.pic_width_in_mbs_minus_1);
-    printf("    pic_height_in_map_units_minus_1         %d\n", sps.pic_height_in_map_units_minus_1);
-    printf("    frame_mbs_only_flag                     %d\n", sps.frame_mbs_only_flag);
-    printf("    mb_adaptive_frame_field_flag            %d\n", sps.mb_adaptive_frame_field_flag);
-    printf("    direct_8x8_inference_flag               %d\n", sps.direct_8x8_inference_flag);
-    printf("    frame_cropping_flag                     %d\n", sps.frame_cropping_flag);
-    printf("    frame_crop_left_offset                  %d\n", sps.frame_crop_left_offset);
-    printf("    frame_crop_right_offset                 %d\n", sps.frame_crop_right_offset);
-    printf("    frame_crop_top_offset                   %d\n", sps.frame_crop_top_offset);
-    printf("    frame_crop_bottom_offset                %d\n", sps.frame_crop_bottom_offset);
-    printf("    vui_prameters_present_flag              %d\n", sps.vui_prameters_present_flag);
-    printf("    aspect_ratio_info_present_flag          %d\n", sps.vui.aspect_ratio_info_present_flag);
-    printf("    aspect_ratio_idc                        %d\n", sps.vui.aspect_ratio_idc);
-    printf("    sar_width                               %d\n", sps.vui.sar_width);
-    printf("    sar_height                              %d\n", sps.vui.sar_height);
-    printf("    overscan_info_present_flag              %d\n", sps.vui.overscan_info_present_flag);
-    printf("    overscan_appropriate_flag               %d\n", sps.vui.overscan_appropriate_flag);
-    printf("    video_signal_type_present_flag          %d\n", sps.vui.video_signal_type_present_flag);
-    printf("    video_format                            %d\n", sps.vui.video_format);
-    printf("    video_full_range_flag                   %d\n", sps.vui.video_full_range_flag);
-    printf("    colour_description_present_flag         %d\n", sps.vui.colour_description_present_flag);
-    printf("    colour_primaries                        %d\n", sps.vui.colour_primaries);
-    printf("    transfer_characteristics                %d\n", sps.vui.transfer_characteristics);
-    printf("    matrix_coefficients                     %d\n", sps.vui.matrix_coefficients);
-    printf("    chroma_loc_info_present_flag            %d\n", sps.vui.chroma_loc_info_present_flag);
-    printf("    chroma_sample_loc_type_top_field        %d\n", sps.vui.chroma_sample_loc_type_top_field);
-    printf("    chroma_sample_loc_type_bottom_field     %d\n", sps.vui.chroma_sample_loc_type_bottom_field);
-    printf("    timing_info_present_flag                %d\n", sps.vui.timing_info_present_flag);
-    printf("    num_units_in_tick                       %d\n", sps.vui.num_units_in_tick);
-    printf("    time_scale                              %d\n", sps.vui.time_scale);
-    printf("    fixed_frame_rate_flag                   %d\n", sps.vui.fixed_frame_rate_flag);
-    printf("    nal_hrd_parameters_present_flag         %d\n", sps.vui.nal_hrd_parameters_present_flag);
-    printf("    vcl_hrd_parameters_present_flag         %d\n", sps.vui.vcl_hrd_parameters_present_flag);
-    printf("    low_delay_hrd_flag                      %d\n", sps.vui.low_delay_hrd_flag);
-    printf("    pic_struct_present_flag                 %d\n", sps.vui.pic_struct_present_flag);
-    printf("    bitstream_restriction_flag              %d\n", sps.vui.bitstream_restriction_flag);
-    printf("    motion_vectors_over_pic_boundaries_flag %d\n", sps.vui.motion_vectors_over_pic_boundaries_flag);
-    printf("    max_bytes_per_pic_denom                 %d\n", sps.vui.max_bytes_per_pic_denom);
-    printf("    max_bits_per_mb_denom                   %d\n", sps.vui.max_bits_per_mb_denom);
-    printf("    log2_max_mv_length_horizontal           %d\n", sps.vui.log2_max_mv_length_horizontal);
-    printf("    log2_max_mv_length_vertical             %d\n", sps.vui.log2_max_mv_length_vertical);
-    printf("    num_reorder_frames                      %d\n", sps.vui.num_reorder_frames);
-    printf("    max_dec_frame_buffering                 %d\n", sps.vui.max_dec_frame_buffering);
-    printf("    width                                   %d\n", sps.width);
-    printf("    height                                  %d\n", sps.height);
+    memset(&record, 0, sizeof(record));
+    record.start_code_bytes = start_code_bytes;
+    record.nal_bytes = nal_bytes;
+    record.nal_unit_type = nal_unit_type;
+    switch (nal_unit_type)
+    {
+        case 1: /* Coded slice of a non-IDR picture */
+        case 5: /* Coded slice of an IDR picture */
+            bits_init_nal(&bits, data, nal_bytes);
+            memset(&slice, 0, sizeof(slice));
+            record.slice_error = parse_slice_header(&bits, params->sps,
+                                                    params->pps, &slice);
+            break;
+        case 7: /* Sequence parameter set */
+        case 8: /* Picture parameter set */
+            record.params_event = params_parse(params, data, nal_bytes,
+                                               nal_unit_type,
+                                               &(record.params_id));
+            break;
+        default:
+            break;
+    }
+
+    text = out->format == EMIT_TEXT;
+    if (text)
+    {
+        emit_str(out, "  start_code_bytes ");
+        emit_int(out, start_code_bytes);
+        emit_str(out, " nal_bytes ");
+        emit_int(out, nal_bytes);
+        emit_str(out, "\n  nal_unit_type 0x");
+        emit_hex(out, nal_unit_type, 2);
+        emit_str(out, "\n");
+    }
+    else
+    {
+        emit_record(out, &g_nal_record, &record);
+    }
+    switch (nal_unit_type)
+    {
+        case 1:
+        case 5:
+            emit_hexdump(out, data, nal_bytes < 32 ? nal_bytes : 32);
+            if (record.slice_error == 0)
+            {
+                emit_record(out, &g_slice_record, &slice);
+            }
+            else if (text)
+            {
+                emit_str(out, record.slice_error == 1 ?
+                         "    slice header without sps or pps" :
+                         "    slice header error");
+                emit_str(out, ", pic_parameter_set_id ");
+                emit_int(out, slice.pic_parameter_set_id);
+                emit_str(out, "\n");
+            }
+            break;
+        case 7:
+            emit_hexdump(out, data, nal_bytes);
+            if (record.params_event == PARAMS_SAME)
+            {
+                if (text)
+                {
+                    emit_str(out, "    same as sps ");
+                    emit_int(out, record.params_id);
+                    emit_str(out, " before\n");
+                }
+                break;
+            }
+            if (text && (record.params_event == PARAMS_RES_CHANGE))
+            {
+                emit_str(out, "    sps ");
+                emit_int(out, record.params_id);
+                emit_str(out, " resolution change to ");
+                emit_int(out, params->sps[record.params_id]->width);
+                emit_str(out, "x");
+                emit_int(out, params->sps[record.params_id]->height);
+                emit_str(out, "\n");
+            }
+            process_sps(out, data, nal_bytes);
+            break;
+        case 8:
+            emit_hexdump(out, data, nal_bytes);
+            if (record.params_event == PARAMS_SAME)
+            {
+                if (text)
+                {
+                    emit_str(out, "    same as pps ");
+                    emit_int(out, record.params_id);
+                    emit_str(out, " before\n");
+                }
+                break;
+            }
+            process_pps(out, params, data, nal_bytes);
+            break;
+        case 9: /* Access unit delimiter */
+            emit_hexdump(out, data, nal_bytes);
+            break;
+        default:
+            break;
+    }
     return 0;
 }
 
+/* -j, frames are read in order on the main thread, parsed by workers
+   into a text buffer each and written out in order
+   the main thread also keeps the parameter sets and hands each job a
+   copy of them as they were before its frame
+   a job slot goes free -> read -> busy -> done -> free, seq % MAX_JOBS
+   picks the slot so at most MAX_JOBS frames are in flight */
+#define MAX_THREADS 64
+#define JOBS_PER_THREAD 4
+
+#define JOB_FREE 0
+#define JOB_READY 1
+#define JOB_BUSY 2
+#define JOB_DONE 3
+
+struct job_t
+{
+    int state;
+    int error;
+    struct beef_frame_t frame;
+    char* data;
+    long long data_bytes;   /* allocated */
+    struct emit_t out;      /* no fd, kept from frame to frame */
+    struct nal_index_t index;
+    struct params_t params;
+};
+
+struct jobs_t
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t ready_cond;  /* a job is ready or done is set */
+    pthread_cond_t done_cond;   /* a job is done */
+    struct job_t* jobs;
+    int num_jobs;
+    long long next_read;        /* seq of the next frame read */
+    long long next_take;        /* seq a worker takes next */
+    int done;                   /* no more frames */
+};
+
+/* parse one whole frame into job->out */
 static int
-process_pps(const char* data, int bytes)
+process_job(struct job_t* job)
 {
-    struct pps_t pps;
-    struct bits_t bits;
+    int index;
+    struct emit_t* out;
+    struct nal_entry_t* entry;
 
-    bits_init(&bits, data, bytes);
-    memset(&pps, 0, sizeof(pps));
-    parse_pps(&bits, &pps);
-
-    printf("-------------------------------------------------------------------------------\n");
-    printf("[ PPS ]\n");
-    printf("        pic_parameter_set_id                   %d\n", pps.pic_parameter_set_id);
-    printf("        seq_parameter_set_id                   %d\n", pps.seq_parameter_set_id);
-    printf("        entropy_coding_mode_flag               %d\n", pps.entropy_coding_mode_flag);
-    printf("        pic_order_present_flag                 %d\n", pps.pic_order_present_flag);
-    printf("        num_slice_groups_minus1                %d\n", pps.num_slice_groups_minus1);
-    printf("        num_ref_idx_l0_active_minus1           %d\n", pps.num_ref_idx_l0_active_minus1);
-    printf("        num_ref_idx_l1_active_minus1           %d\n", pps.num_ref_idx_l1_active_minus1);
-    printf("        weighted_pred_flag                     %d\n", pps.weighted_pred_flag);
-    printf("        weighted_bipred_idc                    %d\n", pps.weighted_bipred_idc);
-    printf("        pic_init_qp_minus26                    %d\n", pps.pic_init_qp_minus26);
-    printf("        pic_init_qs_minus26                    %d\n", pps.pic_init_qs_minus26);
-    printf("        chroma_qp_index_offset                 %d\n", pps.chroma_qp_index_offset);
-    printf("        deblocking_filter_control_present_flag %d\n", pps.deblocking_filter_control_present_flag);
-    printf("        constrained_intra_pred_flag            %d\n", pps.constrained_intra_pred_flag);
-    printf("        redundant_pic_cnt_present_flag         %d\n", pps.redundant_pic_cnt_present_flag);
+    out = &(job->out);
+    process_frame_header(out, job->frame.version, job->frame.width,
+                         job->frame.height, job->frame.bytes,
+                         job->frame.timestamp_us, job->frame.flags);
+    if (nal_index_build(&(job->index), job->data, job->frame.bytes) < 0)
+    {
+        job->error = 1;
+    }
+    else if ((job->frame.bytes > 0) && (job->index.count < 1))
+    {
+        emit_message(out, "bad start code\n");
+    }
+    for (index = 0; index < job->index.count; index++)
+    {
+        entry = job->index.nals + index;
+        process_nal(out, &(job->params), job->data + entry->offset,
+                    entry->bytes, entry->start_code_bytes,
+                    entry->nal_unit_type);
+    }
+    if ((job->frame.version > 1) &&
+        (beef_crc32(0, job->data, job->frame.bytes) != job->frame.checksum))
+    {
+        job->error = 1;
+    }
+    job->error |= out->error;
+    return job->error;
+}
+
+static void*
+worker_thread(void* arg)
+{
+    struct jobs_t* jobs;
+    struct job_t* job;
+
+    jobs = (struct jobs_t*)arg;
+    pthread_mutex_lock(&(jobs->mutex));
+    for (;;)
+    {
+        job = jobs->jobs + jobs->next_take % jobs->num_jobs;
+        if ((jobs->next_take < jobs->next_read) && (job->state == JOB_READY))
+        {
+            job->state = JOB_BUSY;
+            jobs->next_take++;
+            pthread_mutex_unlock(&(jobs->mutex));
+            process_job(job);
+            pthread_mutex_lock(&(jobs->mutex));
+            job->state = JOB_DONE;
+            pthread_cond_signal(&(jobs->done_cond));
+            continue;
+        }
+        if (jobs->done)
+        {
+            break;
+        }
+        pthread_cond_wait(&(jobs->ready_cond), &(jobs->mutex));
+    }
+    pthread_mutex_unlock(&(jobs->mutex));
+    return NULL;
+}
+
+/* write out done jobs in order up to seq, waiting for them, called with
+   the mutex held
+   returns 1 once a job had an error */
+static int
+write_jobs(struct jobs_t* jobs, struct emit_t* out, long long* next_write,
+           long long seq)
+{
+    struct job_t* job;
+
+    while (*next_write < seq)
+    {
+        job = jobs->jobs + *next_write % jobs->num_jobs;
+        if (job->state != JOB_DONE)
+        {
+            pthread_cond_wait(&(jobs->done_cond), &(jobs->mutex));
+            continue;
+        }
+        emit_data(out, job->out.buf, job->out.bytes);
+        job->out.bytes = 0;
+        job->state = JOB_FREE;
+        (*next_write)++;
+        if (job->error)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* read a BEEF frame into job, 0 ok, 1 end of frames, else error */
+static int
+read_job(int fd, struct job_t* job)
+{
+    int rv;
+    long long bytes;
+    long long readed;
+    char* data;
+
+    rv = beef_read_header(fd, &(job->frame));
+    if (rv != 0)
+    {
+        return rv;
+    }
+    if (job->frame.bytes > job->data_bytes)
+    {
+        data = (char*)realloc(job->data, job->frame.bytes);
+        if (data == NULL)
+        {
+            return 2;
+        }
+        job->data = data;
+        job->data_bytes = job->frame.bytes;
+    }
+    bytes = 0;
+    while (bytes < job->frame.bytes)
+    {
+        readed = read(fd, job->data + bytes, job->frame.bytes - bytes);
+        if (readed < 1)
+        {
+            return 2;
+        }
+        bytes += readed;
+    }
+    job->error = 0;
+    return 0;
+}
+
+/* keep params current past the frame in job, v2 frames say in their
+   flags whether there is anything to find */
+static int
+scan_job_params(struct params_t* params, struct nal_index_t* index,
+                struct job_t* job)
+{
+    int jndex;
+    int id;
+    struct nal_entry_t* entry;
+
+    if ((job->frame.version > 1) &&
+        !(job->frame.flags & (FRAME_FLAG_SPS | FRAME_FLAG_PPS)))
+    {
+        return 0;
+    }
+    if (nal_index_build(index, job->data, job->frame.bytes) < 0)
+    {
+        return 1;
+    }
+    for (jndex = 0; jndex < index->count; jndex++)
+    {
+        entry = index->nals + jndex;
+        if ((entry->nal_unit_type == 7) || (entry->nal_unit_type == 8))
+        {
+            params_parse(params, job->data + entry->offset, entry->bytes,
+                         entry->nal_unit_type, &id);
+        }
+    }
     return 0;
 }
 
+/* returns 0, 1 on error or -1 when no thread could be started, nothing
+   is read from fd then */
+static int
+process_parallel(struct emit_t* out, int fd, int num_threads)
+{
+    int index;
+    int rv;
+    int error;
+    int started;
+    long long next_write;
+    struct job_t* job;
+    struct jobs_t jobs;
+    struct params_t params;
+    struct nal_index_t nals;
+    pthread_t threads[MAX_THREADS];
+
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.num_jobs = num_threads * JOBS_PER_THREAD;
+    jobs.jobs = (struct job_t*)calloc(jobs.num_jobs, sizeof(struct job_t));
+    if (jobs.jobs == NULL)
+    {
+        return 1;
+    }
+    pthread_mutex_init(&(jobs.mutex), NULL);
+    pthread_cond_init(&(jobs.ready_cond), NULL);
+    pthread_cond_init(&(jobs.done_cond), NULL);
+    for (index = 0; index < jobs.num_jobs; index++)
+    {
+        emit_init(&(jobs.jobs[index].out), -1, out->format, out->select);
+        jobs.jobs[index].out.hexdump = out->hexdump;
+    }
+    for (started = 0; started < num_threads; started++)
+    {
+        if (pthread_create(threads + started, NULL, worker_thread,
+                           &jobs) != 0)
+        {
+            break;
+        }
+    }
+    error = started < 1 ? -1 : 0;
+    next_write = 0;
+    params_init(&params);
+    memset(&nals, 0, sizeof(nals));
+    pthread_mutex_lock(&(jobs.mutex));
+    while (!error)
+    {
+        /* the slot for the next frame frees once its last user is out */
+        error = write_jobs(&jobs, out, &next_write,
+                           jobs.next_read - jobs.num_jobs + 1);
+        if (error)
+        {
+            break;
+        }
+        job = jobs.jobs + jobs.next_read % jobs.num_jobs;
+        pthread_mutex_unlock(&(jobs.mutex));
+        rv = read_job(fd, job);
+        if (rv == 0)
+        {
+            if ((params_copy(&(job->params), &params) != 0) ||
+                (scan_job_params(&params, &nals, job) != 0))
+            {
+                rv = 2;
+            }
+        }
+        pthread_mutex_lock(&(jobs.mutex));
+        if (rv != 0)
+        {
+            /* frames read before a bad one still go out */
+            error = write_jobs(&jobs, out, &next_write, jobs.next_read);
+            error |= rv != 1;
+            break;
+        }
+        job->state = JOB_READY;
+        jobs.next_read++;
+        pthread_cond_signal(&(jobs.ready_cond));
+    }
+    jobs.done = 1;
+    pthread_cond_broadcast(&(jobs.ready_cond));
+    pthread_mutex_unlock(&(jobs.mutex));
+    for (index = 0; index < started; index++)
+    {
+        pthread_join(threads[index], NULL);
+    }
+    for (index = 0; index < jobs.num_jobs; index++)
+    {
+        free(jobs.jobs[index].data);
+        emit_deinit(&(jobs.jobs[index].out));
+        nal_index_deinit(&(jobs.jobs[index].index));
+        params_deinit(&(jobs.jobs[index].params));
+    }
+    free(jobs.jobs);
+    params_deinit(&params);
+    nal_index_deinit(&nals);
+    pthread_cond_destroy(&(jobs.ready_cond));
+    pthread_cond_destroy(&(jobs.done_cond));
+    pthread_mutex_destroy(&(jobs.mutex));
+    return error;
+}
+
 char test[] =
 {
     0x67, 0x42, 0xc0, 0x20, 0xda, 0x01, 0x0c, 0x1d,
     0xf9, 0x78, 0x40, 0x00, 0x00, 0x03, 0x00, 0x40,
     0x00, 0x00, 0x0c, 0x23, 0xc6, 0x0c, 0xa8 };
 
+/* -j only splits BEEF input, anything else is parsed in one pass, so
+   is a pipe since its first bytes can not be looked at and put back */
+static int
+is_beef(int fd)
+{
+    char text[4];
+    long long offset;
+
+    offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0)
+    {
+        return 0;
+    }
+    if (pread(fd, text, 4, offset) != 4)
+    {
+        return 0;
+    }
+    return (strncmp(text, "BEEF", 4) == 0) || (strncmp(text, "BEF2", 4) == 0);
+}
+
+/* --stats, one pass over the nals into counters, printed once at the
+   end */
+static int
+process_stats(int fd)
+{
+    int rv;
+    struct nal_stream_t stream;
+    struct nal_unit_t nal;
+    struct stats_t stats;
+
+    if (nal_stream_init(&stream, fd) != 0)
+    {
+        nal_stream_deinit(&stream);
+        return 1;
+    }
+    stats_init(&stats, stream.format == NAL_STREAM_BEEF);
+    while ((rv = nal_stream_next(&stream, &nal)) != NAL_STREAM_END)
+    {
+        if (rv == NAL_STREAM_ERROR)
+        {
+            break;
+        }
+        if (rv == NAL_STREAM_FRAME)
+        {
+            stats_frame(&stats);
+        }
+        else if (rv == NAL_STREAM_NAL)
+        {
+            stats_nal(&stats, nal.data, nal.bytes, nal.start_code_bytes,
+                      nal.nal_unit_type);
+        }
+    }
+    stats_print(&stats, stdout);
+    stats_deinit(&stats);
+    nal_stream_deinit(&stream);
+    return rv == NAL_STREAM_ERROR;
+}
+
+static const struct option g_long_options[] =
+{
+    { "stats", no_argument, NULL, 'S' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* parser [--stats] [-o text|binary|jsonl|csv] [-s field,...] [-x 0|1] ... file
+   -s picks the fields to format, a name or record.name for each
+   -x turns the nal hexdump off or on, it is on for text only */
 int
 main(int argc, char** argv)
 {
     int fd;
-    char* alloc_data;
-    char* data;
-    char* end_data;
-    int data_bytes;
-    int width;
-    int height;
-    int nal_unit_type;
-    int start_code_bytes;
-    int nal_bytes;
-    char* rbsp;
-    int lnal_bytes;
-    int rbsp_bytes;
+    int rv;
+    int opt;
+    int frame;
+    int to_idr;
+    int num_threads;
+    int nal_count;
+    int format;
+    int hexdump;
+    int stats;
+    const char* select;
+    char text[64];
+    struct nal_stream_t stream;
+    struct nal_unit_t nal;
+    struct params_t params;
+    struct emit_t out;
 
-    if (argc < 2)
+    frame = -1;
+    to_idr = 0;
+    num_threads = 0;
+    format = EMIT_TEXT;
+    hexdump = -1;
+    select = NULL;
+    stats = 0;
+    while ((opt = getopt_long(argc, argv, "f:i:j:o:s:x:", g_long_options,
+                              NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'f': /* start at frame */
+                frame = atoi(optarg);
+                break;
+            case 'i': /* start at the idr before frame */
+                frame = atoi(optarg);
+                to_idr = 1;
+                break;
+            case 'j': /* parse frames on this many threads */
+                num_threads = atoi(optarg);
+                break;
+            case 'o': /* output format */
+                format = emit_format(optarg);
+                if (format < 0)
+                {
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's': /* only these fields */
+                select = optarg;
+                break;
+            case 'x': /* nal hexdump */
+                hexdump = atoi(optarg) != 0;
+                break;
+            case 'S': /* stream statistics only */
+                stats = 1;
+                break;
+            default:
+                printf("usage: parser [--stats] [-f frame | -i frame] "
+                       "[-j threads] [-o text|binary|jsonl|csv] "
+                       "[-s field,...] [-x 0|1] file\n");
+                return 1;
+        }
+    }
+    /* records go to fd 1, messages go through emit_message so they stay
+       out of a binary, jsonl or csv stream */
+    emit_init(&out, 1, format, select);
+    if (hexdump >= 0)
     {
-        printf("error\n");
+        out.hexdump = hexdump;
+    }
+    if (optind >= argc)
+    {
+        emit_message(&out, "error\n");
+        emit_deinit(&out);
         return 1;
     }
-    fd = open(argv[1], O_RDONLY);
-    if (fd == -1)
+    fd = 0;
+    if (strcmp(argv[optind], "-") != 0)
+    {
+        fd = open(argv[optind], O_RDONLY);
+        if (fd == -1)
+        {
+            emit_message(&out, "error\n");
+            emit_deinit(&out);
+            return 1;
+        }
+    }
+    if ((frame >= 0) &&
+        (seek_frame(&out, fd, argv[optind], frame, to_idr) != 0))
     {
-        printf("error\n");
+        snprintf(text, sizeof(text), "error seeking to frame %d\n", frame);
+        emit_message(&out, text);
+        emit_deinit(&out);
+        close(fd);
         return 1;
     }
-    data_bytes = 1024 * 1024;
-    alloc_data = (char*)malloc(data_bytes);
-    while (get_next_frame(fd, alloc_data, &data_bytes, &width, &height) == 0)
+    if (stats)
     {
-        data = alloc_data;
-        end_data = data + data_bytes;
-        while (data < end_data)
+        /* the statistics are text on stdout whatever the format */
+        rv = process_stats(fd);
+        close(fd);
+        fflush(stdout);
+        if (rv != 0)
         {
-            start_code_bytes = parse_start_code(data, end_data);
-            if (start_code_bytes == 0)
+            emit_message(&out, "error\n");
+        }
+        emit_deinit(&out);
+        return rv;
+    }
+    emit_header(&out, g_records, sizeof(g_records) / sizeof(g_records[0]));
+    if (num_threads > MAX_THREADS)
+    {
+        num_threads = MAX_THREADS;
+    }
+    if ((num_threads > 0) && is_beef(fd))
+    {
+        rv = process_parallel(&out, fd, num_threads);
+        if (rv >= 0)
+        {
+            if (rv != 0)
             {
-                printf("bad start code\n");
-                break;
+                emit_message(&out, "error\n");
             }
-            data += start_code_bytes;
-            nal_bytes = get_nal_bytes(data, end_data);
-
-            lnal_bytes = nal_bytes;
-            rbsp_bytes = lnal_bytes + 16;
-            rbsp = (char*)malloc(rbsp_bytes);
-            if (rbsp != NULL)
+            close(fd);
+            emit_message(&out, "end test\n");
+            emit_deinit(&out);
+            return rv != 0;
+        }
+        /* no threads, the file is parsed here from where it was */
+    }
+    if (nal_stream_init(&stream, fd) != 0)
+    {
+        emit_message(&out, "error\n");
+        emit_deinit(&out);
+        nal_stream_deinit(&stream);
+        close(fd);
+        return 1;
+    }
+    nal_count = 0;
+    params_init(&params);
+    while ((rv = nal_stream_next(&stream, &nal)) != NAL_STREAM_END)
+    {
+        if (rv == NAL_STREAM_ERROR)
+        {
+            emit_message(&out, "error\n");
+            break;
+        }
+        if (rv == NAL_STREAM_FRAME)
+        {
+            process_frame_header(&out, stream.version, stream.width,
+                                 stream.height, stream.frame_bytes,
+                                 stream.timestamp_us, stream.frame_flags);
+            nal_count = 0;
+            continue;
+        }
+        if (rv == NAL_STREAM_SEGMENT_END)
+        {
+            if ((nal_count < 1) && (nal.lead_bytes > 0))
             {
-                if (nal_to_rbsp(data, &lnal_bytes, rbsp, &rbsp_bytes) != -1)
-                {
-                    printf("  start_code_bytes %d rbsp_bytes %d\n", start_code_bytes, rbsp_bytes);
-                    nal_unit_type = rbsp[0] & 0x1F;
-                    printf("  nal_unit_type 0x%2.2x\n", nal_unit_type);
-                    switch (nal_unit_type)
-                    {
-                        case 1: /* Coded slice of a non-IDR picture */
-                            hexdump(data, 32);
-                            break;
-                        case 5: /* Coded slice of an IDR picture */
-                            hexdump(data, 32);
-                            break;
-                        case 7: /* Sequence parameter set */
-                            hexdump(rbsp, rbsp_bytes);
-                            process_sps(rbsp, rbsp_bytes);
-                            break;
-                        case 8: /* Picture parameter set */
-                            hexdump(rbsp, rbsp_bytes);
-                            process_pps(rbsp, rbsp_bytes);
-                            break;
-                        case 9: /* Access unit delimiter */
-                            hexdump(rbsp, rbsp_bytes);
-                            break;
-                        default:
-                            break;
-                    }
-                }
-                free(rbsp);
+                emit_message(&out, "bad start code\n");
             }
-            data += nal_bytes;
+            continue;
         }
-        data_bytes = 1024 * 1024;
+        nal_count++;
+        process_nal(&out, &params, nal.data, nal.bytes,
+                    nal.start_code_bytes, nal.nal_unit_type);
     }
-    free(alloc_data);
+    params_deinit(&params);
+    nal_stream_deinit(&stream);
     close(fd);
 
-    printf("end test\n");
+    emit_message(&out, "end test\n");
 #if 0
-    lnal_bytes = sizeof(test);
-    rbsp_bytes = lnal_bytes + 16;
-    rbsp = (char*)malloc(rbsp_bytes);
-    if (rbsp != NULL)
-    {
-        if (nal_to_rbsp(test, &lnal_bytes, rbsp, &rbsp_bytes) != -1)
-        {
-            hexdump(test, sizeof(test));
-            hexdump(rbsp, sizeof(test));
-            process_sps(rbsp, rbsp_bytes);
-        }
-        free(rbsp);
-    }
+    emit_hexdump(&out, test, sizeof(test));
+    process_sps(&out, test, sizeof(test));
 #endif
-    return 0;
+    emit_deinit(&out);
+    return rv == NAL_STREAM_ERROR;
 }
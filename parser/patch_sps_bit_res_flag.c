@@ -1,205 +1,764 @@
 
+#define _GNU_SOURCE     /* copy_file_range */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "bits.h"
 #include "sps.h"
+#include "sps_rewrite.h"
 #include "utils.h"
+#include "stream.h"
+#include "beef.h"
+
+/* what the patcher always did, every bitstream restriction field set with
+   motion_vectors_over_pic_boundaries_flag 1, the denoms 0, mv lengths
+   11, num_reorder_frames 0 and max_dec_frame_buffering 1 */
+static const char* g_default_rules =
+    "vui.bitstream_restriction=1:0:0:11:11:0:1";
+
+static const char* g_usage =
+    "usage: patch_sps_bit_res_flag [-2] [-j threads] [-r rule,...] in out\n"
+    "       patch_sps_bit_res_flag -i [-j threads] [-r rule,...] file\n";
+
+#define MAX_THREADS         64
+#define PATCH_CHUNK_BYTES   (32 * 1024 * 1024)
+#define PATCH_WINDOW_BYTES  (4 * 1024 * 1024)
+#define PATCH_NAL_STEP      (64 * 1024)
+#define OUT_BATCH_BYTES     (1024 * 1024)
+#define OUT_BATCH_DIRECT    (64 * 1024)
+
+/* stream output, start codes and small nals are gathered in buf, a big
+   nal goes out by reference in the same writev as what was gathered */
+struct out_batch_t
+{
+    int fd;
+    char* buf;          /* OUT_BATCH_BYTES */
+    int bytes;
+};
 
 static int
-sps_set_it_vui(struct bits_t* bits)
+out_batch_flush(struct out_batch_t* batch, const char* data, int bytes)
 {
-    int val;
-    int val1;
+    struct iovec iov[2];
+
+    iov[0].iov_base = batch->buf;
+    iov[0].iov_len = batch->bytes;
+    iov[1].iov_base = (char*)data;
+    iov[1].iov_len = bytes;
+    batch->bytes = 0;
+    return write_iov(batch->fd, iov, 2);
+}
 
-    val = in_uint(bits, 1); // aspect_ratio_info_present_flag
-    if (val)
+/* bytes go to the batch unless a BEEF frame is collecting in frame, its
+   header can only be written once its new size is known */
+static int
+out_bytes(struct out_batch_t* batch, struct wbits_t* frame,
+          const char* data, int bytes)
+{
+    if (bytes < 1)
+    {
+        return 0;
+    }
+    if (frame != NULL)
+    {
+        return wbits_copy(frame, data, 0, (long long)bytes * 8);
+    }
+    if (bytes >= OUT_BATCH_DIRECT)
     {
-        val = in_uint(bits, 8); // aspect_ratio_idc
-        if (val == 255)
+        return out_batch_flush(batch, data, bytes);
+    }
+    if ((batch->bytes + bytes > OUT_BATCH_BYTES) &&
+        (out_batch_flush(batch, NULL, 0) != 0))
+    {
+        return 1;
+    }
+    memcpy(batch->buf + batch->bytes, data, bytes);
+    batch->bytes += bytes;
+    return 0;
+}
+
+/* write the collected frame with its header, v2 input stays v2 and v1
+   input becomes v2 with to_v2
+   returns the header bytes written or -1 on error */
+static int
+out_frame(int out_fd, struct nal_stream_t* stream, struct wbits_t* frame,
+          struct beef_writer_t* writer, int to_v2)
+{
+    long long bytes;
+    struct _header
+    {
+        char text[4];
+        int width;
+        int height;
+        int bytes_follow;
+    } header;
+    struct iovec iov[2];
+
+    bytes = wbits_flush(frame);
+    frame->offset = 0;
+    if ((stream->version > 1) || to_v2)
+    {
+        if (beef_writer_frame(writer, frame->data, bytes, stream->width,
+                              stream->height, stream->timestamp_us) != 0)
         {
-            /* Extended_SAR */
-            in_uint(bits, 16); // sar_width
-            in_uint(bits, 16); // sar_height
+            return -1;
         }
+        return sizeof(struct beef2_header_t);
     }
-
-    val = in_uint(bits, 1); // overscan_info_present_flag
-    if (val)
+    memcpy(header.text, "BEEF", 4);
+    header.width = stream->width;
+    header.height = stream->height;
+    header.bytes_follow = bytes;
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = frame->data;
+    iov[1].iov_len = bytes;
+    if (write_iov(out_fd, iov, 2) != 0)
     {
-        in_uint(bits, 1); // overscan_appropriate_flag
+        return -1;
     }
+    return sizeof(header);
+}
+
+/* raw Annex B from a file is cut into chunks, each chunk owns the nals
+   whose payload starts in it
+   scan, on -j threads, find the sps nals of each chunk and rewrite them
+   then a prefix sum over the size changes gives each chunk its output
+   offset
+   write, on -j threads, each chunk is copied to its offset with
+   copy_file_range, which shares blocks where the filesystem can, and only
+   its sps nals are written
+   the output is the same as the stream path's
+   in place, -i, the sps nals are written over the input, one that got
+   shorter is followed by zeros, trailing_zero_8bits, so the file keeps its
+   size, nothing is written when one got longer */
+
+/* an sps payload of bytes at offset in the input replaced by data */
+struct patch_edit_t
+{
+    long long offset;
+    int bytes;
+    char* data;
+    int data_bytes;
+};
+
+/* [span_start, span_end) of the input goes out at out_offset, the span
+   is [start, end) grown by an sps running past end and shrunk by one
+   from the chunk before running into it */
+struct patch_chunk_t
+{
+    long long start;
+    long long end;
+    long long span_start;
+    long long span_end;
+    long long out_offset;
+    long long delta;        /* output minus input bytes */
+    struct patch_edit_t* edits;
+    int num_edits;
+    int alloc_edits;
+    int error;
+};
+
+struct patch_t
+{
+    pthread_mutex_t mutex;
+    int in_fd;
+    int out_fd;
+    long long file_bytes;
+    const char* rules;
+    int write;              /* 0 scan, 1 write */
+    int in_place;           /* out_fd is in_fd */
+    int grown;              /* in place, sps nals that got longer */
+    struct patch_chunk_t* chunks;
+    int num_chunks;
+    int next_chunk;
+    long long hits;
+    long long misses;
+    long long rejected;
+};
 
-    val = in_uint(bits, 1); // video_signal_type_present_flag
-    if (val)
+/* what a worker keeps from chunk to chunk */
+struct patch_worker_t
+{
+    struct patch_t* patch;
+    struct sps_rewrite_t rewrite;
+    char* window;           /* PATCH_WINDOW_BYTES */
+    char* nal;
+    int nal_alloc;
+    int no_copy_range;      /* copy_file_range failed, copy through window */
+};
+
+static int
+pread_full(int fd, char* data, long long bytes, long long offset)
+{
+    long long readed;
+
+    while (bytes > 0)
     {
-        in_uint(bits, 3); // video_format
-        in_uint(bits, 1); // video_full_range_flag
-        val = in_uint(bits, 1); // colour_description_present_flag
-        if (val)
+        readed = pread(fd, data, bytes, offset);
+        if (readed < 1)
         {
-            in_uint(bits, 8); // colour_primaries
-            in_uint(bits, 8); // transfer_characteristics
-            in_uint(bits, 8); // matrix_coefficients
+            return 1;
         }
+        data += readed;
+        bytes -= readed;
+        offset += readed;
     }
+    return 0;
+}
 
-    val = in_uint(bits, 1); // chroma_loc_info_present_flag
-    if (val)
+static int
+pwrite_full(int fd, const char* data, long long bytes, long long offset)
+{
+    long long written;
+
+    while (bytes > 0)
     {
-        in_ueint(bits); // chroma_sample_loc_type_top_field
-        in_ueint(bits); // chroma_sample_loc_type_bottom_field
+        written = pwrite(fd, data, bytes, offset);
+        if (written < 1)
+        {
+            return 1;
+        }
+        data += written;
+        bytes -= written;
+        offset += written;
     }
+    return 0;
+}
 
-    val = in_uint(bits, 1); // timing_info_present_flag
-    if (val)
+/* the nal whose payload starts at offset into worker->nal, up to the
+   next start code or the end of the file less trailing zeros the way
+   nal_stream_next ends it
+   returns its bytes or -1 on error */
+static int
+patch_read_nal(struct patch_worker_t* worker, long long offset)
+{
+    int bytes;
+    int search;
+    int code_bytes;
+    long long step;
+    char* data;
+    const char* code;
+
+    bytes = 0;
+    search = 0;
+    for (;;)
     {
-        in_uint(bits, 32); // num_units_in_tick
-        in_uint(bits, 32); // time_scale
-        in_uint(bits, 1); // fixed_frame_rate_flag
+        step = worker->patch->file_bytes - offset - bytes;
+        if (step > PATCH_NAL_STEP)
+        {
+            step = PATCH_NAL_STEP;
+        }
+        if (step < 1)
+        {
+            break;
+        }
+        if (bytes + step > worker->nal_alloc)
+        {
+            data = (char*)realloc(worker->nal, bytes + step);
+            if (data == NULL)
+            {
+                return -1;
+            }
+            worker->nal = data;
+            worker->nal_alloc = bytes + step;
+        }
+        if (pread_full(worker->patch->in_fd, worker->nal + bytes, step,
+                       offset + bytes) != 0)
+        {
+            return -1;
+        }
+        bytes += step;
+        code = find_start_code(worker->nal + search, worker->nal + bytes,
+                               &code_bytes);
+        if (code < worker->nal + bytes)
+        {
+            bytes = code - worker->nal;
+            break;
+        }
+        search = bytes - 2;
     }
-
-    val = in_uint(bits, 1); // nal_hrd_parameters_present_flag
-    if (val)
+    while ((bytes > 0) && (worker->nal[bytes - 1] == 0))
     {
-        //parse_hrd(bits, &(vui->nal_hrd_parameters));
+        bytes--;
     }
+    return bytes;
+}
+
+static int
+patch_add_edit(struct patch_chunk_t* chunk, long long offset, int bytes,
+               const char* data, int data_bytes)
+{
+    int alloc;
+    struct patch_edit_t* edits;
+    struct patch_edit_t* edit;
 
-    val1 = in_uint(bits, 1); // vcl_hrd_parameters_present_flag
-    if (val1)
+    if (chunk->num_edits >= chunk->alloc_edits)
     {
-        //parse_hrd(bits, &(vui->vcl_hrd_parameters));
+        alloc = chunk->alloc_edits < 16 ? 16 : chunk->alloc_edits * 2;
+        edits = (struct patch_edit_t*)
+            realloc(chunk->edits, alloc * sizeof(struct patch_edit_t));
+        if (edits == NULL)
+        {
+            return 1;
+        }
+        chunk->edits = edits;
+        chunk->alloc_edits = alloc;
     }
+    edit = chunk->edits + chunk->num_edits;
+    edit->data = (char*)malloc(data_bytes > 0 ? data_bytes : 1);
+    if (edit->data == NULL)
+    {
+        return 1;
+    }
+    memcpy(edit->data, data, data_bytes);
+    edit->offset = offset;
+    edit->bytes = bytes;
+    edit->data_bytes = data_bytes;
+    chunk->num_edits++;
+    chunk->delta += data_bytes - bytes;
+    return 0;
+}
+
+/* windows overlap by 3 bytes so a start code across the edge is found
+   in the next one, a window only takes payloads that start inside it */
+static int
+patch_scan_chunk(struct patch_worker_t* worker, struct patch_chunk_t* chunk)
+{
+    int code_bytes;
+    int bytes;
+    int new_bytes;
+    long long pos;
+    long long window_bytes;
+    long long payload;
+    const char* code;
+    const char* end;
+    const char* new_sps;
+    struct patch_t* patch;
 
-    if (val || val1)
+    patch = worker->patch;
+    pos = chunk->start > 3 ? chunk->start - 3 : 0;
+    for (;;)
     {
-        in_uint(bits, 1); // low_delay_hrd_flag
+        window_bytes = patch->file_bytes - pos;
+        if (window_bytes > PATCH_WINDOW_BYTES)
+        {
+            window_bytes = PATCH_WINDOW_BYTES;
+        }
+        if (window_bytes < 4)
+        {
+            return 0;
+        }
+        if (pread_full(patch->in_fd, worker->window, window_bytes, pos) != 0)
+        {
+            return 1;
+        }
+        end = worker->window + window_bytes;
+        code = find_start_code(worker->window, end, &code_bytes);
+        while (code < end)
+        {
+            payload = pos + (code - worker->window) + code_bytes;
+            if ((payload >= chunk->end) || (payload >= pos + window_bytes))
+            {
+                break;
+            }
+            if ((payload >= chunk->start) &&
+                ((worker->window[payload - pos] & 0x1F) == 7))
+            {
+                bytes = patch_read_nal(worker, payload);
+                if (bytes < 0)
+                {
+                    return 1;
+                }
+                if ((bytes > 0) &&
+                    (sps_rewrite_nal(&(worker->rewrite), worker->nal, bytes,
+                                     &new_sps, &new_bytes) == 0) &&
+                    (new_bytes > 0) &&
+                    ((new_bytes != bytes) ||
+                     (memcmp(new_sps, worker->nal, bytes) != 0)) &&
+                    (patch_add_edit(chunk, payload, bytes, new_sps,
+                                    new_bytes) != 0))
+                {
+                    return 1;
+                }
+            }
+            code = find_start_code(code + code_bytes, end, &code_bytes);
+        }
+        if ((pos + window_bytes >= chunk->end) ||
+            (pos + window_bytes >= patch->file_bytes))
+        {
+            return 0;
+        }
+        pos += window_bytes - 3;
     }
+}
+
+/* input bytes at in_offset to out_offset, in the kernel when the
+   filesystems allow it else through the window */
+static int
+patch_copy(struct patch_worker_t* worker, long long in_offset,
+           long long out_offset, long long bytes)
+{
+    long long step;
+    loff_t in_pos;
+    loff_t out_pos;
 
-    in_uint(bits, 1); // pic_struct_present_flag
+    in_pos = in_offset;
+    out_pos = out_offset;
+    while (!worker->no_copy_range && (bytes > 0))
+    {
+        step = copy_file_range(worker->patch->in_fd, &in_pos,
+                               worker->patch->out_fd, &out_pos, bytes, 0);
+        if (step > 0)
+        {
+            bytes -= step;
+        }
+        else if ((step < 0) && ((errno == EXDEV) || (errno == ENOSYS) ||
+                                (errno == EINVAL) || (errno == EOPNOTSUPP)))
+        {
+            worker->no_copy_range = 1;
+        }
+        else if ((step < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        else
+        {
+            return 1;
+        }
+    }
+    in_offset = in_pos;
+    out_offset = out_pos;
+    while (bytes > 0)
+    {
+        step = bytes < PATCH_WINDOW_BYTES ? bytes : PATCH_WINDOW_BYTES;
+        if ((pread_full(worker->patch->in_fd, worker->window, step,
+                        in_offset) != 0) ||
+            (pwrite_full(worker->patch->out_fd, worker->window, step,
+                         out_offset) != 0))
+        {
+            return 1;
+        }
+        in_offset += step;
+        out_offset += step;
+        bytes -= step;
+    }
+    return 0;
+}
 
-    out_uint(bits, 1, 1); // bitstream_restriction_flag
-    out_uint(bits, 1, 1); // motion_vectors_over_pic_boundaries_flag
-    out_ueint(bits, 0); // max_bytes_per_pic_denom
-    out_ueint(bits, 0); // max_bits_per_mb_denom
-    out_ueint(bits, 11); // log2_max_mv_length_horizontal
-    out_ueint(bits, 11); // log2_max_mv_length_vertical
-    out_ueint(bits, 0); // num_reorder_frames
-    out_ueint(bits, 1); // max_dec_frame_buffering
+/* an sps over the one it replaces and zeros after it */
+static int
+patch_write_in_place(struct patch_worker_t* worker,
+                     const struct patch_edit_t* edit)
+{
+    long long offset;
+    long long zeros;
+    long long step;
+    struct iovec iov[2];
 
-#if 0
-    val = in_uint(bits, 1); // bitstream_restriction_flag
-    printf("bitstream_restriction_flag %d left %d\n", val, bits->bits_left);
-    if (val)
+    zeros = edit->bytes - edit->data_bytes;
+    step = zeros < PATCH_WINDOW_BYTES ? zeros : PATCH_WINDOW_BYTES;
+    memset(worker->window, 0, step);
+    iov[0].iov_base = edit->data;
+    iov[0].iov_len = edit->data_bytes;
+    iov[1].iov_base = worker->window;
+    iov[1].iov_len = step;
+    if (pwritev(worker->patch->out_fd, iov, 2, edit->offset) !=
+        edit->data_bytes + step)
     {
-        in_uint(bits, 1); // motion_vectors_over_pic_boundaries_flag
-        in_ueint(bits); // max_bytes_per_pic_denom
-        in_ueint(bits); // max_bits_per_mb_denom
-        in_ueint(bits); // log2_max_mv_length_horizontal
-        in_ueint(bits); // log2_max_mv_length_vertical
-        in_ueint(bits); // num_reorder_frames
-        in_ueint(bits); // max_dec_frame_buffering
+        return 1;
+    }
+    offset = edit->offset + edit->data_bytes + step;
+    zeros -= step;
+    while (zeros > 0)
+    {
+        step = zeros < PATCH_WINDOW_BYTES ? zeros : PATCH_WINDOW_BYTES;
+        if (pwrite_full(worker->patch->out_fd, worker->window, step,
+                        offset) != 0)
+        {
+            return 1;
+        }
+        offset += step;
+        zeros -= step;
     }
-#endif
     return 0;
 }
 
 static int
-sps_set_it(const char* data, int data_bytes, char* new_sps)
+patch_write_chunk(struct patch_worker_t* worker, struct patch_chunk_t* chunk)
 {
-    char rbsp[64];
-    int ldata_bytes;
-    int rbsp_bytes;
-    int nal_bytes;
     int index;
-    int val;
-    struct bits_t lbits;
-    struct bits_t* bits;
+    long long in_offset;
+    long long out_offset;
+    struct patch_edit_t* edit;
 
-    //hexdump(data, data_bytes);
-    ldata_bytes = data_bytes;
-    rbsp_bytes = 64;
-    nal_to_rbsp(data, &ldata_bytes, rbsp, &rbsp_bytes);
-    //hexdump(rbsp, rbsp_bytes);
+    if (worker->patch->in_place)
+    {
+        for (index = 0; index < chunk->num_edits; index++)
+        {
+            if (patch_write_in_place(worker, chunk->edits + index) != 0)
+            {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    in_offset = chunk->span_start;
+    out_offset = chunk->out_offset;
+    for (index = 0; index < chunk->num_edits; index++)
+    {
+        edit = chunk->edits + index;
+        if ((patch_copy(worker, in_offset, out_offset,
+                        edit->offset - in_offset) != 0) ||
+            (pwrite_full(worker->patch->out_fd, edit->data, edit->data_bytes,
+                         out_offset + edit->offset - in_offset) != 0))
+        {
+            return 1;
+        }
+        out_offset += edit->offset - in_offset + edit->data_bytes;
+        in_offset = edit->offset + edit->bytes;
+    }
+    return patch_copy(worker, in_offset, out_offset,
+                      chunk->span_end - in_offset);
+}
 
-    bits = &lbits;
-    bits_init(bits, rbsp, 64);
+static void*
+patch_thread(void* arg)
+{
+    int index;
+    struct patch_worker_t* worker;
+    struct patch_t* patch;
+    struct patch_chunk_t* chunk;
 
-    in_uint(bits, 1); // forbidden_zero_bit
-    in_uint(bits, 2); // nal_ref_idc
-    in_uint(bits, 5); // nal_unit_type
-    in_uint(bits, 8); // profile_idc
-    in_uint(bits, 1); // constraint_set0_flag
-    in_uint(bits, 1); // constraint_set1_flag
-    in_uint(bits, 1); // constraint_set2_flag
-    in_uint(bits, 1); // constraint_set3_flag
-    in_uint(bits, 4); // reserved_zero_4bits
-    in_uint(bits, 8); // level_idc
-    in_ueint(bits); // seq_parameter_set_id
-    /* some alpha fields can be here */
-    in_ueint(bits); // log2_max_frame_num_minus4
-    val = in_ueint(bits); // pic_order_cnt_type
-    if (val == 0)
+    worker = (struct patch_worker_t*)arg;
+    patch = worker->patch;
+    for (;;)
     {
-        in_ueint(bits); // log2_max_pic_order_cnt_lsb_minus4
+        pthread_mutex_lock(&(patch->mutex));
+        index = patch->next_chunk++;
+        pthread_mutex_unlock(&(patch->mutex));
+        if (index >= patch->num_chunks)
+        {
+            break;
+        }
+        chunk = patch->chunks + index;
+        if (patch->write)
+        {
+            chunk->error = patch_write_chunk(worker, chunk);
+        }
+        else
+        {
+            chunk->error = patch_scan_chunk(worker, chunk);
+        }
     }
-    else if (val == 1)
+    return NULL;
+}
+
+/* run one phase on every chunk, workers were set up by patch_parallel
+   the threads take chunks until none are left so the phase finishes as
+   long as one of them started, returns 1 when none did */
+static int
+patch_run(struct patch_t* patch, struct patch_worker_t* workers,
+          int num_threads)
+{
+    int index;
+    int error;
+    int started;
+    pthread_t threads[MAX_THREADS];
+
+    patch->next_chunk = 0;
+    for (started = 0; started < num_threads; started++)
     {
-        in_uint(bits, 1); // delta_pic_order_always_zero_flag
-        in_seint(bits); // offset_for_non_ref_pic
-        in_seint(bits); // offset_for_top_to_bottom_field
-        val = in_ueint(bits); // num_ref_frames_in_pic_order_cnt_cycle
-        for (index = 0; index < val; index++)
+        if (pthread_create(threads + started, NULL, patch_thread,
+                           workers + started) != 0)
         {
-            in_ueint(bits);
+            break;
         }
     }
-    in_ueint(bits); // num_ref_frames
-    in_uint(bits, 1); // gaps_in_frame_num_value_allowed_flag
-    in_ueint(bits); // pic_width_in_mbs_minus_1
-    in_ueint(bits); // pic_height_in_map_units_minus_1
-    val = in_uint(bits, 1); // frame_mbs_only_flag
-    if (!val)
+    for (index = 0; index < started; index++)
     {
-        in_uint(bits, 1); // mb_adaptive_frame_field_flag
+        pthread_join(threads[index], NULL);
     }
-    in_uint(bits, 1); // direct_8x8_inference_flag
-    val = in_uint(bits, 1); // frame_cropping_flag
-    if (val)
+    if (started < 1)
     {
-        in_ueint(bits); // frame_crop_left_offset
-        in_ueint(bits); // frame_crop_right_offset
-        in_ueint(bits); // frame_crop_top_offset
-        in_ueint(bits); // frame_crop_bottom_offset
+        return 1;
     }
-    val = in_uint(bits, 1); // vui_prameters_present_flag
-    printf("vui_prameters_present_flag %d\n", val);
-    if (val)
+    error = 0;
+    for (index = 0; index < patch->num_chunks; index++)
     {
-        sps_set_it_vui(bits);
+        error |= patch->chunks[index].error;
     }
+    return error;
+}
 
-    out_uint(bits, 1, 1); // stop bit
-    while (bits->bits_left > 0)
+/* returns the output bytes or -1 on error */
+static long long
+patch_file(struct patch_t* patch, int num_threads)
+{
+    int index;
+    int jndex;
+    int error;
+    long long offset;
+    long long delta;
+    struct patch_chunk_t* chunk;
+    struct patch_edit_t* edit;
+    struct patch_worker_t workers[MAX_THREADS];
+
+    patch->num_chunks = (patch->file_bytes + PATCH_CHUNK_BYTES - 1) /
+                        PATCH_CHUNK_BYTES;
+    if (patch->num_chunks < 1)
+    {
+        patch->num_chunks = 1;
+    }
+    patch->chunks = (struct patch_chunk_t*)
+        calloc(patch->num_chunks, sizeof(struct patch_chunk_t));
+    if (patch->chunks == NULL)
+    {
+        return -1;
+    }
+    for (index = 0; index < patch->num_chunks; index++)
+    {
+        chunk = patch->chunks + index;
+        chunk->start = (long long)index * PATCH_CHUNK_BYTES;
+        chunk->end = chunk->start + PATCH_CHUNK_BYTES;
+        if (chunk->end > patch->file_bytes)
+        {
+            chunk->end = patch->file_bytes;
+        }
+    }
+    error = 0;
+    memset(workers, 0, sizeof(workers));
+    for (index = 0; index < num_threads; index++)
     {
-        out_uint(bits, 0, 1); // align bits
+        workers[index].patch = patch;
+        error |= sps_rewrite_init(&(workers[index].rewrite), patch->rules);
+        workers[index].window = (char*)malloc(PATCH_WINDOW_BYTES);
+        error |= workers[index].window == NULL;
     }
 
-    rbsp_bytes = bits->offset;
-    printf("rbsp_bytes %d\n", rbsp_bytes);
+    if (!error)
+    {
+        error = patch_run(patch, workers, num_threads);
+    }
+    for (index = 0; patch->in_place && (index < patch->num_chunks); index++)
+    {
+        chunk = patch->chunks + index;
+        for (jndex = 0; jndex < chunk->num_edits; jndex++)
+        {
+            edit = chunk->edits + jndex;
+            patch->grown += edit->data_bytes > edit->bytes;
+        }
+        chunk->delta = 0;
+    }
+    error |= patch->grown > 0;
+    /* the prefix sum, an sps can run past the end of its chunk */
+    offset = 0;
+    delta = 0;
+    for (index = 0; index < patch->num_chunks; index++)
+    {
+        chunk = patch->chunks + index;
+        chunk->span_start = chunk->start > offset ? chunk->start : offset;
+        chunk->span_end = chunk->end > chunk->span_start ? chunk->end :
+                                                           chunk->span_start;
+        if (chunk->num_edits > 0)
+        {
+            edit = chunk->edits + chunk->num_edits - 1;
+            if (edit->offset + edit->bytes > chunk->span_end)
+            {
+                chunk->span_end = edit->offset + edit->bytes;
+            }
+        }
+        chunk->out_offset = chunk->span_start + delta;
+        delta += chunk->delta;
+        offset = chunk->span_end;
+    }
+    if (!error)
+    {
+        patch->write = 1;
+        error = patch_run(patch, workers, num_threads);
+    }
 
-    //memcpy(new_sps, data, data_bytes);
-    //rbsp_bytes = data_bytes;
+    for (index = 0; index < num_threads; index++)
+    {
+        patch->hits += workers[index].rewrite.hits;
+        patch->misses += workers[index].rewrite.misses;
+        patch->rejected += workers[index].rewrite.rejected;
+        sps_rewrite_deinit(&(workers[index].rewrite));
+        free(workers[index].window);
+        free(workers[index].nal);
+    }
+    for (index = 0; index < patch->num_chunks; index++)
+    {
+        chunk = patch->chunks + index;
+        while (chunk->num_edits > 0)
+        {
+            free(chunk->edits[--(chunk->num_edits)].data);
+        }
+        free(chunk->edits);
+    }
+    free(patch->chunks);
+    return error ? -1 : patch->file_bytes + delta;
+}
 
-    nal_bytes = 64;
-    rbsp_to_nal(rbsp, rbsp_bytes, new_sps, &nal_bytes);
+/* raw Annex B input when fd is a file, BEEF frames and pipes go
+   through the stream */
+static int
+patch_can_chunk(int fd, long long* file_bytes)
+{
+    char magic[4];
+    struct stat st;
 
-    //hexdump(new_sps, nal_bytes);
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        return 0;
+    }
+    *file_bytes = st.st_size;
+    return (pread_full(fd, magic, 4, 0) != 0) ||
+           ((memcmp(magic, "BEEF", 4) != 0) &&
+            (memcmp(magic, "BEF2", 4) != 0));
+}
 
-    return nal_bytes;
+static int
+patch_main_file(int in_fd, int out_fd, long long file_bytes,
+                const char* rules, int num_threads)
+{
+    long long total_out_bytes;
+    struct patch_t patch;
+
+    memset(&patch, 0, sizeof(patch));
+    pthread_mutex_init(&(patch.mutex), NULL);
+    patch.in_fd = in_fd;
+    patch.out_fd = out_fd;
+    patch.in_place = in_fd == out_fd;
+    patch.file_bytes = file_bytes;
+    patch.rules = rules;
+    total_out_bytes = patch_file(&patch, num_threads);
+    pthread_mutex_destroy(&(patch.mutex));
+    printf("data_bytes in %lld\n", patch.file_bytes);
+    printf("sps rewritten %lld cached %lld rejected %lld\n", patch.misses,
+           patch.hits, patch.rejected);
+    if (patch.grown > 0)
+    {
+        printf("%d sps longer than before, not patched in place\n",
+               patch.grown);
+        return 1;
+    }
+    if ((total_out_bytes < 0) ||
+        (!patch.in_place && (ftruncate(out_fd, total_out_bytes) != 0)))
+    {
+        printf("error\n");
+        return 1;
+    }
+    printf("total_out_bytes %lld\n", total_out_bytes);
+    return 0;
 }
 
 int
@@ -207,87 +766,212 @@ main(int argc, char** argv)
 {
     int fd;
     int out_fd;
-    int data_bytes;
-    int nal_bytes;
-    int start_code_bytes;
-    int total_out_bytes;
+    int rv;
+    int error;
+    int opt;
     int new_sps_bytes;
-    char* alloc_data;
-    char* data;
-    char* end_data;
-    char new_sps[64];
-#if 0
-    struct bits_t lbits;
-    bits_init(&lbits, new_sps, 5);
-    memset(new_sps, 0, sizeof(new_sps));
-    hexdump(new_sps, 64);
-    in_uint(&lbits, 1);
-    out_uint(&lbits, 0x11223344, 32);
-    printf("error %d\n", lbits.error);
-    hexdump(new_sps, 64);
-    bits_init(&lbits, new_sps, 5);
-    in_uint(&lbits, 1);
-    printf("0x%8.8x\n", in_uint(&lbits, 32));
-    printf("error %d\n", lbits.error);
-    return 0;
-#endif
-    if (argc < 3)
+    int num_threads;
+    int in_place;
+    int to_v2;
+    long long total_out_bytes;
+    long long offset;
+    long long file_bytes;
+    const char* new_sps;
+    const char* rules;
+    struct out_batch_t batch;
+    struct wbits_t* frame;
+    struct wbits_t frame_data;
+    struct nal_stream_t stream;
+    struct nal_unit_t nal;
+    struct beef_writer_t writer;
+    struct sps_rewrite_t rewrite;
+
+    rules = g_default_rules;
+    num_threads = 1;
+    in_place = 0;
+    to_v2 = 0;
+    while ((opt = getopt(argc, argv, "2ij:r:")) != -1)
     {
-        printf("error\n");
+        switch (opt)
+        {
+            case '2': /* BEEF output is v2 with a footer index, -r "" only
+                         converts */
+                to_v2 = 1;
+                break;
+            case 'i': /* patch the input, no output file */
+                in_place = 1;
+                break;
+            case 'j': /* threads */
+                num_threads = atoi(optarg);
+                if (num_threads < 1)
+                {
+                    num_threads = 1;
+                }
+                if (num_threads > MAX_THREADS)
+                {
+                    num_threads = MAX_THREADS;
+                }
+                break;
+            case 'r': /* sps rewrite rules */
+                rules = optarg;
+                break;
+            default:
+                printf("%s", g_usage);
+                return 1;
+        }
+    }
+    if (argc - optind < 2 - in_place)
+    {
+        printf("%s", g_usage);
         return 1;
     }
-    fd = open(argv[1], O_RDONLY);
-    if (fd == -1)
+    /* the rules are checked before any file is opened */
+    if (sps_rewrite_init(&rewrite, rules) != 0)
+    {
+        printf("bad rule at %s\n", rules + rewrite.error_pos);
+        sps_rewrite_deinit(&rewrite);
+        return 1;
+    }
+    sps_rewrite_deinit(&rewrite);
+    fd = 0;
+    if (strcmp(argv[optind], "-") != 0)
+    {
+        fd = open(argv[optind], in_place ? O_RDWR : O_RDONLY);
+        if (fd == -1)
+        {
+            printf("error\n");
+            return 1;
+        }
+    }
+    file_bytes = 0;
+    if (to_v2 && (in_place || patch_can_chunk(fd, &file_bytes)))
+    {
+        printf("-2 needs a BEEF input and an output file\n");
+        close(fd);
+        return 1;
+    }
+    if (!patch_can_chunk(fd, &file_bytes) && in_place)
+    {
+        printf("in place needs a raw Annex B file\n");
+        close(fd);
+        return 1;
+    }
+    if (in_place)
+    {
+        rv = patch_main_file(fd, fd, file_bytes, rules, num_threads);
+        close(fd);
+        return rv;
+    }
+    out_fd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC,
+                  S_IRUSR | S_IWUSR);
+    if (out_fd == -1)
     {
         printf("error\n");
+        close(fd);
         return 1;
     }
-    out_fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-    if (fd == -1)
+    if (patch_can_chunk(fd, &file_bytes))
+    {
+        rv = patch_main_file(fd, out_fd, file_bytes, rules, num_threads);
+        close(fd);
+        close(out_fd);
+        return rv;
+    }
+    sps_rewrite_init(&rewrite, rules);
+    batch.fd = out_fd;
+    batch.buf = (char*)malloc(OUT_BATCH_BYTES);
+    batch.bytes = 0;
+    if ((nal_stream_init(&stream, fd) != 0) || (batch.buf == NULL))
     {
         printf("error\n");
+        nal_stream_deinit(&stream);
+        sps_rewrite_deinit(&rewrite);
+        free(batch.buf);
+        close(fd);
+        close(out_fd);
         return 1;
     }
+    if (to_v2 && (stream.format != NAL_STREAM_BEEF))
+    {
+        printf("-2 needs a BEEF input and an output file\n");
+        nal_stream_deinit(&stream);
+        sps_rewrite_deinit(&rewrite);
+        free(batch.buf);
+        close(fd);
+        close(out_fd);
+        return 1;
+    }
+    frame = NULL;
+    if (stream.format == NAL_STREAM_BEEF)
+    {
+        frame = &frame_data;
+        wbits_init(frame, 1024 * 1024);
+        beef_writer_init(&writer, out_fd);
+    }
+    /* everything between nals, start codes and trailing zeros, is copied
+       as is so only the sps bytes change */
+    error = 0;
     total_out_bytes = 0;
-    data_bytes = 1024 * 1024;
-    alloc_data = (char*)malloc(data_bytes);
-    data = alloc_data;
-    data_bytes = read(fd, data, data_bytes);
-    close(fd);
-    printf("data_bytes in %d\n", data_bytes);
-    end_data = data + data_bytes;
-    //hexdump(data, 32);
-    start_code_bytes = parse_start_code(data, end_data);
-    write(out_fd, data, start_code_bytes);
-    total_out_bytes += start_code_bytes;
-    data += start_code_bytes;
-    while ((nal_bytes = get_nal_bytes(data, end_data)) > 0)
-    {
-        //printf("nal_bytes %d\n", nal_bytes);
-        if ((data[0] & 0x1F) == 7)
-        {
-            new_sps_bytes = sps_set_it(data, nal_bytes, new_sps);
-            write(out_fd, new_sps, new_sps_bytes);
-            total_out_bytes += new_sps_bytes;
+    while (!error &&
+           ((rv = nal_stream_next(&stream, &nal)) != NAL_STREAM_END))
+    {
+        if (rv == NAL_STREAM_ERROR)
+        {
+            error = 1;
+            break;
         }
-        else
+        if (rv == NAL_STREAM_FRAME)
         {
-            write(out_fd, data, nal_bytes);
-            total_out_bytes += nal_bytes;
+            continue;
         }
-        printf("nal_bytes %d nal type %x\n", nal_bytes, data[0] & 0x1F);
-        data += nal_bytes;
-        start_code_bytes = parse_start_code(data, end_data);
-        if (start_code_bytes < 1)
+        error |= out_bytes(&batch, frame, nal.lead, nal.lead_bytes);
+        total_out_bytes += nal.lead_bytes;
+        if (rv == NAL_STREAM_SEGMENT_END)
         {
-            break;
+            if (frame != NULL)
+            {
+                rv = out_frame(out_fd, &stream, frame, &writer, to_v2);
+                error |= rv < 0;
+                total_out_bytes += rv;
+            }
+            continue;
+        }
+        new_sps_bytes = -1;
+        if ((nal.nal_unit_type == 7) &&
+            (sps_rewrite_nal(&rewrite, nal.data, nal.bytes, &new_sps,
+                             &new_sps_bytes) == 0))
+        {
+            error |= out_bytes(&batch, frame, new_sps, new_sps_bytes);
+            total_out_bytes += new_sps_bytes;
+        }
+        if (new_sps_bytes < 1)
+        {
+            error |= out_bytes(&batch, frame, nal.data, nal.bytes);
+            total_out_bytes += nal.bytes;
         }
-        write(out_fd, data, start_code_bytes);
-        total_out_bytes += start_code_bytes;
-        data += start_code_bytes;
+        printf("nal_bytes %d nal type %x\n", nal.bytes, nal.nal_unit_type);
     }
-    free(alloc_data);
+    printf("data_bytes in %lld\n", stream.data_offset + stream.end);
+    error |= out_batch_flush(&batch, NULL, 0);
+    free(batch.buf);
+    if (frame != NULL)
+    {
+        offset = writer.offset;
+        error |= beef_writer_finish(&writer);
+        total_out_bytes += writer.offset - offset;
+        wbits_deinit(frame);
+    }
+    printf("sps rewritten %lld cached %lld rejected %lld\n", rewrite.misses,
+           rewrite.hits, rewrite.rejected);
+    sps_rewrite_deinit(&rewrite);
+    nal_stream_deinit(&stream);
+    close(fd);
     close(out_fd);
-    printf("total_out_bytes %d\n", total_out_bytes);
+    if (error)
+    {
+        printf("error\n");
+        return 1;
+    }
+    printf("total_out_bytes %lld\n", total_out_bytes);
     return 0;
 }
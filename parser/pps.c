@@ -3,31 +3,202 @@
 #include <string.h>
 
 #include "bits.h"
+#include "sps.h"
 #include "pps.h"
 
+/* Ceil(Log2(val)) */
+static int
+ceil_log2(int val)
+{
+    int rv;
+
+    rv = 0;
+    while ((1 << rv) < val)
+    {
+        rv++;
+    }
+    return rv;
+}
+
+/* slice group map fields, only their place is kept for slice_group_ids */
+static int
+parse_pps_slice_groups(struct bits_t* bits, struct pps_t* pps)
+{
+    int index;
+    long long id_bits;
+
+    pps->slice_group_map_type = in_ueint(bits);
+    switch (pps->slice_group_map_type)
+    {
+        case 0:
+            for (index = 0; index <= pps->num_slice_groups_minus1; index++)
+            {
+                pps->run_length_minus1[index] = in_ueint(bits);
+            }
+            break;
+        case 2:
+            for (index = 0; index < pps->num_slice_groups_minus1; index++)
+            {
+                pps->top_left[index] = in_ueint(bits);
+                pps->bottom_right[index] = in_ueint(bits);
+            }
+            break;
+        case 3:
+        case 4:
+        case 5:
+            pps->slice_group_change_direction_flag = in_uint(bits, 1);
+            pps->slice_group_change_rate_minus1 = in_ueint(bits);
+            break;
+        case 6:
+            pps->pic_size_in_map_units_minus1 = in_ueint(bits);
+            pps->slice_group_id_bits =
+                ceil_log2(pps->num_slice_groups_minus1 + 1);
+            pps->slice_group_id_bit_offset = bits_tell(bits);
+            id_bits = (long long)(pps->pic_size_in_map_units_minus1 + 1) *
+                      pps->slice_group_id_bits;
+            if ((pps->pic_size_in_map_units_minus1 < 0) ||
+                (pps->slice_group_id_bit_offset + id_bits >
+                 bits->data_bytes * 8))
+            {
+                return 1;
+            }
+            bits_skip(bits, id_bits);
+            break;
+        case 1:
+            break;
+        default:
+            return 1;
+    }
+    return 0;
+}
+
+/* bits is set up with bits_init_nal on a whole pps nal
+   sps_by_id is the sets seen so far, MAX_SPS entries, or NULL, it is only
+   used to count the scaling lists when transform_8x8_mode_flag is set, 4:2:0
+   is assumed without the sps
+   returns 0 or 1 on a bad value */
 int
-parse_pps(struct bits_t *bits, struct pps_t *pps)
+parse_pps(struct bits_t* bits, struct sps_t* const* sps_by_id,
+          struct pps_t* pps)
 {
+    int index;
+    int count;
+    int chroma_format_idc;
+
+    pps->forbidden_zero_bit = in_uint(bits, 1);
+    pps->nal_ref_idc = in_uint(bits, 2);
+    pps->nal_unit_type = in_uint(bits, 5);
     pps->pic_parameter_set_id = in_ueint(bits);
     pps->seq_parameter_set_id = in_ueint(bits);
+    if ((pps->pic_parameter_set_id < 0) || (pps->pic_parameter_set_id > 255) ||
+        (pps->seq_parameter_set_id < 0) || (pps->seq_parameter_set_id > 31))
+    {
+        return 1;
+    }
     pps->entropy_coding_mode_flag = in_uint(bits, 1);
     pps->pic_order_present_flag = in_uint(bits, 1);
     pps->num_slice_groups_minus1 = in_ueint(bits);
-    if (pps->num_slice_groups_minus1 > 0)
+    if ((pps->num_slice_groups_minus1 < 0) ||
+        (pps->num_slice_groups_minus1 >= MAX_SLICE_GROUPS))
+    {
+        return 1;
+    }
+    if ((pps->num_slice_groups_minus1 > 0) &&
+        (parse_pps_slice_groups(bits, pps) != 0))
     {
-        printf("Error unsupported\n");
         return 1;
     }
     pps->num_ref_idx_l0_active_minus1 = in_ueint(bits);
     pps->num_ref_idx_l1_active_minus1 = in_ueint(bits);
     pps->weighted_pred_flag = in_uint(bits, 1);
-    pps->weighted_bipred_idc = (in_uint(bits, 1) << 1) + in_uint(bits, 1);
+    pps->weighted_bipred_idc = in_uint(bits, 2);
     pps->pic_init_qp_minus26 = in_seint(bits);
     pps->pic_init_qs_minus26 = in_seint(bits);
     pps->chroma_qp_index_offset = in_seint(bits);
     pps->deblocking_filter_control_present_flag = in_uint(bits, 1);
     pps->constrained_intra_pred_flag = in_uint(bits, 1);
     pps->redundant_pic_cnt_present_flag = in_uint(bits, 1);
+    pps->second_chroma_qp_index_offset = pps->chroma_qp_index_offset;
+    if (!bits_more_rbsp_data(bits))
+    {
+        return 0;
+    }
 
+    pps->transform_8x8_mode_flag = in_uint(bits, 1);
+    pps->pic_scaling_matrix_present_flag = in_uint(bits, 1);
+    if (pps->pic_scaling_matrix_present_flag)
+    {
+        chroma_format_idc = 1;
+        if ((sps_by_id != NULL) &&
+            (sps_by_id[pps->seq_parameter_set_id] != NULL))
+        {
+            chroma_format_idc =
+                sps_by_id[pps->seq_parameter_set_id]->chroma_format_idc;
+        }
+        count = 6 + (chroma_format_idc != 3 ? 2 : 6) *
+                    pps->transform_8x8_mode_flag;
+        pps->scaling_matrix_bit_offset = bits_tell(bits);
+        for (index = 0; index < count; index++)
+        {
+            if (in_uint(bits, 1))
+            {
+                pps->pic_scaling_list_present_flag |= 1 << index;
+                if (parse_scaling_list(bits, NULL, index < 6 ? 16 : 64))
+                {
+                    pps->use_default_scaling_matrix_flag |= 1 << index;
+                }
+            }
+        }
+    }
+    pps->second_chroma_qp_index_offset = in_seint(bits);
     return 0;
 }
+
+/* the slice_group_id of the first count map units of a type 6 pps, bits is
+   set up again on the same nal and not read yet
+   returns 0 or 1 when there are fewer ids or the pps is not type 6 */
+int
+pps_slice_group_ids(struct bits_t* bits, const struct pps_t* pps,
+                    unsigned char* ids, int count)
+{
+    int index;
+
+    if ((pps->num_slice_groups_minus1 < 1) ||
+        (pps->slice_group_map_type != 6) ||
+        (count > pps->pic_size_in_map_units_minus1 + 1))
+    {
+        return 1;
+    }
+    bits_skip(bits, pps->slice_group_id_bit_offset);
+    for (index = 0; index < count; index++)
+    {
+        ids[index] = in_uint(bits, pps->slice_group_id_bits);
+    }
+    return bits->error;
+}
+
+/* decode the lists parse_pps walked, bits is set up again on the same nal
+   and not read yet, sps is the set pps refers to and seq_matrix its lists
+   from parse_sps_scaling_matrix
+   returns 0 or 1 when the lists do not read back */
+int
+parse_pps_scaling_matrix(struct bits_t* bits, const struct pps_t* pps,
+                         const struct sps_t* sps,
+                         const struct scaling_matrix_t* seq_matrix,
+                         struct scaling_matrix_t* matrix)
+{
+    int count;
+
+    if (!pps->pic_scaling_matrix_present_flag)
+    {
+        *matrix = *seq_matrix;
+        return 0;
+    }
+    bits_skip(bits, pps->scaling_matrix_bit_offset);
+    count = 6 + (sps->chroma_format_idc != 3 ? 2 : 6) *
+                pps->transform_8x8_mode_flag;
+    /* fall-back rule B when the sps has lists, else A */
+    return parse_scaling_matrix(bits, count,
+                                sps->seq_scaling_matrix_present_flag ?
+                                seq_matrix : NULL, matrix);
+}
@@ -1,26 +1,65 @@
 #ifndef _PPS_H_
 #define _PPS_H_
 
+#define MAX_SLICE_GROUPS    8
+
 struct pps_t
 {
+    int forbidden_zero_bit;                      /* u(1) */
+    int nal_ref_idc;                             /* u(2) */
+    int nal_unit_type;                           /* u(5) */
     int pic_parameter_set_id;                    /* ue(v) */
     int seq_parameter_set_id;                    /* ue(v) */
     int entropy_coding_mode_flag;                /* u(1) */
     int pic_order_present_flag;                  /* u(1) */
     int num_slice_groups_minus1;                 /* ue(v) */
+    int slice_group_map_type;                    /* ue(v) */
+    int run_length_minus1[MAX_SLICE_GROUPS];     /* ue(v), type 0 */
+    int top_left[MAX_SLICE_GROUPS];              /* ue(v), type 2 */
+    int bottom_right[MAX_SLICE_GROUPS];          /* ue(v), type 2 */
+    int slice_group_change_direction_flag;       /* u(1), types 3 to 5 */
+    int slice_group_change_rate_minus1;          /* ue(v), types 3 to 5 */
+    int pic_size_in_map_units_minus1;            /* ue(v), type 6 */
+    int slice_group_id_bit_offset;               /* type 6, rbsp bit of the
+                                                    first slice_group_id */
+    int slice_group_id_bits;                     /* type 6, u(v) size of
+                                                    each slice_group_id */
     int num_ref_idx_l0_active_minus1;            /* ue(v) */
     int num_ref_idx_l1_active_minus1;            /* ue(v) */
     int weighted_pred_flag;                      /* u(1) */
-    int weighted_bipred_idc;                     /* u(1) */
+    int weighted_bipred_idc;                     /* u(2) */
     int pic_init_qp_minus26;                     /* se(v) */
     int pic_init_qs_minus26;                     /* se(v) */
     int chroma_qp_index_offset;                  /* se(v) */
     int deblocking_filter_control_present_flag;  /* u(1) */
     int constrained_intra_pred_flag;             /* u(1) */
     int redundant_pic_cnt_present_flag;          /* u(1) */
+    int transform_8x8_mode_flag;                 /* u(1) */
+    int pic_scaling_matrix_present_flag;         /* u(1) */
+    int pic_scaling_list_present_flag;           /* u(1) each, bit i is
+                                                    list i */
+    int use_default_scaling_matrix_flag;         /* bit i is list i */
+    int scaling_matrix_bit_offset;               /* rbsp bit of the first
+                                                    pic_scaling_list_present
+                                                    _flag */
+    int second_chroma_qp_index_offset;           /* se(v), else
+                                                    chroma_qp_index_offset */
 };
 
+struct bits_t;
+struct sps_t;
+struct scaling_matrix_t;
+
+int
+parse_pps(struct bits_t* bits, struct sps_t* const* sps_by_id,
+          struct pps_t* pps);
+int
+pps_slice_group_ids(struct bits_t* bits, const struct pps_t* pps,
+                    unsigned char* ids, int count);
 int
-parse_pps(struct bits_t *bits, struct pps_t *pps);
+parse_pps_scaling_matrix(struct bits_t* bits, const struct pps_t* pps,
+                         const struct sps_t* sps,
+                         const struct scaling_matrix_t* seq_matrix,
+                         struct scaling_matrix_t* matrix);
 
 #endif
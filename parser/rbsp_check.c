@@ -0,0 +1,858 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "sps.h"
+#include "splice.h"
+#include "utils.h"
+#include "hexdump.h"
+
+#define CHECK_MAX_BYTES (64 * 1024)
+
+/* sps fields rbsp_splice edits, in the order they are sent */
+#define CHECK_FIELD_ID          0
+#define CHECK_FIELD_FRAME_NUM   1
+#define CHECK_FIELD_NON_REF     2
+#define CHECK_FIELD_REFS        3
+#define CHECK_FIELD_GAPS        4
+#define CHECK_FIELD_WIDTH       5
+#define CHECK_FIELD_HEIGHT      6
+#define CHECK_FIELDS            7
+
+struct check_t
+{
+    unsigned int seed;
+    int cases;
+    unsigned char nal[CHECK_MAX_BYTES];
+    unsigned char ref[CHECK_MAX_BYTES];
+    unsigned char out[CHECK_MAX_BYTES];
+};
+
+/* xorshift32, the same seed gives the same cases */
+static unsigned int
+check_rand(struct check_t* check)
+{
+    unsigned int x;
+
+    x = check->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    check->seed = x;
+    return x;
+}
+
+static void
+check_fail(const char* what, const unsigned char* nal, int nal_size,
+           int rbsp_size, int ref_rv, int rv)
+{
+    printf("rbsp check %s mismatch nal_size %d rbsp_size %d "
+           "nal_to_rbsp_c %d got %d\n", what, nal_size, rbsp_size,
+           ref_rv, rv);
+    fhexdump(stdout, nal, nal_size);
+}
+
+static void
+check_fail_escape(const char* what, const unsigned char* rbsp,
+                  int rbsp_size, int nal_size, int rv)
+{
+    printf("rbsp check rbsp_to_nal %s mismatch rbsp_size %d nal_size %d "
+           "got %d\n", what, rbsp_size, nal_size, rv);
+    fhexdump(stdout, rbsp, rbsp_size);
+}
+
+/* exactly bytes so even a one byte overrun shows up under a memory
+   checker, malloc may return NULL for 0 bytes and that is not an error */
+static unsigned char*
+check_alloc(int bytes, int* error)
+{
+    unsigned char* data;
+
+    data = (unsigned char*)malloc(bytes);
+    if ((data == NULL) && (bytes > 0))
+    {
+        *error = 1;
+    }
+    return data;
+}
+
+/* nal_to_rbsp, nal_to_rbsp_inplace and nal_escape_count against the
+   byte at a time nal_to_rbsp_c, on exact size copies of nal and out */
+static int
+check_one(struct check_t* check, const unsigned char* data, int nal_size,
+          int rbsp_size)
+{
+    int ref_rv;
+    int ref_nal_size;
+    int ref_rbsp_size;
+    int rv;
+    int lnal_size;
+    int lrbsp_size;
+    int error;
+    unsigned char* nal;
+    unsigned char* out;
+
+    check->cases++;
+    error = 0;
+    nal = check_alloc(nal_size, &error);
+    out = check_alloc(rbsp_size, &error);
+    if (error)
+    {
+        free(nal);
+        free(out);
+        printf("rbsp check out of memory\n");
+        return 1;
+    }
+    memcpy(nal, data, nal_size);
+
+    ref_nal_size = nal_size;
+    ref_rbsp_size = rbsp_size;
+    ref_rv = nal_to_rbsp_c((const char*)nal, &ref_nal_size,
+                           (char*)check->ref, &ref_rbsp_size);
+
+    lnal_size = nal_size;
+    lrbsp_size = rbsp_size;
+    rv = nal_to_rbsp((const char*)nal, &lnal_size, (char*)out, &lrbsp_size);
+    if ((rv != ref_rv) ||
+        ((ref_rv >= 0) &&
+         ((lnal_size != ref_nal_size) || (lrbsp_size != ref_rbsp_size) ||
+          (memcmp(out, check->ref, ref_rv) != 0))))
+    {
+        check_fail("nal_to_rbsp", nal, nal_size, rbsp_size, ref_rv, rv);
+        free(nal);
+        free(out);
+        return 1;
+    }
+
+    /* in place and the escape count always have room */
+    if (rbsp_size >= nal_size)
+    {
+        rv = nal_to_rbsp_inplace((char*)nal, nal_size);
+        if ((rv != ref_rv) ||
+            ((ref_rv >= 0) && (memcmp(nal, check->ref, ref_rv) != 0)))
+        {
+            check_fail("nal_to_rbsp_inplace", data, nal_size, rbsp_size,
+                       ref_rv, rv);
+            free(nal);
+            free(out);
+            return 1;
+        }
+        rv = nal_escape_count((const char*)data, nal_size);
+        if (rv != ((ref_rv < 0) ? -1 : nal_size - ref_rv))
+        {
+            check_fail("nal_escape_count", data, nal_size, rbsp_size,
+                       ref_rv, rv);
+            free(nal);
+            free(out);
+            return 1;
+        }
+    }
+    free(nal);
+    free(out);
+    return 0;
+}
+
+/* data as an rbsp, rbsp_to_nal with rbsp_to_nal_max room and then with
+   exactly the room it took must give a nal nal_to_rbsp_c turns back into
+   data, one byte less room must fail */
+static int
+check_round_trip(struct check_t* check, const unsigned char* data,
+                 int rbsp_size)
+{
+    int rv;
+    int exact_rv;
+    int max_size;
+    int nal_size;
+    int ref_nal_size;
+    int ref_rbsp_size;
+    int error;
+    unsigned char* nal;
+    unsigned char* exact;
+
+    check->cases++;
+    error = 0;
+    max_size = rbsp_to_nal_max(rbsp_size);
+    nal = check_alloc(max_size, &error);
+    if (error)
+    {
+        printf("rbsp check out of memory\n");
+        return 1;
+    }
+    nal_size = max_size;
+    rv = rbsp_to_nal((const char*)data, rbsp_size, (char*)nal, &nal_size);
+    ref_nal_size = nal_size;
+    ref_rbsp_size = rbsp_size;
+    if ((rv < 0) || (rv != nal_size) ||
+        (nal_to_rbsp_c((const char*)nal, &ref_nal_size, (char*)check->ref,
+                       &ref_rbsp_size) != rbsp_size) ||
+        (memcmp(check->ref, data, rbsp_size) != 0))
+    {
+        check_fail_escape("round trip", data, rbsp_size, max_size, rv);
+        free(nal);
+        return 1;
+    }
+
+    exact = check_alloc(rv, &error);
+    if (error)
+    {
+        free(nal);
+        printf("rbsp check out of memory\n");
+        return 1;
+    }
+    nal_size = rv;
+    exact_rv = rbsp_to_nal((const char*)data, rbsp_size, (char*)exact,
+                           &nal_size);
+    if ((exact_rv != rv) || (memcmp(exact, nal, rv) != 0))
+    {
+        check_fail_escape("exact room", data, rbsp_size, rv, exact_rv);
+        free(nal);
+        free(exact);
+        return 1;
+    }
+    nal_size = rv - 1;
+    exact_rv = -1;
+    if (rv > 0)
+    {
+        exact_rv = rbsp_to_nal((const char*)data, rbsp_size, (char*)exact,
+                               &nal_size);
+    }
+    if (exact_rv != -1)
+    {
+        check_fail_escape("short room", data, rbsp_size, rv - 1, exact_rv);
+        free(nal);
+        free(exact);
+        return 1;
+    }
+    free(nal);
+    free(exact);
+    return 0;
+}
+
+/* first 0x000001 at or after from, the index of its zero_byte when one
+   at or after from comes before it, data_bytes if there is none */
+static int
+check_find_start_code(const unsigned char* data, int data_bytes, int from,
+                      int* start_code_bytes)
+{
+    int index;
+
+    for (index = from; index + 2 < data_bytes; index++)
+    {
+        if ((data[index] == 0) && (data[index + 1] == 0) &&
+            (data[index + 2] == 1))
+        {
+            if ((index > from) && (data[index - 1] == 0))
+            {
+                *start_code_bytes = 4;
+                return index - 1;
+            }
+            *start_code_bytes = 3;
+            return index;
+        }
+    }
+    *start_code_bytes = 0;
+    return data_bytes;
+}
+
+/* scan_nals a byte at a time, nals has room for every nal */
+static int
+check_scan_nals(const unsigned char* data, int data_bytes,
+                struct nal_loc_t* nals)
+{
+    int count;
+    int nal;
+    int end;
+    int start_code;
+    int start_code_bytes;
+    int next_bytes;
+
+    count = 0;
+    start_code = check_find_start_code(data, data_bytes, 0,
+                                       &start_code_bytes);
+    while (start_code < data_bytes)
+    {
+        nal = start_code + start_code_bytes;
+        start_code = check_find_start_code(data, data_bytes, nal,
+                                           &next_bytes);
+        /* trailing_zero_8bits are not part of the nal */
+        end = start_code;
+        while ((end > nal) && (data[end - 1] == 0))
+        {
+            end--;
+        }
+        if (end > nal)
+        {
+            nals[count].offset = nal;
+            nals[count].bytes = end - nal;
+            nals[count].start_code_bytes = start_code_bytes;
+            count++;
+        }
+        start_code_bytes = next_bytes;
+    }
+    return count;
+}
+
+/* scan_nals against check_scan_nals, with room for all the nals and with
+   room for fewer, the count is the same either way */
+static int
+check_scan(struct check_t* check, const unsigned char* data, int data_bytes)
+{
+    int index;
+    int count;
+    int ref_count;
+    int max_nals;
+    int error;
+    unsigned char* copy;
+    struct nal_loc_t* ref;
+    struct nal_loc_t* nals;
+
+    check->cases++;
+    error = 0;
+    max_nals = data_bytes / 3 + 1;
+    copy = check_alloc(data_bytes, &error);
+    ref = (struct nal_loc_t*)malloc(max_nals * sizeof(struct nal_loc_t));
+    nals = (struct nal_loc_t*)malloc(max_nals * sizeof(struct nal_loc_t));
+    if (error || (ref == NULL) || (nals == NULL))
+    {
+        free(copy);
+        free(ref);
+        free(nals);
+        printf("rbsp check out of memory\n");
+        return 1;
+    }
+    memcpy(copy, data, data_bytes);
+    ref_count = check_scan_nals(copy, data_bytes, ref);
+    if (check_rand(check) & 1)
+    {
+        max_nals = check_rand(check) % (ref_count + 1);
+    }
+    count = scan_nals((const char*)copy, data_bytes, nals, max_nals);
+    error = count != ref_count;
+    for (index = 0; !error && (index < count) && (index < max_nals); index++)
+    {
+        error = (nals[index].offset != ref[index].offset) ||
+                (nals[index].bytes != ref[index].bytes) ||
+                (nals[index].start_code_bytes != ref[index].start_code_bytes);
+    }
+    if (error)
+    {
+        printf("rbsp check scan_nals mismatch data_bytes %d max_nals %d "
+               "nals %d got %d\n", data_bytes, max_nals, ref_count, count);
+        if (index > 0)
+        {
+            index--;
+            printf("nal %d offset %lld bytes %d start code %d, got offset "
+                   "%lld bytes %d start code %d\n", index, ref[index].offset,
+                   ref[index].bytes, ref[index].start_code_bytes,
+                   nals[index].offset, nals[index].bytes,
+                   nals[index].start_code_bytes);
+        }
+        fhexdump(stdout, data, data_bytes);
+    }
+    free(copy);
+    free(ref);
+    free(nals);
+    return error;
+}
+
+/* every check on one buffer, the nal side with full room, one byte short
+   and half room */
+static int
+check_sizes(struct check_t* check, const unsigned char* data, int nal_size)
+{
+    if ((check_round_trip(check, data, nal_size) != 0) ||
+        (check_scan(check, data, nal_size) != 0))
+    {
+        return 1;
+    }
+    if (check_one(check, data, nal_size, nal_size) != 0)
+    {
+        return 1;
+    }
+    if ((nal_size > 0) &&
+        (check_one(check, data, nal_size, nal_size - 1) != 0))
+    {
+        return 1;
+    }
+    if (check_one(check, data, nal_size, nal_size / 2) != 0)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+/* mostly 0 to 3 so zero pairs and escapes are common */
+static void
+check_fill(struct check_t* check, unsigned char* data, int bytes)
+{
+    int index;
+    unsigned int r;
+
+    for (index = 0; index < bytes; index++)
+    {
+        r = check_rand(check);
+        if ((r & 7) == 0)
+        {
+            data[index] = (r >> 8) & 0xFF;
+        }
+        else
+        {
+            data[index] = (r >> 8) & 3;
+        }
+    }
+}
+
+/* bytes with no zeros so only the planted pattern can match */
+static void
+check_fill_clean(struct check_t* check, unsigned char* data, int bytes)
+{
+    int index;
+
+    for (index = 0; index < bytes; index++)
+    {
+        data[index] = (check_rand(check) % 255) + 1;
+    }
+}
+
+static int
+check_random(struct check_t* check, int count)
+{
+    int index;
+    int bytes;
+    unsigned int r;
+
+    for (index = 0; index < count; index++)
+    {
+        r = check_rand(check);
+        if ((r & 63) == 0)
+        {
+            bytes = check_rand(check) % CHECK_MAX_BYTES;
+        }
+        else
+        {
+            bytes = check_rand(check) % 300;
+        }
+        check_fill(check, check->nal, bytes);
+        /* a final 00 00 gets an escape of its own in rbsp_to_nal */
+        if ((bytes >= 2) && ((r & 0x300) == 0))
+        {
+            check->nal[bytes - 1] = 0;
+            check->nal[bytes - 2] = 0;
+        }
+        if (check_sizes(check, check->nal, bytes) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+check_adversarial(struct check_t* check)
+{
+    int bytes;
+    int offset;
+    int value;
+    int next;
+    unsigned char* nal;
+
+    nal = check->nal;
+
+    /* all zeros, fails at the third byte */
+    for (bytes = 0; bytes <= 70; bytes++)
+    {
+        memset(nal, 0, bytes);
+        if (check_sizes(check, nal, bytes) != 0)
+        {
+            return 1;
+        }
+    }
+
+    /* back to back 00 00 03, each cut short at every length */
+    for (bytes = 0; bytes <= 100; bytes++)
+    {
+        for (offset = 0; offset < bytes; offset++)
+        {
+            nal[offset] = ((offset % 3) == 2) ? 3 : 0;
+        }
+        if (check_sizes(check, nal, bytes) != 0)
+        {
+            return 1;
+        }
+    }
+
+    /* 00 00 value next planted at every offset across the 16 and 32 byte
+       vector edges, next past the end leaves a cabac_zero_word tail */
+    for (offset = 0; offset <= 70; offset++)
+    {
+        for (value = 0; value <= 4; value++)
+        {
+            for (next = 0; next <= 5; next++)
+            {
+                bytes = 100;
+                check_fill_clean(check, nal, bytes);
+                nal[offset] = 0;
+                nal[offset + 1] = 0;
+                nal[offset + 2] = value;
+                nal[offset + 3] = next;
+                if (check_sizes(check, nal, bytes) != 0)
+                {
+                    return 1;
+                }
+                if (check_sizes(check, nal, offset + 3) != 0)
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    /* two escapes close together, the second pair can not reuse the
+       zeros of the first */
+    for (offset = 0; offset <= 70; offset++)
+    {
+        for (next = 0; next <= 6; next++)
+        {
+            bytes = 100;
+            check_fill_clean(check, nal, bytes);
+            memcpy(nal + offset, "\0\0\3", 3);
+            nal[offset + 3 + next] = 0;
+            nal[offset + 4 + next] = 0;
+            nal[offset + 5 + next] = 3;
+            if (check_sizes(check, nal, bytes) != 0)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* a random sps write_sps can send, no scaling matrix or hrd */
+static void
+check_sps_fill(struct check_t* check, struct sps_t* sps)
+{
+    static const int profiles[7] = { 66, 77, 88, 100, 110, 122, 244 };
+    int index;
+    struct vui_t* vui;
+
+    memset(sps, 0, sizeof(struct sps_t));
+    sps->nal_ref_idc = 3;
+    sps->nal_unit_type = 7;
+    sps->profile_idc = profiles[check_rand(check) % 7];
+    sps->constraint_set0_flag = check_rand(check) & 1;
+    sps->constraint_set1_flag = check_rand(check) & 1;
+    sps->level_idc = check_rand(check) & 0xFF;
+    sps->seq_parameter_set_id = check_rand(check) % 32;
+    if (sps_high_profile(sps->profile_idc))
+    {
+        sps->chroma_format_idc = check_rand(check) % 4;
+        if (sps->chroma_format_idc == 3)
+        {
+            sps->separate_colour_plane_flag = check_rand(check) & 1;
+        }
+        sps->bit_depth_luma_minus8 = check_rand(check) % 7;
+        sps->bit_depth_chroma_minus8 = check_rand(check) % 7;
+        sps->qpprime_y_zero_transform_bypass_flag = check_rand(check) & 1;
+    }
+    sps->log2_max_frame_num_minus4 = check_rand(check) % 13;
+    sps->pic_order_cnt_type = check_rand(check) % 3;
+    sps->log2_max_pic_order_cnt_lsb_minus4 = check_rand(check) % 13;
+    if (sps->pic_order_cnt_type == 1)
+    {
+        sps->delta_pic_order_always_zero_flag = check_rand(check) & 1;
+        sps->offset_for_non_ref_pic = (int)(check_rand(check) % 2001) - 1000;
+        sps->offset_for_top_to_bottom_field =
+            (int)(check_rand(check) % 2001) - 1000;
+        sps->num_ref_frames_in_pic_order_cnt_cycle = check_rand(check) % 8;
+        for (index = 0; index < sps->num_ref_frames_in_pic_order_cnt_cycle;
+             index++)
+        {
+            sps->offset_for_ref_frame[index] =
+                (int)(check_rand(check) % 201) - 100;
+        }
+    }
+    sps->num_ref_frames = check_rand(check) % 17;
+    sps->gaps_in_frame_num_value_allowed_flag = check_rand(check) & 1;
+    sps->pic_width_in_mbs_minus_1 = check_rand(check) % 512;
+    sps->pic_height_in_map_units_minus_1 = check_rand(check) % 512;
+    sps->frame_mbs_only_flag = check_rand(check) & 1;
+    if (!sps->frame_mbs_only_flag)
+    {
+        sps->mb_adaptive_frame_field_flag = check_rand(check) & 1;
+    }
+    sps->direct_8x8_inference_flag = check_rand(check) & 1;
+    sps->frame_cropping_flag = check_rand(check) & 1;
+    if (sps->frame_cropping_flag)
+    {
+        sps->frame_crop_left_offset = check_rand(check) % 64;
+        sps->frame_crop_right_offset = check_rand(check) % 64;
+        sps->frame_crop_top_offset = check_rand(check) % 64;
+        sps->frame_crop_bottom_offset = check_rand(check) % 64;
+    }
+    sps->vui_prameters_present_flag = check_rand(check) & 1;
+    if (sps->vui_prameters_present_flag)
+    {
+        vui = &(sps->vui);
+        vui->aspect_ratio_info_present_flag = check_rand(check) & 1;
+        vui->aspect_ratio_idc = 255;
+        vui->sar_width = check_rand(check) & 0xFFFF;
+        vui->sar_height = check_rand(check) & 0xFFFF;
+        vui->timing_info_present_flag = check_rand(check) & 1;
+        vui->num_units_in_tick = check_rand(check);
+        vui->time_scale = check_rand(check);
+        vui->fixed_frame_rate_flag = check_rand(check) & 1;
+        vui->bitstream_restriction_flag = check_rand(check) & 1;
+        vui->max_bytes_per_pic_denom = check_rand(check) % 17;
+        vui->max_bits_per_mb_denom = check_rand(check) % 17;
+        vui->log2_max_mv_length_horizontal = check_rand(check) % 17;
+        vui->log2_max_mv_length_vertical = check_rand(check) % 17;
+        vui->num_reorder_frames = check_rand(check) % 17;
+        vui->max_dec_frame_buffering = check_rand(check) % 17;
+    }
+}
+
+/* bit offset and length of each CHECK_FIELD_ in an rbsp from
+   check_sps_fill, offset -1 when the field is not sent */
+static int
+check_sps_fields(char* rbsp, long long rbsp_bytes, long long* offsets,
+                 long long* lengths)
+{
+    int index;
+    int count;
+    int profile_idc;
+    int chroma_format_idc;
+    int pic_order_cnt_type;
+    struct bits_t bits;
+
+    for (index = 0; index < CHECK_FIELDS; index++)
+    {
+        offsets[index] = -1;
+        lengths[index] = 0;
+    }
+    bits_init(&bits, rbsp, rbsp_bytes);
+    in_uint(&bits, 8);
+    profile_idc = in_uint(&bits, 8);
+    in_uint(&bits, 16);
+    offsets[CHECK_FIELD_ID] = bits_tell(&bits);
+    in_ueint(&bits);
+    lengths[CHECK_FIELD_ID] = bits_tell(&bits) - offsets[CHECK_FIELD_ID];
+    if (sps_high_profile(profile_idc))
+    {
+        chroma_format_idc = in_ueint(&bits);
+        if (chroma_format_idc == 3)
+        {
+            in_uint(&bits, 1);
+        }
+        in_ueint(&bits);
+        in_ueint(&bits);
+        in_uint(&bits, 2);
+    }
+    offsets[CHECK_FIELD_FRAME_NUM] = bits_tell(&bits);
+    in_ueint(&bits);
+    lengths[CHECK_FIELD_FRAME_NUM] =
+        bits_tell(&bits) - offsets[CHECK_FIELD_FRAME_NUM];
+    pic_order_cnt_type = in_ueint(&bits);
+    if (pic_order_cnt_type == 0)
+    {
+        in_ueint(&bits);
+    }
+    else if (pic_order_cnt_type == 1)
+    {
+        in_uint(&bits, 1);
+        offsets[CHECK_FIELD_NON_REF] = bits_tell(&bits);
+        in_seint(&bits);
+        lengths[CHECK_FIELD_NON_REF] =
+            bits_tell(&bits) - offsets[CHECK_FIELD_NON_REF];
+        in_seint(&bits);
+        count = in_ueint(&bits);
+        for (index = 0; index < count; index++)
+        {
+            in_seint(&bits);
+        }
+    }
+    for (index = CHECK_FIELD_REFS; index <= CHECK_FIELD_HEIGHT; index++)
+    {
+        offsets[index] = bits_tell(&bits);
+        if (index == CHECK_FIELD_GAPS)
+        {
+            in_uint(&bits, 1);
+        }
+        else
+        {
+            in_ueint(&bits);
+        }
+        lengths[index] = bits_tell(&bits) - offsets[index];
+    }
+    return bits.error;
+}
+
+/* write_sps of an sps, then the same fields changed once through
+   write_sps and once through rbsp_splice on the first rbsp, the two
+   must come out the same */
+static int
+check_splice(struct check_t* check, int count)
+{
+    int index;
+    int field;
+    int num_edits;
+    int val;
+    unsigned int r;
+    long long offsets[CHECK_FIELDS];
+    long long lengths[CHECK_FIELDS];
+    long long rbsp_bytes;
+    long long ref_bytes;
+    long long rv;
+    struct sps_t* sps;
+    struct sps_t* edited;
+    struct bits_edit_t edits[CHECK_FIELDS];
+    struct wbits_t rbsp;
+    struct wbits_t ref;
+    struct wbits_t out;
+
+    sps = (struct sps_t*)malloc(sizeof(struct sps_t));
+    edited = (struct sps_t*)malloc(sizeof(struct sps_t));
+    if ((sps == NULL) || (edited == NULL) ||
+        (wbits_init(&rbsp, 64) != 0) || (wbits_init(&ref, 64) != 0) ||
+        (wbits_init(&out, 64) != 0))
+    {
+        printf("rbsp check out of memory\n");
+        return 1;
+    }
+    rv = 0;
+    for (index = 0; (index < count) && (rv == 0); index++)
+    {
+        check->cases++;
+        check_sps_fill(check, sps);
+        memcpy(edited, sps, sizeof(struct sps_t));
+        rbsp.offset = 0;
+        rbsp.acc = 0;
+        rbsp.acc_bits = 0;
+        write_sps(&rbsp, sps, NULL);
+        rbsp_bytes = wbits_flush(&rbsp);
+        if (rbsp.error ||
+            (check_sps_fields(rbsp.data, rbsp_bytes, offsets, lengths) != 0))
+        {
+            printf("rbsp check sps fields not found\n");
+            rv = 1;
+            break;
+        }
+
+        num_edits = 0;
+        for (field = 0; field < CHECK_FIELDS; field++)
+        {
+            if ((offsets[field] < 0) || (check_rand(check) & 1))
+            {
+                continue;
+            }
+            r = check_rand(check);
+            switch (field)
+            {
+                case CHECK_FIELD_ID:
+                    val = r % 32;
+                    edited->seq_parameter_set_id = val;
+                    break;
+                case CHECK_FIELD_FRAME_NUM:
+                    val = r % 13;
+                    edited->log2_max_frame_num_minus4 = val;
+                    break;
+                case CHECK_FIELD_NON_REF:
+                    val = (int)(r % 2000001) - 1000000;
+                    edited->offset_for_non_ref_pic = val;
+                    bits_edit_seint(edits + num_edits, offsets[field],
+                                    lengths[field], val);
+                    num_edits++;
+                    continue;
+                case CHECK_FIELD_REFS:
+                    val = r % 17;
+                    edited->num_ref_frames = val;
+                    break;
+                case CHECK_FIELD_GAPS:
+                    val = r & 1;
+                    edited->gaps_in_frame_num_value_allowed_flag = val;
+                    bits_edit_uint(edits + num_edits, offsets[field],
+                                   lengths[field], val, 1);
+                    num_edits++;
+                    continue;
+                case CHECK_FIELD_WIDTH:
+                    val = r % (1u << (check_rand(check) % 17));
+                    edited->pic_width_in_mbs_minus_1 = val;
+                    break;
+                default:
+                    val = r % (1u << (check_rand(check) % 17));
+                    edited->pic_height_in_map_units_minus_1 = val;
+                    break;
+            }
+            bits_edit_ueint(edits + num_edits, offsets[field],
+                            lengths[field], val);
+            num_edits++;
+        }
+
+        ref.offset = 0;
+        ref.acc = 0;
+        ref.acc_bits = 0;
+        write_sps(&ref, edited, NULL);
+        ref_bytes = wbits_flush(&ref);
+        out.offset = 0;
+        out.acc = 0;
+        out.acc_bits = 0;
+        if ((rbsp_splice(rbsp.data, rbsp_bytes, edits, num_edits,
+                         &out) != ref_bytes) || ref.error ||
+            (memcmp(out.data, ref.data, ref_bytes) != 0))
+        {
+            printf("rbsp check rbsp_splice mismatch %d edits\n", num_edits);
+            fhexdump(stdout, rbsp.data, rbsp_bytes);
+            printf("write_sps\n");
+            fhexdump(stdout, ref.data, ref_bytes);
+            printf("rbsp_splice\n");
+            fhexdump(stdout, out.data, out.offset);
+            rv = 1;
+        }
+    }
+    wbits_deinit(&rbsp);
+    wbits_deinit(&ref);
+    wbits_deinit(&out);
+    free(sps);
+    free(edited);
+    return (int)rv;
+}
+
+/* rbsp_check [seed [count]]  compare the unescape paths with the byte at
+   a time reference, exit 1 on the first mismatch */
+int
+main(int argc, char** argv)
+{
+    int count;
+    struct check_t* check;
+
+    check = (struct check_t*)calloc(1, sizeof(struct check_t));
+    if (check == NULL)
+    {
+        printf("rbsp check out of memory\n");
+        return 1;
+    }
+    check->seed = 0x2545f491;
+    count = 20000;
+    if (argc > 1)
+    {
+        check->seed = strtoul(argv[1], NULL, 0);
+        if (check->seed == 0)
+        {
+            check->seed = 1;
+        }
+    }
+    if (argc > 2)
+    {
+        count = atoi(argv[2]);
+    }
+    if ((check_adversarial(check) != 0) || (check_random(check, count) != 0) ||
+        (check_splice(check, count) != 0))
+    {
+        free(check);
+        return 1;
+    }
+    printf("rbsp check ok %d cases\n", check->cases);
+    free(check);
+    return 0;
+}
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "sps.h"
+#include "pps.h"
+#include "params.h"
+#include "slice.h"
+
+/* num_bits can be 0 */
+static unsigned int
+in_uint_v(struct bits_t* bits, int num_bits)
+{
+    if (num_bits < 1)
+    {
+        return 0;
+    }
+    return in_uint(bits, num_bits);
+}
+
+/* only walked, the picture numbers are not kept */
+static int
+skip_ref_pic_list_modification(struct bits_t* bits)
+{
+    int modification_of_pic_nums_idc;
+    int count;
+
+    count = 0;
+    do
+    {
+        modification_of_pic_nums_idc                    = in_ueint(bits);
+        if (modification_of_pic_nums_idc < 3)
+        {
+            /* abs_diff_pic_num_minus1 or long_term_pic_num */
+            in_ueint(bits);
+        }
+        else if (modification_of_pic_nums_idc > 3)
+        {
+            return 1;
+        }
+        /* at most num_ref_idx_active_minus1 + 2 entries */
+        if (++count > 33)
+        {
+            return 1;
+        }
+    } while ((modification_of_pic_nums_idc != 3) && !bits->error);
+    return 0;
+}
+
+/* only walked, the weights are not kept */
+static int
+skip_pred_weight_table(struct bits_t* bits, struct slice_t* slice,
+                       int chroma_array_type)
+{
+    int list;
+    int index;
+    int count;
+
+    in_ueint(bits);                     /* luma_log2_weight_denom */
+    if (chroma_array_type != 0)
+    {
+        in_ueint(bits);                 /* chroma_log2_weight_denom */
+    }
+    for (list = 0; list < 2; list++)
+    {
+        count = list == 0 ? slice->num_ref_idx_l0_active_minus1 :
+                            slice->num_ref_idx_l1_active_minus1;
+        for (index = 0; index <= count; index++)
+        {
+            if (in_uint(bits, 1))       /* luma_weight_flag */
+            {
+                in_seint(bits);         /* luma_weight */
+                in_seint(bits);         /* luma_offset */
+            }
+            if ((chroma_array_type != 0) && in_uint(bits, 1))
+            {
+                in_seint(bits);         /* chroma_weight Cb */
+                in_seint(bits);         /* chroma_offset Cb */
+                in_seint(bits);         /* chroma_weight Cr */
+                in_seint(bits);         /* chroma_offset Cr */
+            }
+        }
+        if ((slice->slice_type % 5) != SLICE_TYPE_B)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+static int
+parse_dec_ref_pic_marking(struct bits_t* bits, int idr_pic_flag,
+                          struct dec_ref_pic_marking_t* drpm)
+{
+    int op;
+    struct mmco_t mmco;
+
+    if (idr_pic_flag)
+    {
+        drpm->no_output_of_prior_pics_flag              = in_uint(bits, 1);
+        drpm->long_term_reference_flag                  = in_uint(bits, 1);
+        return 0;
+    }
+    drpm->adaptive_ref_pic_marking_mode_flag            = in_uint(bits, 1);
+    if (!drpm->adaptive_ref_pic_marking_mode_flag)
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        memset(&mmco, 0, sizeof(mmco));
+        op                                              = in_ueint(bits);
+        if ((op == 0) || bits->error)
+        {
+            break;
+        }
+        if (op > 6)
+        {
+            return 1;
+        }
+        mmco.memory_management_control_operation = op;
+        if ((op == 1) || (op == 3))
+        {
+            mmco.difference_of_pic_nums_minus1          = in_ueint(bits);
+        }
+        if (op == 2)
+        {
+            mmco.long_term_pic_num                      = in_ueint(bits);
+        }
+        if ((op == 3) || (op == 6))
+        {
+            mmco.long_term_frame_idx                    = in_ueint(bits);
+        }
+        if (op == 4)
+        {
+            mmco.max_long_term_frame_idx_plus1          = in_ueint(bits);
+        }
+        if (drpm->num_mmco < MAX_MMCO)
+        {
+            drpm->mmco[drpm->num_mmco] = mmco;
+        }
+        drpm->num_mmco++;
+    }
+    return 0;
+}
+
+/* Ceil(Log2(PicSizeInMapUnits / SliceGroupChangeRate + 1)), the
+   division is not an integer one so this is the smallest size where
+   (2^size - 1) * SliceGroupChangeRate reaches PicSizeInMapUnits */
+static int
+slice_group_change_cycle_bits(const struct sps_t* sps,
+                              const struct pps_t* pps)
+{
+    int size;
+    long long pic_size_in_map_units;
+    long long change_rate;
+
+    pic_size_in_map_units = (long long)(sps->pic_width_in_mbs_minus_1 + 1) *
+                            (sps->pic_height_in_map_units_minus_1 + 1);
+    change_rate = pps->slice_group_change_rate_minus1 + 1;
+    size = 0;
+    while ((((1ll << size) - 1) * change_rate < pic_size_in_map_units) &&
+           (size < 32))
+    {
+        size++;
+    }
+    return size;
+}
+
+/* bits is set up with bits_init_nal on a whole slice nal, type 1 or 5
+   sps_by_id and pps_by_id are the parameter sets seen so far, MAX_SPS
+   and MAX_PPS entries, NULL where none was seen
+   reading stops after the last slice header field so header_bits is where
+   slice_data starts, cabac_alignment_one_bits aside
+   returns 0, 1 when the pps or sps is not there, 2 on a bad or
+   unsupported header */
+int
+parse_slice_header(struct bits_t* bits, struct sps_t* const* sps_by_id,
+                   struct pps_t* const* pps_by_id, struct slice_t* slice)
+{
+    int slice_type;
+    int idr_pic_flag;
+    const struct sps_t* sps;
+    const struct pps_t* pps;
+
+    slice->forbidden_zero_bit                           = in_uint(bits, 1);
+    slice->nal_ref_idc                                  = in_uint(bits, 2);
+    slice->nal_unit_type                                = in_uint(bits, 5);
+    if ((slice->nal_unit_type != 1) && (slice->nal_unit_type != 5))
+    {
+        return 2;
+    }
+    idr_pic_flag = slice->nal_unit_type == 5;
+    slice->first_mb_in_slice                            = in_ueint(bits);
+    slice->slice_type                                   = in_ueint(bits);
+    slice->pic_parameter_set_id                         = in_ueint(bits);
+    if ((slice->slice_type < 0) || (slice->slice_type > 9) || bits->error)
+    {
+        return 2;
+    }
+    if ((slice->pic_parameter_set_id < 0) ||
+        (slice->pic_parameter_set_id >= MAX_PPS) ||
+        (pps_by_id[slice->pic_parameter_set_id] == NULL))
+    {
+        return 1;
+    }
+    pps = pps_by_id[slice->pic_parameter_set_id];
+    if ((pps->seq_parameter_set_id < 0) ||
+        (pps->seq_parameter_set_id >= MAX_SPS) ||
+        (sps_by_id[pps->seq_parameter_set_id] == NULL))
+    {
+        return 1;
+    }
+    sps = sps_by_id[pps->seq_parameter_set_id];
+    slice_type = slice->slice_type % 5;
+
+    if (sps->separate_colour_plane_flag)
+    {
+        slice->colour_plane_id                          = in_uint(bits, 2);
+    }
+    slice->frame_num = in_uint_v(bits, sps->log2_max_frame_num_minus4 + 4);
+    if (!sps->frame_mbs_only_flag)
+    {
+        slice->field_pic_flag                           = in_uint(bits, 1);
+        if (slice->field_pic_flag)
+        {
+            slice->bottom_field_flag                    = in_uint(bits, 1);
+        }
+    }
+    if (idr_pic_flag)
+    {
+        slice->idr_pic_id                               = in_ueint(bits);
+    }
+    if (sps->pic_order_cnt_type == 0)
+    {
+        slice->pic_order_cnt_lsb =
+            in_uint_v(bits, sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
+        if (pps->pic_order_present_flag && !slice->field_pic_flag)
+        {
+            slice->delta_pic_order_cnt_bottom           = in_seint(bits);
+        }
+    }
+    if ((sps->pic_order_cnt_type == 1) &&
+        !sps->delta_pic_order_always_zero_flag)
+    {
+        slice->delta_pic_order_cnt[0]                   = in_seint(bits);
+        if (pps->pic_order_present_flag && !slice->field_pic_flag)
+        {
+            slice->delta_pic_order_cnt[1]               = in_seint(bits);
+        }
+    }
+    if (pps->redundant_pic_cnt_present_flag)
+    {
+        slice->redundant_pic_cnt                        = in_ueint(bits);
+    }
+    if (slice_type == SLICE_TYPE_B)
+    {
+        slice->direct_spatial_mv_pred_flag              = in_uint(bits, 1);
+    }
+    slice->num_ref_idx_l0_active_minus1 = pps->num_ref_idx_l0_active_minus1;
+    slice->num_ref_idx_l1_active_minus1 = pps->num_ref_idx_l1_active_minus1;
+    if ((slice_type == SLICE_TYPE_P) || (slice_type == SLICE_TYPE_SP) ||
+        (slice_type == SLICE_TYPE_B))
+    {
+        slice->num_ref_idx_active_override_flag         = in_uint(bits, 1);
+        if (slice->num_ref_idx_active_override_flag)
+        {
+            slice->num_ref_idx_l0_active_minus1         = in_ueint(bits);
+            if (slice_type == SLICE_TYPE_B)
+            {
+                slice->num_ref_idx_l1_active_minus1     = in_ueint(bits);
+            }
+        }
+    }
+    if ((slice->num_ref_idx_l0_active_minus1 < 0) ||
+        (slice->num_ref_idx_l0_active_minus1 > 31) ||
+        (slice->num_ref_idx_l1_active_minus1 < 0) ||
+        (slice->num_ref_idx_l1_active_minus1 > 31))
+    {
+        return 2;
+    }
+
+    /* ref_pic_list_modification */
+    if ((slice_type != SLICE_TYPE_I) && (slice_type != SLICE_TYPE_SI))
+    {
+        slice->ref_pic_list_modification_flag_l0        = in_uint(bits, 1);
+        if (slice->ref_pic_list_modification_flag_l0 &&
+            (skip_ref_pic_list_modification(bits) != 0))
+        {
+            return 2;
+        }
+    }
+    if (slice_type == SLICE_TYPE_B)
+    {
+        slice->ref_pic_list_modification_flag_l1        = in_uint(bits, 1);
+        if (slice->ref_pic_list_modification_flag_l1 &&
+            (skip_ref_pic_list_modification(bits) != 0))
+        {
+            return 2;
+        }
+    }
+
+    if ((pps->weighted_pred_flag &&
+         ((slice_type == SLICE_TYPE_P) || (slice_type == SLICE_TYPE_SP))) ||
+        ((pps->weighted_bipred_idc == 1) && (slice_type == SLICE_TYPE_B)))
+    {
+        skip_pred_weight_table(bits, slice, sps->chroma_array_type);
+    }
+    if (slice->nal_ref_idc != 0)
+    {
+        if (parse_dec_ref_pic_marking(bits, idr_pic_flag,
+                                      &(slice->dec_ref_pic_marking)) != 0)
+        {
+            return 2;
+        }
+    }
+    if (pps->entropy_coding_mode_flag && (slice_type != SLICE_TYPE_I) &&
+        (slice_type != SLICE_TYPE_SI))
+    {
+        slice->cabac_init_idc                           = in_ueint(bits);
+    }
+    slice->slice_qp_delta                               = in_seint(bits);
+    if ((slice_type == SLICE_TYPE_SP) || (slice_type == SLICE_TYPE_SI))
+    {
+        if (slice_type == SLICE_TYPE_SP)
+        {
+            slice->sp_for_switch_flag                   = in_uint(bits, 1);
+        }
+        slice->slice_qs_delta                           = in_seint(bits);
+    }
+    if (pps->deblocking_filter_control_present_flag)
+    {
+        slice->disable_deblocking_filter_idc            = in_ueint(bits);
+        if (slice->disable_deblocking_filter_idc != 1)
+        {
+            slice->slice_alpha_c0_offset_div2           = in_seint(bits);
+            slice->slice_beta_offset_div2               = in_seint(bits);
+        }
+    }
+    if ((pps->num_slice_groups_minus1 > 0) &&
+        (pps->slice_group_map_type >= 3) && (pps->slice_group_map_type <= 5))
+    {
+        slice->slice_group_change_cycle =
+            in_uint_v(bits, slice_group_change_cycle_bits(sps, pps));
+    }
+    slice->header_bits = bits_tell(bits);
+    return bits->error ? 2 : 0;
+}
+
+/* 7.4.1.2.4, nonzero when slice is the first vcl nal of a new primary
+   picture given prev, the last primary slice before it
+   fields not in either header are 0 in both so they compare equal */
+int
+slice_first_of_picture(const struct slice_t* prev,
+                       const struct slice_t* slice)
+{
+    if (slice->redundant_pic_cnt > 0)
+    {
+        return 0;
+    }
+    if ((slice->frame_num != prev->frame_num) ||
+        (slice->pic_parameter_set_id != prev->pic_parameter_set_id) ||
+        (slice->field_pic_flag != prev->field_pic_flag) ||
+        (slice->bottom_field_flag != prev->bottom_field_flag) ||
+        ((slice->nal_ref_idc != prev->nal_ref_idc) &&
+         ((slice->nal_ref_idc == 0) || (prev->nal_ref_idc == 0))) ||
+        (slice->pic_order_cnt_lsb != prev->pic_order_cnt_lsb) ||
+        (slice->delta_pic_order_cnt_bottom !=
+         prev->delta_pic_order_cnt_bottom) ||
+        (slice->delta_pic_order_cnt[0] != prev->delta_pic_order_cnt[0]) ||
+        (slice->delta_pic_order_cnt[1] != prev->delta_pic_order_cnt[1]) ||
+        (slice->nal_unit_type != prev->nal_unit_type))
+    {
+        return 1;
+    }
+    return (slice->nal_unit_type == 5) &&
+           (slice->idr_pic_id != prev->idr_pic_id);
+}
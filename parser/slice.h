@@ -0,0 +1,81 @@
+
+#ifndef _SLICE_H_
+#define _SLICE_H_
+
+#define SLICE_TYPE_P    0
+#define SLICE_TYPE_B    1
+#define SLICE_TYPE_I    2
+#define SLICE_TYPE_SP   3
+#define SLICE_TYPE_SI   4
+
+#define MAX_MMCO        32
+
+struct mmco_t
+{
+    int memory_management_control_operation;    /* ue(v) */
+    int difference_of_pic_nums_minus1;          /* ue(v) */
+    int long_term_pic_num;                      /* ue(v) */
+    int long_term_frame_idx;                    /* ue(v) */
+    int max_long_term_frame_idx_plus1;          /* ue(v) */
+};
+
+struct dec_ref_pic_marking_t
+{
+    int no_output_of_prior_pics_flag;           /* u(1) */
+    int long_term_reference_flag;               /* u(1) */
+    int adaptive_ref_pic_marking_mode_flag;     /* u(1) */
+    int num_mmco;                               /* ops before the 0 that
+                                                   ends them, the first
+                                                   MAX_MMCO are kept */
+    struct mmco_t mmco[MAX_MMCO];
+};
+
+struct slice_t
+{
+    int forbidden_zero_bit;                     /* u(1) */
+    int nal_ref_idc;                            /* u(2) */
+    int nal_unit_type;                          /* u(5) */
+    int first_mb_in_slice;                      /* ue(v) */
+    int slice_type;                             /* ue(v) */
+    int pic_parameter_set_id;                   /* ue(v) */
+    int colour_plane_id;                        /* u(2) */
+    int frame_num;                              /* u(v) */
+    int field_pic_flag;                         /* u(1) */
+    int bottom_field_flag;                      /* u(1) */
+    int idr_pic_id;                             /* ue(v) */
+    int pic_order_cnt_lsb;                      /* u(v) */
+    int delta_pic_order_cnt_bottom;             /* se(v) */
+    int delta_pic_order_cnt[2];                 /* se(v) */
+    int redundant_pic_cnt;                      /* ue(v) */
+    int direct_spatial_mv_pred_flag;            /* u(1) */
+    int num_ref_idx_active_override_flag;       /* u(1) */
+    int num_ref_idx_l0_active_minus1;           /* ue(v) */
+    int num_ref_idx_l1_active_minus1;           /* ue(v) */
+    int ref_pic_list_modification_flag_l0;      /* u(1) */
+    int ref_pic_list_modification_flag_l1;      /* u(1) */
+    struct dec_ref_pic_marking_t dec_ref_pic_marking;
+    int cabac_init_idc;                         /* ue(v) */
+    int slice_qp_delta;                         /* se(v) */
+    int sp_for_switch_flag;                     /* u(1) */
+    int slice_qs_delta;                         /* se(v) */
+    int disable_deblocking_filter_idc;          /* ue(v) */
+    int slice_alpha_c0_offset_div2;             /* se(v) */
+    int slice_beta_offset_div2;                 /* se(v) */
+    int slice_group_change_cycle;               /* u(v) */
+
+    int header_bits;                            /* rbsp bits before
+                                                   slice_data */
+};
+
+struct bits_t;
+struct sps_t;
+struct pps_t;
+
+int
+parse_slice_header(struct bits_t* bits, struct sps_t* const* sps_by_id,
+                   struct pps_t* const* pps_by_id, struct slice_t* slice);
+int
+slice_first_of_picture(const struct slice_t* prev,
+                       const struct slice_t* slice);
+
+#endif
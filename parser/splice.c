@@ -0,0 +1,108 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "splice.h"
+
+int
+bits_edit_uint(struct bits_edit_t* edit, long long bit_offset,
+               long long bit_length, unsigned int val, int num_bits)
+{
+    edit->bit_offset = bit_offset;
+    edit->bit_length = bit_length;
+    edit->val = num_bits < 32 ? val & ((1u << num_bits) - 1) : val;
+    edit->val_bits = num_bits;
+    return 0;
+}
+
+int
+bits_edit_ueint(struct bits_edit_t* edit, long long bit_offset,
+                long long bit_length, unsigned int val)
+{
+    edit->bit_offset = bit_offset;
+    edit->bit_length = bit_length;
+    edit->val = (unsigned long long)val + 1;
+    edit->val_bits = 2 * (64 - __builtin_clzll(edit->val)) - 1;
+    return 0;
+}
+
+int
+bits_edit_seint(struct bits_edit_t* edit, long long bit_offset,
+                long long bit_length, int val)
+{
+    if (val <= 0)
+    {
+        return bits_edit_ueint(edit, bit_offset, bit_length,
+                               -(unsigned int)val * 2);
+    }
+    return bits_edit_ueint(edit, bit_offset, bit_length,
+                           (unsigned int)val * 2 - 1);
+}
+
+/* bits before rbsp_stop_one_bit, anything after the last non zero byte,
+   like cabac_zero_words, is not part of the payload
+   returns -1 if there is no stop bit */
+long long
+rbsp_payload_bits(const char* rbsp, long long rbsp_bytes)
+{
+    int byte_data;
+
+    while (rbsp_bytes > 0)
+    {
+        byte_data = rbsp[rbsp_bytes - 1] & 0xFF;
+        if (byte_data != 0)
+        {
+            return rbsp_bytes * 8 - __builtin_ctz(byte_data) - 1;
+        }
+        rbsp_bytes--;
+    }
+    return -1;
+}
+
+/* append to wbits the rbsp with edits applied and new rbsp_trailing_bits,
+   edits are sorted by bit_offset and do not overlap, unchanged ranges
+   between them are copied with wbits_copy
+   returns the bytes in wbits or -1 on error */
+long long
+rbsp_splice(const char* rbsp, long long rbsp_bytes,
+            const struct bits_edit_t* edits, int num_edits,
+            struct wbits_t* wbits)
+{
+    int index;
+    long long pos;
+    long long payload_bits;
+    const struct bits_edit_t* edit;
+
+    payload_bits = rbsp_payload_bits(rbsp, rbsp_bytes);
+    if (payload_bits < 0)
+    {
+        return -1;
+    }
+    pos = 0;
+    for (index = 0; index < num_edits; index++)
+    {
+        edit = edits + index;
+        if ((edit->bit_offset < pos) || (edit->bit_length < 0) ||
+            (edit->bit_offset + edit->bit_length > payload_bits) ||
+            (edit->val_bits < 0) || (edit->val_bits > 64))
+        {
+            return -1;
+        }
+        wbits_copy(wbits, rbsp, pos, edit->bit_offset - pos);
+        if (edit->val_bits > 0)
+        {
+            put_bits(wbits, edit->val, edit->val_bits);
+        }
+        pos = edit->bit_offset + edit->bit_length;
+    }
+    wbits_copy(wbits, rbsp, pos, payload_bits - pos);
+    put_trailing_bits(wbits);
+    wbits_flush(wbits);
+    if (wbits->error)
+    {
+        return -1;
+    }
+    return wbits->offset;
+}
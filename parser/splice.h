@@ -0,0 +1,31 @@
+
+#ifndef _SPLICE_H_
+#define _SPLICE_H_
+
+/* replace bit_length bits at bit_offset in the source rbsp with the
+   val_bits low bits of val, bit_length 0 inserts, val_bits 0 deletes */
+struct bits_edit_t
+{
+    long long bit_offset;
+    long long bit_length;
+    unsigned long long val;
+    int val_bits;           /* 0 to 64 */
+};
+
+int
+bits_edit_uint(struct bits_edit_t* edit, long long bit_offset,
+               long long bit_length, unsigned int val, int num_bits);
+int
+bits_edit_ueint(struct bits_edit_t* edit, long long bit_offset,
+                long long bit_length, unsigned int val);
+int
+bits_edit_seint(struct bits_edit_t* edit, long long bit_offset,
+                long long bit_length, int val);
+long long
+rbsp_payload_bits(const char* rbsp, long long rbsp_bytes);
+long long
+rbsp_splice(const char* rbsp, long long rbsp_bytes,
+            const struct bits_edit_t* edits, int num_edits,
+            struct wbits_t* wbits);
+
+#endif
@@ -5,23 +5,20 @@
 #include "bits.h"
 #include "sps.h"
 
-void
-hexdump(const void *p, int len);
-
 static int
 parse_hrd(struct bits_t* bits, struct hrd_t* hrd)
 {
     int index;
 
     hrd->cpb_cnt_minus1                                 = in_ueint(bits);
+    if ((hrd->cpb_cnt_minus1 < 0) || (hrd->cpb_cnt_minus1 > 31))
+    {
+        return 1;
+    }
     hrd->bit_rate_scale                                 = in_uint(bits, 4);
     hrd->cpb_size_scale                                 = in_uint(bits, 4);
     for (index = 0; index <= hrd->cpb_cnt_minus1; index++ )
     {
-        if (index > 31)
-        {
-            break;
-        }
         hrd->bit_rate_value_minus1[index]               = in_ueint(bits);
         hrd->cpb_size_value_minus1[index]               = in_ueint(bits);
         hrd->cbr_flag[index]                            = in_uint(bits, 1);
@@ -78,21 +75,23 @@ parse_vui(struct bits_t* bits, struct vui_t* vui)
     vui->timing_info_present_flag                       = in_uint(bits, 1);
     if (vui->timing_info_present_flag)
     {
-        vui->num_units_in_tick                          = in_uint(bits, 32);
-        vui->time_scale                                 = in_uint(bits, 32);
+        vui->num_units_in_tick                          = in_uint32(bits);
+        vui->time_scale                                 = in_uint32(bits);
         vui->fixed_frame_rate_flag                      = in_uint(bits, 1);
     }
     
     vui->nal_hrd_parameters_present_flag                = in_uint(bits, 1);
-    if (vui->nal_hrd_parameters_present_flag)
+    if (vui->nal_hrd_parameters_present_flag &&
+        (parse_hrd(bits, &(vui->nal_hrd_parameters)) != 0))
     {
-        parse_hrd(bits, &(vui->nal_hrd_parameters));
+        return 1;
     }
 
     vui->vcl_hrd_parameters_present_flag                = in_uint(bits, 1);
-    if (vui->vcl_hrd_parameters_present_flag)
+    if (vui->vcl_hrd_parameters_present_flag &&
+        (parse_hrd(bits, &(vui->vcl_hrd_parameters)) != 0))
     {
-        parse_hrd(bits, &(vui->vcl_hrd_parameters));
+        return 1;
     }
 
     if (vui->nal_hrd_parameters_present_flag ||
@@ -118,12 +117,138 @@ parse_vui(struct bits_t* bits, struct vui_t* vui)
     return 0;
 }
 
+/* Table 7-3 and 7-4, zigzag order */
+static const unsigned char g_default_4x4[2][16] =
+{
+    {  6, 13, 13, 20, 20, 20, 28, 28, 28, 28, 32, 32, 32, 37, 37, 42 },
+    { 10, 14, 14, 20, 20, 20, 24, 24, 24, 24, 27, 27, 27, 30, 30, 34 }
+};
+
+static const unsigned char g_default_8x8[2][64] =
+{
+    {  6, 10, 10, 13, 11, 13, 16, 16, 16, 16, 18, 18, 18, 18, 18, 23,
+      23, 23, 23, 23, 23, 25, 25, 25, 25, 25, 25, 25, 27, 27, 27, 27,
+      27, 27, 27, 27, 29, 29, 29, 29, 29, 29, 29, 31, 31, 31, 31, 31,
+      31, 33, 33, 33, 33, 33, 36, 36, 36, 36, 38, 38, 38, 40, 40, 42 },
+    {  9, 13, 13, 15, 13, 15, 17, 17, 17, 17, 19, 19, 19, 19, 19, 21,
+      21, 21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 24, 24, 24, 24,
+      24, 24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 27, 27, 27, 27, 27,
+      27, 28, 28, 28, 28, 28, 30, 30, 30, 30, 32, 32, 32, 33, 33, 35 }
+};
+
+/* scaling_list(), list is NULL to only walk it, once nextScale is 0 the
+   rest of the list repeats lastScale and nothing more is sent
+   returns useDefaultScalingMatrixFlag */
 int
-parse_sps(struct bits_t* bits, struct sps_t* sps)
+parse_scaling_list(struct bits_t* bits, unsigned char* list, int size)
+{
+    int index;
+    int last_scale;
+    int next_scale;
+
+    last_scale = 8;
+    for (index = 0; index < size; index++)
+    {
+        next_scale = (last_scale + in_seint(bits) + 256) % 256;
+        if (next_scale == 0)
+        {
+            if (index == 0)
+            {
+                return 1;
+            }
+            break;
+        }
+        last_scale = next_scale;
+        if (list != NULL)
+        {
+            list[index] = last_scale;
+        }
+    }
+    if (list != NULL)
+    {
+        for (; index < size; index++)
+        {
+            list[index] = last_scale;
+        }
+    }
+    return 0;
+}
+
+/* profiles that send chroma_format_idc to seq_scaling_matrix */
+int
+sps_high_profile(int profile_idc)
+{
+    switch (profile_idc)
+    {
+        case 100: case 110: case 122: case 244: case 44: case 83:
+        case 86: case 118: case 128: case 138: case 139: case 134:
+        case 135:
+            return 1;
+    }
+    return 0;
+}
+
+/* the fields profiles 100 and up have after seq_parameter_set_id, the
+   scaling lists are walked and only their place is kept, see
+   parse_sps_scaling_matrix
+   profile_idc must be set, chroma_format_idc is 1 when not sent */
+int
+parse_sps_high_profile(struct bits_t* bits, struct sps_t* sps)
 {
     int index;
     int count;
 
+    sps->chroma_format_idc = 1;
+    if (!sps_high_profile(sps->profile_idc))
+    {
+        return 0;
+    }
+    sps->chroma_format_idc                              = in_ueint(bits);
+    if (sps->chroma_format_idc > 3)
+    {
+        return 1;
+    }
+    if (sps->chroma_format_idc == 3)
+    {
+        sps->separate_colour_plane_flag                 = in_uint(bits, 1);
+    }
+    sps->bit_depth_luma_minus8                          = in_ueint(bits);
+    sps->bit_depth_chroma_minus8                        = in_ueint(bits);
+    sps->qpprime_y_zero_transform_bypass_flag           = in_uint(bits, 1);
+    sps->seq_scaling_matrix_present_flag                = in_uint(bits, 1);
+    sps->scaling_matrix_bit_offset = bits_tell(bits);
+    if (sps->seq_scaling_matrix_present_flag)
+    {
+        count = sps->chroma_format_idc != 3 ? 8 : 12;
+        for (index = 0; index < count; index++)
+        {
+            if (in_uint(bits, 1))
+            {
+                sps->seq_scaling_list_present_flag |= 1 << index;
+                if (parse_scaling_list(bits, NULL, index < 6 ? 16 : 64))
+                {
+                    sps->use_default_scaling_matrix_flag |= 1 << index;
+                }
+            }
+        }
+    }
+    sps->scaling_matrix_bits = bits_tell(bits) -
+                               sps->scaling_matrix_bit_offset;
+    if ((sps->bit_depth_luma_minus8 > 6) ||
+        (sps->bit_depth_chroma_minus8 > 6))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+int
+parse_sps(struct bits_t* bits, struct sps_t* sps)
+{
+    int count;
+    int crop_unit_x;
+    int crop_unit_y;
+
     sps->forbidden_zero_bit                             = in_uint(bits, 1);
     sps->nal_ref_idc                                    = in_uint(bits, 2);
     sps->nal_unit_type                                  = in_uint(bits, 5);
@@ -135,7 +260,14 @@ parse_sps(struct bits_t* bits, struct sps_t* sps)
     sps->reserved_zero_4bits                            = in_uint(bits, 4);
     sps->level_idc                                      = in_uint(bits, 8);
     sps->seq_parameter_set_id                           = in_ueint(bits);
-    /* some alpha fields can be here */
+    if ((sps->seq_parameter_set_id < 0) || (sps->seq_parameter_set_id > 31))
+    {
+        return 1;
+    }
+    if (parse_sps_high_profile(bits, sps) != 0)
+    {
+        return 1;
+    }
     sps->log2_max_frame_num_minus4                      = in_ueint(bits);
     sps->pic_order_cnt_type                             = in_ueint(bits);
     if (sps->pic_order_cnt_type == 0)
@@ -149,10 +281,11 @@ parse_sps(struct bits_t* bits, struct sps_t* sps)
         sps->offset_for_top_to_bottom_field             = in_seint(bits);
         sps->num_ref_frames_in_pic_order_cnt_cycle      = in_ueint(bits);
         count = sps->num_ref_frames_in_pic_order_cnt_cycle;
-        for (index = 0; index < count; index++)
+        if ((count < 0) || (count > 255))
         {
-            in_ueint(bits);
+            return 1;
         }
+        in_seint_array(bits, sps->offset_for_ref_frame, count);
     }
     sps->num_ref_frames                                 = in_ueint(bits);
     sps->gaps_in_frame_num_value_allowed_flag           = in_uint(bits, 1);
@@ -173,15 +306,318 @@ parse_sps(struct bits_t* bits, struct sps_t* sps)
         sps->frame_crop_bottom_offset                   = in_ueint(bits);
     }
     sps->vui_prameters_present_flag                     = in_uint(bits, 1);
-    if (sps->vui_prameters_present_flag)
+    if (sps->vui_prameters_present_flag &&
+        (parse_vui(bits, &(sps->vui)) != 0))
     {
-        //hexdump(bits->data, bits->end_data - bits->data);
-        parse_vui(bits, &(sps->vui));
+        return 1;
     }
 
-    sps->width = 16 * (sps->pic_width_in_mbs_minus_1 + 1);
+    sps->chroma_array_type = sps->separate_colour_plane_flag ? 0 :
+                             sps->chroma_format_idc;
+    /* SubWidthC and SubHeightC, Table 6-1 */
+    crop_unit_x = 1;
+    crop_unit_y = 1;
+    if (sps->chroma_array_type == 1)
+    {
+        crop_unit_x = 2;
+        crop_unit_y = 2;
+    }
+    else if (sps->chroma_array_type == 2)
+    {
+        crop_unit_x = 2;
+    }
+    crop_unit_y *= 2 - sps->frame_mbs_only_flag;
+    sps->width = 16 * (sps->pic_width_in_mbs_minus_1 + 1) -
+                 crop_unit_x * (sps->frame_crop_left_offset +
+                                sps->frame_crop_right_offset);
     sps->height = 16 * (2 - sps->frame_mbs_only_flag) *
-                  (sps->pic_height_in_map_units_minus_1 + 1);
+                  (sps->pic_height_in_map_units_minus_1 + 1) -
+                  crop_unit_y * (sps->frame_crop_top_offset +
+                                 sps->frame_crop_bottom_offset);
 
     return 0;
 }
+
+static int
+write_hrd(struct wbits_t* wbits, const struct hrd_t* hrd)
+{
+    int index;
+
+    if ((hrd->cpb_cnt_minus1 < 0) || (hrd->cpb_cnt_minus1 > 31))
+    {
+        return 1;
+    }
+    put_ueint(wbits, hrd->cpb_cnt_minus1);
+    put_uint(wbits, hrd->bit_rate_scale, 4);
+    put_uint(wbits, hrd->cpb_size_scale, 4);
+    for (index = 0; index <= hrd->cpb_cnt_minus1; index++)
+    {
+        put_ueint(wbits, hrd->bit_rate_value_minus1[index]);
+        put_ueint(wbits, hrd->cpb_size_value_minus1[index]);
+        put_uint(wbits, hrd->cbr_flag[index], 1);
+    }
+    put_uint(wbits, hrd->initial_cpb_removal_delay_length_minus1, 5);
+    put_uint(wbits, hrd->cpb_removal_delay_length_minus1, 5);
+    put_uint(wbits, hrd->dpb_output_delay_length_minus1, 5);
+    put_uint(wbits, hrd->time_offset_length, 5);
+    return 0;
+}
+
+static int
+write_vui(struct wbits_t* wbits, const struct vui_t* vui)
+{
+    put_uint(wbits, vui->aspect_ratio_info_present_flag, 1);
+    if (vui->aspect_ratio_info_present_flag)
+    {
+        put_uint(wbits, vui->aspect_ratio_idc, 8);
+        if (vui->aspect_ratio_idc == 255)
+        {
+            put_uint(wbits, vui->sar_width, 16);
+            put_uint(wbits, vui->sar_height, 16);
+        }
+    }
+
+    put_uint(wbits, vui->overscan_info_present_flag, 1);
+    if (vui->overscan_info_present_flag)
+    {
+        put_uint(wbits, vui->overscan_appropriate_flag, 1);
+    }
+
+    put_uint(wbits, vui->video_signal_type_present_flag, 1);
+    if (vui->video_signal_type_present_flag)
+    {
+        put_uint(wbits, vui->video_format, 3);
+        put_uint(wbits, vui->video_full_range_flag, 1);
+        put_uint(wbits, vui->colour_description_present_flag, 1);
+        if (vui->colour_description_present_flag)
+        {
+            put_uint(wbits, vui->colour_primaries, 8);
+            put_uint(wbits, vui->transfer_characteristics, 8);
+            put_uint(wbits, vui->matrix_coefficients, 8);
+        }
+    }
+
+    put_uint(wbits, vui->chroma_loc_info_present_flag, 1);
+    if (vui->chroma_loc_info_present_flag)
+    {
+        put_ueint(wbits, vui->chroma_sample_loc_type_top_field);
+        put_ueint(wbits, vui->chroma_sample_loc_type_bottom_field);
+    }
+
+    put_uint(wbits, vui->timing_info_present_flag, 1);
+    if (vui->timing_info_present_flag)
+    {
+        put_uint(wbits, vui->num_units_in_tick, 32);
+        put_uint(wbits, vui->time_scale, 32);
+        put_uint(wbits, vui->fixed_frame_rate_flag, 1);
+    }
+
+    put_uint(wbits, vui->nal_hrd_parameters_present_flag, 1);
+    if (vui->nal_hrd_parameters_present_flag &&
+        (write_hrd(wbits, &(vui->nal_hrd_parameters)) != 0))
+    {
+        return 1;
+    }
+    put_uint(wbits, vui->vcl_hrd_parameters_present_flag, 1);
+    if (vui->vcl_hrd_parameters_present_flag &&
+        (write_hrd(wbits, &(vui->vcl_hrd_parameters)) != 0))
+    {
+        return 1;
+    }
+    if (vui->nal_hrd_parameters_present_flag ||
+        vui->vcl_hrd_parameters_present_flag)
+    {
+        put_uint(wbits, vui->low_delay_hrd_flag, 1);
+    }
+
+    put_uint(wbits, vui->pic_struct_present_flag, 1);
+
+    put_uint(wbits, vui->bitstream_restriction_flag, 1);
+    if (vui->bitstream_restriction_flag)
+    {
+        put_uint(wbits, vui->motion_vectors_over_pic_boundaries_flag, 1);
+        put_ueint(wbits, vui->max_bytes_per_pic_denom);
+        put_ueint(wbits, vui->max_bits_per_mb_denom);
+        put_ueint(wbits, vui->log2_max_mv_length_horizontal);
+        put_ueint(wbits, vui->log2_max_mv_length_vertical);
+        put_ueint(wbits, vui->num_reorder_frames);
+        put_ueint(wbits, vui->max_dec_frame_buffering);
+    }
+    return 0;
+}
+
+/* the whole rbsp of sps with its nal header and rbsp_trailing_bits, the
+   scaling lists are copied from rbsp, the one sps was parsed from, so it
+   can be NULL without seq_scaling_matrix_present_flag
+   parse_sps then write_sps gives back the same rbsp
+   returns 0 or 1 on a value that cannot be written */
+int
+write_sps(struct wbits_t* wbits, const struct sps_t* sps, const char* rbsp)
+{
+    int index;
+
+    if ((sps->pic_order_cnt_type == 1) &&
+        ((sps->num_ref_frames_in_pic_order_cnt_cycle < 0) ||
+         (sps->num_ref_frames_in_pic_order_cnt_cycle > 255)))
+    {
+        return 1;
+    }
+    put_uint(wbits, sps->forbidden_zero_bit, 1);
+    put_uint(wbits, sps->nal_ref_idc, 2);
+    put_uint(wbits, sps->nal_unit_type, 5);
+    put_uint(wbits, sps->profile_idc, 8);
+    put_uint(wbits, sps->constraint_set0_flag, 1);
+    put_uint(wbits, sps->constraint_set1_flag, 1);
+    put_uint(wbits, sps->constraint_set2_flag, 1);
+    put_uint(wbits, sps->constraint_set3_flag, 1);
+    put_uint(wbits, sps->reserved_zero_4bits, 4);
+    put_uint(wbits, sps->level_idc, 8);
+    put_ueint(wbits, sps->seq_parameter_set_id);
+    if (sps_high_profile(sps->profile_idc))
+    {
+        put_ueint(wbits, sps->chroma_format_idc);
+        if (sps->chroma_format_idc == 3)
+        {
+            put_uint(wbits, sps->separate_colour_plane_flag, 1);
+        }
+        put_ueint(wbits, sps->bit_depth_luma_minus8);
+        put_ueint(wbits, sps->bit_depth_chroma_minus8);
+        put_uint(wbits, sps->qpprime_y_zero_transform_bypass_flag, 1);
+        put_uint(wbits, sps->seq_scaling_matrix_present_flag, 1);
+        if (sps->seq_scaling_matrix_present_flag)
+        {
+            if (rbsp == NULL)
+            {
+                return 1;
+            }
+            wbits_copy(wbits, rbsp, sps->scaling_matrix_bit_offset,
+                       sps->scaling_matrix_bits);
+        }
+    }
+    put_ueint(wbits, sps->log2_max_frame_num_minus4);
+    put_ueint(wbits, sps->pic_order_cnt_type);
+    if (sps->pic_order_cnt_type == 0)
+    {
+        put_ueint(wbits, sps->log2_max_pic_order_cnt_lsb_minus4);
+    }
+    else if (sps->pic_order_cnt_type == 1)
+    {
+        put_uint(wbits, sps->delta_pic_order_always_zero_flag, 1);
+        put_seint(wbits, sps->offset_for_non_ref_pic);
+        put_seint(wbits, sps->offset_for_top_to_bottom_field);
+        put_ueint(wbits, sps->num_ref_frames_in_pic_order_cnt_cycle);
+        for (index = 0; index < sps->num_ref_frames_in_pic_order_cnt_cycle;
+             index++)
+        {
+            put_seint(wbits, sps->offset_for_ref_frame[index]);
+        }
+    }
+    put_ueint(wbits, sps->num_ref_frames);
+    put_uint(wbits, sps->gaps_in_frame_num_value_allowed_flag, 1);
+    put_ueint(wbits, sps->pic_width_in_mbs_minus_1);
+    put_ueint(wbits, sps->pic_height_in_map_units_minus_1);
+    put_uint(wbits, sps->frame_mbs_only_flag, 1);
+    if (!sps->frame_mbs_only_flag)
+    {
+        put_uint(wbits, sps->mb_adaptive_frame_field_flag, 1);
+    }
+    put_uint(wbits, sps->direct_8x8_inference_flag, 1);
+    put_uint(wbits, sps->frame_cropping_flag, 1);
+    if (sps->frame_cropping_flag)
+    {
+        put_ueint(wbits, sps->frame_crop_left_offset);
+        put_ueint(wbits, sps->frame_crop_right_offset);
+        put_ueint(wbits, sps->frame_crop_top_offset);
+        put_ueint(wbits, sps->frame_crop_bottom_offset);
+    }
+    put_uint(wbits, sps->vui_prameters_present_flag, 1);
+    if (sps->vui_prameters_present_flag &&
+        (write_vui(wbits, &(sps->vui)) != 0))
+    {
+        return 1;
+    }
+    put_trailing_bits(wbits);
+    return wbits->error;
+}
+
+/* count lists of a scaling matrix at the read position, with fall-back
+   rule A when fall_back is NULL, else rule B from the lists in it */
+int
+parse_scaling_matrix(struct bits_t* bits, int count,
+                     const struct scaling_matrix_t* fall_back,
+                     struct scaling_matrix_t* matrix)
+{
+    int index;
+    int size;
+    int intra;
+    unsigned char* list;
+    const unsigned char* prev;
+    const unsigned char* first;
+    const unsigned char* dflt;
+
+    for (index = 0; index < 12; index++)
+    {
+        /* lists 0 to 2 and 6, 8, 10 are intra */
+        intra = index < 6 ? index < 3 : (index & 1) == 0;
+        if (index < 6)
+        {
+            size = 16;
+            list = matrix->list_4x4[index];
+            prev = index > 0 ? matrix->list_4x4[index - 1] : NULL;
+            dflt = g_default_4x4[intra ? 0 : 1];
+            first = dflt;
+            if (fall_back != NULL)
+            {
+                first = fall_back->list_4x4[index];
+            }
+        }
+        else
+        {
+            size = 64;
+            list = matrix->list_8x8[index - 6];
+            prev = index > 7 ? matrix->list_8x8[index - 8] : NULL;
+            dflt = g_default_8x8[intra ? 0 : 1];
+            first = dflt;
+            if (fall_back != NULL)
+            {
+                first = fall_back->list_8x8[index - 6];
+            }
+        }
+        if ((index < count) && in_uint(bits, 1))
+        {
+            if (parse_scaling_list(bits, list, size))
+            {
+                memcpy(list, dflt, size);
+            }
+            continue;
+        }
+        /* the first list of each kind falls back to first, the others
+           to the list before of the same kind */
+        if ((index == 0) || (index == 3) || (index == 6) || (index == 7))
+        {
+            memcpy(list, first, size);
+        }
+        else
+        {
+            memcpy(list, prev, size);
+        }
+    }
+    return bits->error;
+}
+
+/* decode the lists parse_sps walked, bits is set up again on the same
+   nal and not read yet, Flat_16 when the sps has none
+   returns 0 or 1 when the lists do not read back */
+int
+parse_sps_scaling_matrix(struct bits_t* bits, const struct sps_t* sps,
+                         struct scaling_matrix_t* matrix)
+{
+    memset(matrix, 16, sizeof(struct scaling_matrix_t));
+    if (!sps->seq_scaling_matrix_present_flag)
+    {
+        return 0;
+    }
+    bits_skip(bits, sps->scaling_matrix_bit_offset);
+    return parse_scaling_matrix(bits, sps->chroma_format_idc != 3 ? 8 : 12,
+                                NULL, matrix);
+}
@@ -34,8 +34,8 @@ struct vui_t
     int chroma_sample_loc_type_top_field;       /* ue(v) */
     int chroma_sample_loc_type_bottom_field;    /* ue(v) */
     int timing_info_present_flag;               /* u(1) */
-    int num_units_in_tick;                      /* u(32) */
-    int time_scale;                             /* u(32) */
+    unsigned int num_units_in_tick;             /* u(32) */
+    unsigned int time_scale;                    /* u(32) */
     int fixed_frame_rate_flag;                  /* u(1) */
     int nal_hrd_parameters_present_flag;        /* u(1) */
     struct hrd_t nal_hrd_parameters;
@@ -66,6 +66,19 @@ struct sps_t
     int reserved_zero_4bits;                    /* u(4) */
     int level_idc;                              /* u(8) */
     int seq_parameter_set_id;                   /* ue(v) */
+    int chroma_format_idc;                      /* ue(v) */
+    int separate_colour_plane_flag;             /* u(1) */
+    int bit_depth_luma_minus8;                  /* ue(v) */
+    int bit_depth_chroma_minus8;                /* ue(v) */
+    int qpprime_y_zero_transform_bypass_flag;   /* u(1) */
+    int seq_scaling_matrix_present_flag;        /* u(1) */
+    int seq_scaling_list_present_flag;          /* u(1), bit i for list i */
+    int use_default_scaling_matrix_flag;        /* bit i for list i */
+    int scaling_matrix_bit_offset;              /* of the first
+                                                   seq_scaling_list_present_
+                                                   flag in the rbsp */
+    int scaling_matrix_bits;                    /* from there to the end
+                                                   of the last list */
     int log2_max_frame_num_minus4;              /* ue(v) */
     int pic_order_cnt_type;                     /* ue(v) */
     int log2_max_pic_order_cnt_lsb_minus4;      /* ue(v) */
@@ -73,6 +86,7 @@ struct sps_t
     int offset_for_non_ref_pic;                 /* se(v) */
     int offset_for_top_to_bottom_field;         /* se(v) */
     int num_ref_frames_in_pic_order_cnt_cycle;  /* ue(v) */
+    int offset_for_ref_frame[256];              /* se(v) */
     int num_ref_frames;                         /* ue(v) */
     int gaps_in_frame_num_value_allowed_flag;   /* u(1) */
     int pic_width_in_mbs_minus_1;               /* ue(v) */
@@ -89,33 +103,38 @@ struct sps_t
 
     struct vui_t vui;
 
-    int width;
+    int chroma_array_type;
+    int width;                                  /* cropped */
     int height;
 };
 
-// // IDR Sub
-// struct IDR_SubFunction__Dec_Ref_Pic_Marking
-// {
-//     public int no_output_of_prior_pics_flag;
-//     public int long_term_reference_flag;
-// };
+/* the 6 4x4 and 6 8x8 lists in the order they are sent, zigzag, with
+   the fall-back rules applied so every list is filled */
+struct scaling_matrix_t
+{
+    unsigned char list_4x4[6][16];
+    unsigned char list_8x8[6][64];
+};
 
-// struct idr_t
-// {
-//     int first_mb_in_slice;
-//     int slice_type;
-//     int pic_parameter_set_id;
-//     int frame_num;
-//     int field_pic_flag;
-//     int bottom_field_flag;
-//     int idr_pic_id;
-//     int pic_order_cnt_lsb;
-//     int delta_pic_order_cnt_bottom;
-//     int slice_qp_delta;
-//     struct IDR_SubFunction__Dec_Ref_Pic_Marking dec_ref_pic_marking;
-// };
+struct bits_t;
+struct wbits_t;
 
+int
+parse_scaling_list(struct bits_t* bits, unsigned char* list, int size);
+int
+parse_scaling_matrix(struct bits_t* bits, int count,
+                     const struct scaling_matrix_t* fall_back,
+                     struct scaling_matrix_t* matrix);
+int
+sps_high_profile(int profile_idc);
+int
+parse_sps_high_profile(struct bits_t* bits, struct sps_t* sps);
 int
 parse_sps(struct bits_t* bits, struct sps_t* sps);
+int
+write_sps(struct wbits_t* wbits, const struct sps_t* sps, const char* rbsp);
+int
+parse_sps_scaling_matrix(struct bits_t* bits, const struct sps_t* sps,
+                         struct scaling_matrix_t* matrix);
 
 #endif
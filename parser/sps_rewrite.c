@@ -0,0 +1,819 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+
+#include "bits.h"
+#include "sps.h"
+#include "utils.h"
+#include "sps_rewrite.h"
+
+/* field kinds */
+#define SPS_FIELD_UINT      0   /* u(bits) */
+#define SPS_FIELD_UEINT     1
+#define SPS_FIELD_SEINT     2
+#define SPS_FIELD_GROUP     3   /* offset is its present flag */
+
+/* when a field outside a group is sent, a rule on one that is not sent
+   in an sps leaves that sps as it was */
+#define SPS_SENT_ALWAYS     0
+#define SPS_SENT_HIGH       1   /* sps_high_profile */
+#define SPS_SENT_444        2   /* and chroma_format_idc 3 */
+#define SPS_SENT_POC0       3   /* pic_order_cnt_type 0 */
+#define SPS_SENT_POC1       4   /* pic_order_cnt_type 1, an array entry
+                                   below the cycle length */
+#define SPS_SENT_FIELDS     5   /* frame_mbs_only_flag 0 */
+#define SPS_SENT_HRD        6   /* nal or vcl hrd */
+#define SPS_SENT_SAR        7   /* aspect_ratio_idc 255, Extended_SAR */
+#define SPS_SENT_NAL_CPB    8   /* an entry up to the nal cpb_cnt_minus1 */
+#define SPS_SENT_VCL_CPB    9   /* an entry up to the vcl cpb_cnt_minus1 */
+
+/* def of num_reorder_frames and max_dec_frame_buffering, what a
+   decoder infers without them */
+#define SPS_DEF_MAX_DPB     -1
+
+/* a field a rule can name, parent is the group it is sent in, NULL for
+   the top of the sps */
+struct sps_field_t
+{
+    const char* name;
+    const char* flag_name;  /* of a group */
+    const char* parent;
+    int kind;
+    int bits;
+    int offset;             /* into sps_t */
+    int count;              /* entries of an array */
+    long long max;          /* ue(v), 0 for INT_MAX */
+    int def;                /* when the group is added */
+    int sent;               /* SPS_SENT_ */
+};
+
+#define SPS_OFF(_member) ((int)offsetof(struct sps_t, _member))
+
+#define F_U(_name, _parent, _member, _bits, _def) \
+    { _name, NULL, _parent, SPS_FIELD_UINT, _bits, SPS_OFF(_member), 1, 0, \
+      _def }
+#define F_UE(_name, _parent, _member, _max, _def) \
+    { _name, NULL, _parent, SPS_FIELD_UEINT, 0, SPS_OFF(_member), 1, _max, \
+      _def }
+#define F_SE(_name, _parent, _member) \
+    { _name, NULL, _parent, SPS_FIELD_SEINT, 0, SPS_OFF(_member), 1, 0, 0 }
+#define F_ARRAY_U_IF(_name, _parent, _member, _bits, _count, _sent) \
+    { _name, NULL, _parent, SPS_FIELD_UINT, _bits, SPS_OFF(_member), \
+      _count, 0, 0, _sent }
+#define F_ARRAY_UE_IF(_name, _parent, _member, _count, _sent) \
+    { _name, NULL, _parent, SPS_FIELD_UEINT, 0, SPS_OFF(_member), _count, \
+      0, 0, _sent }
+#define F_U_IF(_name, _parent, _member, _bits, _sent) \
+    { _name, NULL, _parent, SPS_FIELD_UINT, _bits, SPS_OFF(_member), 1, 0, \
+      0, _sent }
+#define F_UE_IF(_name, _member, _max, _sent) \
+    { _name, NULL, NULL, SPS_FIELD_UEINT, 0, SPS_OFF(_member), 1, _max, 0, \
+      _sent }
+#define F_SE_IF(_name, _member, _sent) \
+    { _name, NULL, NULL, SPS_FIELD_SEINT, 0, SPS_OFF(_member), 1, 0, 0, \
+      _sent }
+#define F_ARRAY_SE_IF(_name, _member, _count, _sent) \
+    { _name, NULL, NULL, SPS_FIELD_SEINT, 0, SPS_OFF(_member), _count, 0, 0, \
+      _sent }
+#define F_GROUP(_name, _flag_name, _parent, _member) \
+    { _name, _flag_name, _parent, SPS_FIELD_GROUP, 1, SPS_OFF(_member), 1, \
+      0, 0 }
+
+/* defaults from Annex E, the delay lengths are the inferred 24 bits */
+#define F_HRD(_group, _member, _cpb_sent) \
+    F_UE(_group ".cpb_cnt_minus1", _group, \
+         vui._member.cpb_cnt_minus1, 31, 0), \
+    F_U(_group ".bit_rate_scale", _group, vui._member.bit_rate_scale, 4, 0), \
+    F_U(_group ".cpb_size_scale", _group, vui._member.cpb_size_scale, 4, 0), \
+    F_ARRAY_UE_IF(_group ".bit_rate_value_minus1", _group, \
+                  vui._member.bit_rate_value_minus1, 32, _cpb_sent), \
+    F_ARRAY_UE_IF(_group ".cpb_size_value_minus1", _group, \
+                  vui._member.cpb_size_value_minus1, 32, _cpb_sent), \
+    F_ARRAY_U_IF(_group ".cbr_flag", _group, vui._member.cbr_flag, 1, 32, \
+                 _cpb_sent), \
+    F_U(_group ".initial_cpb_removal_delay_length_minus1", _group, \
+        vui._member.initial_cpb_removal_delay_length_minus1, 5, 23), \
+    F_U(_group ".cpb_removal_delay_length_minus1", _group, \
+        vui._member.cpb_removal_delay_length_minus1, 5, 23), \
+    F_U(_group ".dpb_output_delay_length_minus1", _group, \
+        vui._member.dpb_output_delay_length_minus1, 5, 23), \
+    F_U(_group ".time_offset_length", _group, \
+        vui._member.time_offset_length, 5, 24)
+
+/* in the order they are sent */
+static const struct sps_field_t g_sps_fields[] =
+{
+    F_U("profile_idc", NULL, profile_idc, 8, 0),
+    F_U("constraint_set0_flag", NULL, constraint_set0_flag, 1, 0),
+    F_U("constraint_set1_flag", NULL, constraint_set1_flag, 1, 0),
+    F_U("constraint_set2_flag", NULL, constraint_set2_flag, 1, 0),
+    F_U("constraint_set3_flag", NULL, constraint_set3_flag, 1, 0),
+    F_U("reserved_zero_4bits", NULL, reserved_zero_4bits, 4, 0),
+    F_U("level_idc", NULL, level_idc, 8, 0),
+    F_UE("seq_parameter_set_id", NULL, seq_parameter_set_id, 31, 0),
+    F_UE_IF("chroma_format_idc", chroma_format_idc, 3, SPS_SENT_HIGH),
+    F_U_IF("separate_colour_plane_flag", NULL, separate_colour_plane_flag, 1,
+           SPS_SENT_444),
+    F_UE_IF("bit_depth_luma_minus8", bit_depth_luma_minus8, 6,
+            SPS_SENT_HIGH),
+    F_UE_IF("bit_depth_chroma_minus8", bit_depth_chroma_minus8, 6,
+            SPS_SENT_HIGH),
+    F_U_IF("qpprime_y_zero_transform_bypass_flag", NULL,
+           qpprime_y_zero_transform_bypass_flag, 1, SPS_SENT_HIGH),
+    F_UE("log2_max_frame_num_minus4", NULL, log2_max_frame_num_minus4, 12,
+         0),
+    F_UE("pic_order_cnt_type", NULL, pic_order_cnt_type, 2, 0),
+    F_UE_IF("log2_max_pic_order_cnt_lsb_minus4",
+            log2_max_pic_order_cnt_lsb_minus4, 12, SPS_SENT_POC0),
+    F_U_IF("delta_pic_order_always_zero_flag", NULL,
+           delta_pic_order_always_zero_flag, 1, SPS_SENT_POC1),
+    F_SE_IF("offset_for_non_ref_pic", offset_for_non_ref_pic, SPS_SENT_POC1),
+    F_SE_IF("offset_for_top_to_bottom_field", offset_for_top_to_bottom_field,
+            SPS_SENT_POC1),
+    F_UE_IF("num_ref_frames_in_pic_order_cnt_cycle",
+            num_ref_frames_in_pic_order_cnt_cycle, 255, SPS_SENT_POC1),
+    F_ARRAY_SE_IF("offset_for_ref_frame", offset_for_ref_frame, 255,
+                  SPS_SENT_POC1),
+    F_UE("num_ref_frames", NULL, num_ref_frames, 0, 0),
+    F_U("gaps_in_frame_num_value_allowed_flag", NULL,
+        gaps_in_frame_num_value_allowed_flag, 1, 0),
+    F_UE("pic_width_in_mbs_minus_1", NULL, pic_width_in_mbs_minus_1, 0, 0),
+    F_UE("pic_height_in_map_units_minus_1", NULL,
+         pic_height_in_map_units_minus_1, 0, 0),
+    F_U("frame_mbs_only_flag", NULL, frame_mbs_only_flag, 1, 0),
+    F_U_IF("mb_adaptive_frame_field_flag", NULL, mb_adaptive_frame_field_flag,
+           1, SPS_SENT_FIELDS),
+    F_U("direct_8x8_inference_flag", NULL, direct_8x8_inference_flag, 1, 0),
+    F_GROUP("frame_cropping", "frame_cropping_flag", NULL,
+            frame_cropping_flag),
+    F_UE("frame_crop_left_offset", "frame_cropping", frame_crop_left_offset,
+         0, 0),
+    F_UE("frame_crop_right_offset", "frame_cropping",
+         frame_crop_right_offset, 0, 0),
+    F_UE("frame_crop_top_offset", "frame_cropping", frame_crop_top_offset,
+         0, 0),
+    F_UE("frame_crop_bottom_offset", "frame_cropping",
+         frame_crop_bottom_offset, 0, 0),
+    F_GROUP("vui", "vui_parameters_present_flag", NULL,
+            vui_prameters_present_flag),
+
+    F_GROUP("vui.aspect_ratio_info", "vui.aspect_ratio_info_present_flag",
+            "vui", vui.aspect_ratio_info_present_flag),
+    F_U("vui.aspect_ratio_idc", "vui.aspect_ratio_info",
+        vui.aspect_ratio_idc, 8, 0),
+    F_U_IF("vui.sar_width", "vui.aspect_ratio_info", vui.sar_width, 16,
+           SPS_SENT_SAR),
+    F_U_IF("vui.sar_height", "vui.aspect_ratio_info", vui.sar_height, 16,
+           SPS_SENT_SAR),
+    F_GROUP("vui.overscan_info", "vui.overscan_info_present_flag", "vui",
+            vui.overscan_info_present_flag),
+    F_U("vui.overscan_appropriate_flag", "vui.overscan_info",
+        vui.overscan_appropriate_flag, 1, 0),
+    F_GROUP("vui.video_signal_type", "vui.video_signal_type_present_flag",
+            "vui", vui.video_signal_type_present_flag),
+    F_U("vui.video_format", "vui.video_signal_type", vui.video_format, 3, 5),
+    F_U("vui.video_full_range_flag", "vui.video_signal_type",
+        vui.video_full_range_flag, 1, 0),
+    F_GROUP("vui.colour_description", "vui.colour_description_present_flag",
+            "vui.video_signal_type", vui.colour_description_present_flag),
+    F_U("vui.colour_primaries", "vui.colour_description",
+        vui.colour_primaries, 8, 2),
+    F_U("vui.transfer_characteristics", "vui.colour_description",
+        vui.transfer_characteristics, 8, 2),
+    F_U("vui.matrix_coefficients", "vui.colour_description",
+        vui.matrix_coefficients, 8, 2),
+    F_GROUP("vui.chroma_loc_info", "vui.chroma_loc_info_present_flag", "vui",
+            vui.chroma_loc_info_present_flag),
+    F_UE("vui.chroma_sample_loc_type_top_field", "vui.chroma_loc_info",
+         vui.chroma_sample_loc_type_top_field, 5, 0),
+    F_UE("vui.chroma_sample_loc_type_bottom_field", "vui.chroma_loc_info",
+         vui.chroma_sample_loc_type_bottom_field, 5, 0),
+    F_GROUP("vui.timing_info", "vui.timing_info_present_flag", "vui",
+            vui.timing_info_present_flag),
+    F_U("vui.num_units_in_tick", "vui.timing_info", vui.num_units_in_tick,
+        32, 0),
+    F_U("vui.time_scale", "vui.timing_info", vui.time_scale, 32, 0),
+    F_U("vui.fixed_frame_rate_flag", "vui.timing_info",
+        vui.fixed_frame_rate_flag, 1, 0),
+    F_GROUP("vui.nal_hrd", "vui.nal_hrd_parameters_present_flag", "vui",
+            vui.nal_hrd_parameters_present_flag),
+    F_HRD("vui.nal_hrd", nal_hrd_parameters, SPS_SENT_NAL_CPB),
+    F_GROUP("vui.vcl_hrd", "vui.vcl_hrd_parameters_present_flag", "vui",
+            vui.vcl_hrd_parameters_present_flag),
+    F_HRD("vui.vcl_hrd", vcl_hrd_parameters, SPS_SENT_VCL_CPB),
+    F_U_IF("vui.low_delay_hrd_flag", "vui", vui.low_delay_hrd_flag, 1,
+           SPS_SENT_HRD),
+    F_U("vui.pic_struct_present_flag", "vui", vui.pic_struct_present_flag,
+        1, 0),
+    F_GROUP("vui.bitstream_restriction", "vui.bitstream_restriction_flag",
+            "vui", vui.bitstream_restriction_flag),
+    F_U("vui.motion_vectors_over_pic_boundaries_flag",
+        "vui.bitstream_restriction",
+        vui.motion_vectors_over_pic_boundaries_flag, 1, 1),
+    F_UE("vui.max_bytes_per_pic_denom", "vui.bitstream_restriction",
+         vui.max_bytes_per_pic_denom, 16, 2),
+    F_UE("vui.max_bits_per_mb_denom", "vui.bitstream_restriction",
+         vui.max_bits_per_mb_denom, 16, 1),
+    F_UE("vui.log2_max_mv_length_horizontal", "vui.bitstream_restriction",
+         vui.log2_max_mv_length_horizontal, 16, 16),
+    F_UE("vui.log2_max_mv_length_vertical", "vui.bitstream_restriction",
+         vui.log2_max_mv_length_vertical, 16, 16),
+    F_UE("vui.num_reorder_frames", "vui.bitstream_restriction",
+         vui.num_reorder_frames, 16, SPS_DEF_MAX_DPB),
+    F_UE("vui.max_dec_frame_buffering", "vui.bitstream_restriction",
+         vui.max_dec_frame_buffering, 16, SPS_DEF_MAX_DPB)
+};
+
+#define SPS_NUM_FIELDS ((int)(sizeof(g_sps_fields) / sizeof(g_sps_fields[0])))
+
+/* by name or, for a group, the name of its present flag
+   returns the index or -1 */
+static int
+sps_field_find(const char* name, int name_bytes, int* by_flag)
+{
+    int index;
+    const struct sps_field_t* field;
+
+    for (index = 0; index < SPS_NUM_FIELDS; index++)
+    {
+        field = g_sps_fields + index;
+        if ((strncmp(field->name, name, name_bytes) == 0) &&
+            (field->name[name_bytes] == 0))
+        {
+            *by_flag = 0;
+            return index;
+        }
+        if ((field->flag_name != NULL) &&
+            (strncmp(field->flag_name, name, name_bytes) == 0) &&
+            (field->flag_name[name_bytes] == 0))
+        {
+            *by_flag = 1;
+            return index;
+        }
+    }
+    return -1;
+}
+
+static int
+sps_field_parent(int field)
+{
+    int by_flag;
+    const char* parent;
+
+    parent = g_sps_fields[field].parent;
+    if (parent == NULL)
+    {
+        return -1;
+    }
+    return sps_field_find(parent, strlen(parent), &by_flag);
+}
+
+/* the fields of a group in the order they are sent, groups in it are
+   left out when skip_groups is set
+   returns the number of them */
+static int
+sps_group_members(int group, int* members, int max_members,
+                  int skip_groups)
+{
+    int index;
+    int count;
+    const char* name;
+    const struct sps_field_t* field;
+
+    count = 0;
+    name = g_sps_fields[group].name;
+    for (index = 0; index < SPS_NUM_FIELDS; index++)
+    {
+        field = g_sps_fields + index;
+        if ((field->parent == NULL) || (strcmp(field->parent, name) != 0) ||
+            (skip_groups && (field->kind == SPS_FIELD_GROUP)))
+        {
+            continue;
+        }
+        if (count < max_members)
+        {
+            members[count] = index;
+        }
+        count++;
+    }
+    return count;
+}
+
+static int
+sps_field_check(int field, long long val)
+{
+    long long max;
+    const struct sps_field_t* info;
+
+    info = g_sps_fields + field;
+    switch (info->kind)
+    {
+        case SPS_FIELD_UINT:
+        case SPS_FIELD_GROUP:
+            max = (1ll << info->bits) - 1;
+            break;
+        case SPS_FIELD_UEINT:
+            max = info->max > 0 ? info->max : INT_MAX;
+            break;
+        default:
+            return (val < -INT_MAX) || (val > INT_MAX);
+    }
+    return (val < 0) || (val > max);
+}
+
+/* one rule from text, *text is moved past it
+   returns 0 or 1 on a bad rule */
+static int
+sps_rule_parse(const char** text, struct sps_rule_t* rule)
+{
+    int index;
+    int remove;
+    int by_flag;
+    int num_members;
+    int members[SPS_REWRITE_MAX_VALS];
+    const char* name;
+    const char* end;
+    char* num_end;
+    const struct sps_field_t* field;
+
+    memset(rule, 0, sizeof(struct sps_rule_t));
+    rule->index = -1;
+    remove = **text == '-';
+    name = *text + remove;
+    end = name;
+    while (((*end >= 'a') && (*end <= 'z')) ||
+           ((*end >= '0') && (*end <= '9')) || (*end == '_') || (*end == '.'))
+    {
+        end++;
+    }
+    rule->field = sps_field_find(name, end - name, &by_flag);
+    *text = end;
+    if (rule->field < 0)
+    {
+        return 1;
+    }
+    field = g_sps_fields + rule->field;
+    if (**text == '[')
+    {
+        rule->index = strtol(*text + 1, &num_end, 10);
+        if ((num_end == *text + 1) || (*num_end != ']') ||
+            (rule->index < 0) || (rule->index >= field->count))
+        {
+            return 1;
+        }
+        *text = num_end + 1;
+    }
+    while (**text == ' ')
+    {
+        (*text)++;
+    }
+    if (remove)
+    {
+        rule->op = SPS_RULE_REMOVE;
+        return field->kind != SPS_FIELD_GROUP;
+    }
+    if (**text != '=')
+    {
+        return 1;
+    }
+    do
+    {
+        (*text)++;
+        if (rule->num_vals >= SPS_REWRITE_MAX_VALS)
+        {
+            return 1;
+        }
+        rule->vals[rule->num_vals] = strtoll(*text, &num_end, 0);
+        if (num_end == *text)
+        {
+            return 1;
+        }
+        rule->num_vals++;
+        *text = num_end;
+        while (**text == ' ')
+        {
+            (*text)++;
+        }
+    } while (**text == ':');
+
+    if (field->kind != SPS_FIELD_GROUP)
+    {
+        rule->op = SPS_RULE_SET;
+        return (rule->num_vals != 1) ||
+               sps_field_check(rule->field, rule->vals[0]);
+    }
+    if (by_flag)
+    {
+        if ((rule->num_vals != 1) || (rule->vals[0] < 0) ||
+            (rule->vals[0] > 1))
+        {
+            return 1;
+        }
+        rule->op = rule->vals[0] ? SPS_RULE_ADD : SPS_RULE_REMOVE;
+        rule->num_vals = 0;
+        return 0;
+    }
+    rule->op = SPS_RULE_ADD;
+    num_members = sps_group_members(rule->field, members,
+                                    SPS_REWRITE_MAX_VALS, 1);
+    if (rule->num_vals > num_members)
+    {
+        return 1;
+    }
+    for (index = 0; index < rule->num_vals; index++)
+    {
+        if (sps_field_check(members[index], rule->vals[index]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* rules is a comma list, see sps_rewrite_t, NULL for none
+   returns 0 or 1 on a bad rule, error_pos is where it starts */
+int
+sps_rewrite_init(struct sps_rewrite_t* rewrite, const char* rules)
+{
+    const char* text;
+
+    memset(rewrite, 0, sizeof(struct sps_rewrite_t));
+    if (wbits_init(&(rewrite->wbits), 256) != 0)
+    {
+        return 1;
+    }
+    text = rules;
+    while ((text != NULL) && (*text != 0))
+    {
+        while ((*text == ' ') || (*text == ','))
+        {
+            text++;
+        }
+        if (*text == 0)
+        {
+            break;
+        }
+        rewrite->error_pos = text - rules;
+        if ((rewrite->num_rules >= SPS_REWRITE_MAX_RULES) ||
+            (sps_rule_parse(&text,
+                            rewrite->rules + rewrite->num_rules) != 0) ||
+            ((*text != 0) && (*text != ',')))
+        {
+            return 1;
+        }
+        rewrite->num_rules++;
+    }
+    rewrite->error_pos = 0;
+    return 0;
+}
+
+int
+sps_rewrite_deinit(struct sps_rewrite_t* rewrite)
+{
+    int index;
+
+    for (index = 0; index < SPS_REWRITE_CACHE; index++)
+    {
+        free(rewrite->cache[index].in);
+        free(rewrite->cache[index].out);
+    }
+    free(rewrite->rbsp);
+    wbits_deinit(&(rewrite->wbits));
+    memset(rewrite, 0, sizeof(struct sps_rewrite_t));
+    return 0;
+}
+
+/* MaxDpbMbs from Table A-1, level 1b is 11 with constraint_set3_flag
+   below High profile */
+static int
+sps_max_dpb_mbs(const struct sps_t* sps)
+{
+    switch (sps->level_idc)
+    {
+        case 9: case 10: return 396;
+        case 11: return sps->constraint_set3_flag &&
+                        ((sps->profile_idc == 66) ||
+                         (sps->profile_idc == 77) ||
+                         (sps->profile_idc == 88)) ? 396 : 900;
+        case 12: case 13: case 20: return 2376;
+        case 21: return 4752;
+        case 22: case 30: return 8100;
+        case 31: return 18000;
+        case 32: return 20480;
+        case 40: case 41: return 32768;
+        case 42: return 34816;
+        case 50: return 110400;
+        case 51: case 52: return 184320;
+        case 60: case 61: case 62: return 696320;
+    }
+    return 0;
+}
+
+/* what num_reorder_frames and max_dec_frame_buffering are inferred as
+   without bitstream_restriction, E.2.1 */
+static int
+sps_inferred_dpb_frames(const struct sps_t* sps)
+{
+    int frames;
+    int frame_mbs;
+
+    switch (sps->profile_idc)
+    {
+        case 44: case 86: case 100: case 110: case 122: case 244:
+            if (sps->constraint_set3_flag)
+            {
+                return 0;
+            }
+    }
+    frame_mbs = (sps->pic_width_in_mbs_minus_1 + 1) *
+                (sps->pic_height_in_map_units_minus_1 + 1) *
+                (2 - sps->frame_mbs_only_flag);
+    frames = 16;
+    if ((sps_max_dpb_mbs(sps) > 0) && (frame_mbs > 0) &&
+        (sps_max_dpb_mbs(sps) / frame_mbs < frames))
+    {
+        frames = sps_max_dpb_mbs(sps) / frame_mbs;
+    }
+    return frames;
+}
+
+static int*
+sps_field_ptr(struct sps_t* sps, int field, int index)
+{
+    return (int*)((char*)sps + g_sps_fields[field].offset) + index;
+}
+
+/* set every entry of an array field, or only index */
+static void
+sps_field_set(struct sps_t* sps, int field, int index, long long val)
+{
+    int count;
+
+    if (index >= 0)
+    {
+        *sps_field_ptr(sps, field, index) = (int)val;
+        return;
+    }
+    for (count = 0; count < g_sps_fields[field].count; count++)
+    {
+        *sps_field_ptr(sps, field, count) = (int)val;
+    }
+}
+
+/* turn on the present flag of a group and the groups it is in, a group
+   that was off gets its defaults */
+static void
+sps_group_add(struct sps_t* sps, int group)
+{
+    int index;
+    int count;
+    int parent;
+    int val;
+    int members[64];
+
+    parent = sps_field_parent(group);
+    if (parent >= 0)
+    {
+        sps_group_add(sps, parent);
+    }
+    if (*sps_field_ptr(sps, group, 0))
+    {
+        return;
+    }
+    *sps_field_ptr(sps, group, 0) = 1;
+    count = sps_group_members(group, members, 64, 0);
+    for (index = 0; (index < count) && (index < 64); index++)
+    {
+        val = g_sps_fields[members[index]].def;
+        if (val == SPS_DEF_MAX_DPB)
+        {
+            val = sps_inferred_dpb_frames(sps);
+        }
+        sps_field_set(sps, members[index], -1, val);
+    }
+}
+
+/* whether write_sps sends entry index of field, -1 for any entry */
+static int
+sps_field_sent(const struct sps_t* sps, int field, int index)
+{
+    switch (g_sps_fields[field].sent)
+    {
+        case SPS_SENT_HIGH:
+            return sps_high_profile(sps->profile_idc);
+        case SPS_SENT_444:
+            return sps_high_profile(sps->profile_idc) &&
+                   (sps->chroma_format_idc == 3);
+        case SPS_SENT_POC0:
+            return sps->pic_order_cnt_type == 0;
+        case SPS_SENT_POC1:
+            return (sps->pic_order_cnt_type == 1) &&
+                   ((g_sps_fields[field].count == 1) ||
+                    (index < sps->num_ref_frames_in_pic_order_cnt_cycle));
+        case SPS_SENT_FIELDS:
+            return !sps->frame_mbs_only_flag;
+        case SPS_SENT_HRD:
+            return sps->vui.nal_hrd_parameters_present_flag ||
+                   sps->vui.vcl_hrd_parameters_present_flag;
+        case SPS_SENT_SAR:
+            return sps->vui.aspect_ratio_idc == 255;
+        case SPS_SENT_NAL_CPB:
+            return index <= sps->vui.nal_hrd_parameters.cpb_cnt_minus1;
+        case SPS_SENT_VCL_CPB:
+            return index <= sps->vui.vcl_hrd_parameters.cpb_cnt_minus1;
+    }
+    return 1;
+}
+
+/* returns 0 or 1 when the rule names a field this sps does not send */
+static int
+sps_rule_apply(struct sps_t* sps, const struct sps_rule_t* rule)
+{
+    int index;
+    int parent;
+    int members[SPS_REWRITE_MAX_VALS];
+
+    switch (rule->op)
+    {
+        case SPS_RULE_REMOVE:
+            *sps_field_ptr(sps, rule->field, 0) = 0;
+            break;
+        case SPS_RULE_ADD:
+            sps_group_add(sps, rule->field);
+            sps_group_members(rule->field, members, SPS_REWRITE_MAX_VALS, 1);
+            for (index = 0; index < rule->num_vals; index++)
+            {
+                if (!sps_field_sent(sps, members[index], 0))
+                {
+                    return 1;
+                }
+                sps_field_set(sps, members[index],
+                              g_sps_fields[members[index]].count > 1 ? 0 : -1,
+                              rule->vals[index]);
+            }
+            break;
+        default:
+            parent = sps_field_parent(rule->field);
+            if (parent >= 0)
+            {
+                sps_group_add(sps, parent);
+            }
+            if (!sps_field_sent(sps, rule->field, rule->index))
+            {
+                return 1;
+            }
+            /* the scaling lists are copied as they are, their count
+               depends on 4:4:4 */
+            if ((g_sps_fields[rule->field].offset ==
+                 SPS_OFF(chroma_format_idc)) &&
+                sps->seq_scaling_matrix_present_flag &&
+                ((sps->chroma_format_idc == 3) != (rule->vals[0] == 3)))
+            {
+                return 1;
+            }
+            sps_field_set(sps, rule->field, rule->index, rule->vals[0]);
+            break;
+    }
+    return 0;
+}
+
+/* rewrite the nal into entry->out
+   returns the bytes or -1 when it does not parse or cannot be written */
+static int
+sps_rewrite_run(struct sps_rewrite_t* rewrite, const char* nal, int bytes,
+                struct sps_rewrite_entry_t* entry)
+{
+    int index;
+    int nal_bytes;
+    int rbsp_bytes;
+    long long out_bytes;
+    char* data;
+    struct bits_t bits;
+    struct sps_t sps;
+    struct wbits_t* wbits;
+
+    if (bytes > rewrite->rbsp_alloc)
+    {
+        data = (char*)realloc(rewrite->rbsp, bytes);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        rewrite->rbsp = data;
+        rewrite->rbsp_alloc = bytes;
+    }
+    nal_bytes = bytes;
+    rbsp_bytes = rewrite->rbsp_alloc;
+    if (nal_to_rbsp(nal, &nal_bytes, rewrite->rbsp, &rbsp_bytes) < 0)
+    {
+        return -1;
+    }
+    bits_init(&bits, rewrite->rbsp, rbsp_bytes);
+    memset(&sps, 0, sizeof(sps));
+    if ((parse_sps(&bits, &sps) != 0) || bits.error ||
+        (sps.nal_unit_type != 7))
+    {
+        return -1;
+    }
+    for (index = 0; index < rewrite->num_rules; index++)
+    {
+        if (sps_rule_apply(&sps, rewrite->rules + index) != 0)
+        {
+            rewrite->rejected++;
+            return -1;
+        }
+    }
+
+    wbits = &(rewrite->wbits);
+    wbits->offset = 0;
+    wbits->acc = 0;
+    wbits->acc_bits = 0;
+    if (write_sps(wbits, &sps, rewrite->rbsp) != 0)
+    {
+        return -1;
+    }
+    out_bytes = wbits_flush(wbits);
+    if (wbits->error)
+    {
+        return -1;
+    }
+    nal_bytes = rbsp_to_nal_max(out_bytes);
+    if (nal_bytes > entry->out_alloc)
+    {
+        data = (char*)realloc(entry->out, nal_bytes);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        entry->out = data;
+        entry->out_alloc = nal_bytes;
+    }
+    rbsp_to_nal(wbits->data, out_bytes, entry->out, &nal_bytes);
+    return nal_bytes;
+}
+
+/* nal is an escaped sps, *out is set to the rewritten escaped sps, it
+   stays good until the next call
+   returns 0 or 1 when the sps does not parse and should be passed
+   through */
+int
+sps_rewrite_nal(struct sps_rewrite_t* rewrite, const char* nal, int bytes,
+                const char** out, int* out_bytes)
+{
+    int index;
+    unsigned long long hash;
+    char* data;
+    struct sps_rewrite_entry_t* entry;
+
+    hash = nal_hash(nal, bytes);
+    for (index = 0; index < rewrite->num_cache; index++)
+    {
+        entry = rewrite->cache + index;
+        if ((entry->hash == hash) && (entry->in_bytes == bytes) &&
+            (memcmp(entry->in, nal, bytes) == 0))
+        {
+            rewrite->hits++;
+            break;
+        }
+    }
+    if (index == rewrite->num_cache)
+    {
+        rewrite->misses++;
+        if (rewrite->num_cache < SPS_REWRITE_CACHE)
+        {
+            index = rewrite->num_cache++;
+        }
+        else
+        {
+            index = rewrite->next_evict;
+            rewrite->next_evict = (index + 1) % SPS_REWRITE_CACHE;
+        }
+        entry = rewrite->cache + index;
+        entry->in_bytes = -1;
+        if (bytes > entry->in_alloc)
+        {
+            data = (char*)realloc(entry->in, bytes);
+            if (data == NULL)
+            {
+                return 1;
+            }
+            entry->in = data;
+            entry->in_alloc = bytes;
+        }
+        memcpy(entry->in, nal, bytes);
+        entry->in_bytes = bytes;
+        entry->hash = hash;
+        entry->out_bytes = sps_rewrite_run(rewrite, nal, bytes, entry);
+    }
+    entry = rewrite->cache + index;
+    if (entry->out_bytes < 0)
+    {
+        return 1;
+    }
+    *out = entry->out;
+    *out_bytes = entry->out_bytes;
+    return 0;
+}
@@ -0,0 +1,79 @@
+
+#ifndef _SPS_REWRITE_H_
+#define _SPS_REWRITE_H_
+
+#include "bits.h"
+
+#define SPS_REWRITE_MAX_RULES   64
+#define SPS_REWRITE_MAX_VALS    12
+#define SPS_REWRITE_CACHE       32
+
+/* rule ops */
+#define SPS_RULE_SET        0   /* field=value, the groups it is sent in
+                                   are added */
+#define SPS_RULE_ADD        1   /* group=value:value..., group_flag=1 */
+#define SPS_RULE_REMOVE     2   /* -group, group_flag=0 */
+
+/* one item of the rule list
+   a group is a present flag and the fields it sends, vui, vui.timing_info
+   and the others, adding a group that is not there sets its fields to
+   their inferred or default values first, values given with it go to its
+   fields in the order they are sent */
+struct sps_rule_t
+{
+    int field;              /* index into the field table */
+    int index;              /* of an array field, -1 for every entry */
+    int op;
+    int num_vals;
+    long long vals[SPS_REWRITE_MAX_VALS];
+};
+
+/* an sps nal seen before and what it was rewritten to, out_bytes is -1
+   when it did not parse and is passed through */
+struct sps_rewrite_entry_t
+{
+    unsigned long long hash;
+    char* in;
+    int in_bytes;
+    int in_alloc;
+    char* out;
+    int out_bytes;
+    int out_alloc;
+};
+
+/* rewrites escaped sps nals by a rule list like
+   "vui.num_reorder_frames=0, level_idc=31, -vui.timing_info"
+   the sps is parsed, the rules applied to it and the whole sps written
+   again so fields can change size, vui and hrd can be added or removed
+   rules go in order, a field that is only sent for some profiles,
+   pic_order_cnt_type, aspect_ratio_idc, cpb_cnt_minus1 or flags needs
+   those set first, values of a group go in the same way, an sps that does
+   not send a field a rule names is passed through and counted in rejected
+   the last SPS_REWRITE_CACHE distinct nals are kept with their output,
+   a repeated sps costs a hash and a compare */
+struct sps_rewrite_t
+{
+    struct sps_rule_t rules[SPS_REWRITE_MAX_RULES];
+    int num_rules;
+    int error_pos;          /* offset in the rule text of a bad rule */
+    struct sps_rewrite_entry_t cache[SPS_REWRITE_CACHE];
+    int num_cache;
+    int next_evict;
+    char* rbsp;
+    int rbsp_alloc;
+    struct wbits_t wbits;
+    long long hits;
+    long long misses;
+    long long rejected;     /* distinct sps nals a rule names a field that
+                               is not sent in, passed through */
+};
+
+int
+sps_rewrite_init(struct sps_rewrite_t* rewrite, const char* rules);
+int
+sps_rewrite_deinit(struct sps_rewrite_t* rewrite);
+int
+sps_rewrite_nal(struct sps_rewrite_t* rewrite, const char* nal, int bytes,
+                const char** out, int* out_bytes);
+
+#endif
@@ -0,0 +1,285 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "sps.h"
+#include "params.h"
+#include "au.h"
+#include "utils.h"
+#include "stats.h"
+
+int
+stats_init(struct stats_t* stats, int container)
+{
+    memset(stats, 0, sizeof(struct stats_t));
+    stats->container = container;
+    stats->last_idr = -1;
+    stats->frame_min = -1;
+    stats->idr_interval_min = -1;
+    return params_init(&(stats->params));
+}
+
+int
+stats_deinit(struct stats_t* stats)
+{
+    return params_deinit(&(stats->params));
+}
+
+/* floor(log2(bytes)), 0 for 0 */
+static int
+stats_bucket(long long bytes)
+{
+    int bucket;
+
+    bucket = 0;
+    while ((bytes > 1) && (bucket < STATS_SIZE_BUCKETS - 1))
+    {
+        bytes >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* count the frame being filled, if any */
+static void
+stats_end_frame(struct stats_t* stats)
+{
+    long long interval;
+
+    if (!stats->in_frame)
+    {
+        return;
+    }
+    if (stats->cur_idr)
+    {
+        if (stats->last_idr >= 0)
+        {
+            interval = stats->frame_count - stats->last_idr;
+            if ((stats->idr_interval_min < 0) ||
+                (interval < stats->idr_interval_min))
+            {
+                stats->idr_interval_min = interval;
+            }
+            if (interval > stats->idr_interval_max)
+            {
+                stats->idr_interval_max = interval;
+            }
+            stats->idr_interval_sum += interval;
+            stats->idr_intervals++;
+        }
+        stats->last_idr = stats->frame_count;
+        stats->idr_frames++;
+    }
+    if ((stats->frame_min < 0) || (stats->cur_bytes < stats->frame_min))
+    {
+        stats->frame_min = stats->cur_bytes;
+    }
+    if (stats->cur_bytes > stats->frame_max)
+    {
+        stats->frame_max = stats->cur_bytes;
+    }
+    stats->frame_sizes[stats_bucket(stats->cur_bytes)]++;
+    stats->frame_bytes += stats->cur_bytes;
+    stats->frame_count++;
+    stats->cur_bytes = 0;
+    stats->cur_idr = 0;
+    stats->in_frame = 0;
+}
+
+static void
+stats_start_frame(struct stats_t* stats)
+{
+    stats_end_frame(stats);
+    stats->in_frame = 1;
+}
+
+/* a BEEF frame header, the nals up to the next one are its frame */
+int
+stats_frame(struct stats_t* stats)
+{
+    stats_start_frame(stats);
+    return 0;
+}
+
+/* data is the escaped nal */
+int
+stats_nal(struct stats_t* stats, char* data, int bytes,
+          int start_code_bytes, int nal_unit_type)
+{
+    int id;
+    int set;
+    int event;
+    int escapes;
+    int starts;
+    struct sps_t* sps;
+    const struct sps_t* slice_sps;
+    struct stats_res_t* res;
+
+    nal_unit_type &= 0x1F;
+    if (!stats->container)
+    {
+        starts = au_split_nal(&(stats->split), &(stats->params), data, bytes,
+                              nal_unit_type, &slice_sps);
+        if (!stats->in_frame || starts)
+        {
+            stats_start_frame(stats);
+        }
+    }
+    if (nal_unit_type == 5)
+    {
+        stats->cur_idr = 1;
+    }
+    stats->cur_bytes += start_code_bytes + bytes;
+
+    if ((stats->nal_count[nal_unit_type] == 0) ||
+        (bytes < stats->nal_min[nal_unit_type]))
+    {
+        stats->nal_min[nal_unit_type] = bytes;
+    }
+    if (bytes > stats->nal_max[nal_unit_type])
+    {
+        stats->nal_max[nal_unit_type] = bytes;
+    }
+    stats->nal_count[nal_unit_type]++;
+    stats->nal_bytes[nal_unit_type] += bytes;
+    stats->nal_sizes[stats_bucket(bytes)]++;
+    stats->start_code_bytes += start_code_bytes;
+    escapes = nal_escape_count(data, bytes);
+    if (escapes < 0)
+    {
+        stats->escape_errors++;
+    }
+    else
+    {
+        stats->escape_bytes += escapes;
+    }
+
+    if ((nal_unit_type != 7) && (nal_unit_type != 8))
+    {
+        return 0;
+    }
+    set = nal_unit_type == 8;
+    event = params_parse(&(stats->params), data, bytes, nal_unit_type, &id);
+    if (event == PARAMS_ERROR)
+    {
+        stats->params_errors[set]++;
+        return 0;
+    }
+    stats->params_events[set][event]++;
+    sps = stats->params.sps[id];
+    if (!set && (event != PARAMS_SAME) &&
+        ((stats->res_count == 0) || (sps->width != stats->width) ||
+         (sps->height != stats->height)))
+    {
+        stats->width = sps->width;
+        stats->height = sps->height;
+        if (stats->res_count < STATS_MAX_RES)
+        {
+            res = stats->res + stats->res_count;
+            res->frame = stats->frame_count;
+            res->width = sps->width;
+            res->height = sps->height;
+        }
+        stats->res_count++;
+    }
+    return 0;
+}
+
+static const char* g_nal_names[32] =
+{
+    "unspecified", "slice", "slice_a", "slice_b", "slice_c", "idr", "sei",
+    "sps", "pps", "aud", "end_seq", "end_stream", "filler", "sps_ext",
+    "prefix", "subset_sps", "dps", "reserved", "reserved", "aux_slice",
+    "slice_ext", "slice_3d", "reserved", "reserved", "unspecified",
+    "unspecified", "unspecified", "unspecified", "unspecified",
+    "unspecified", "unspecified", "unspecified"
+};
+
+static void
+stats_print_sizes(FILE* out, const char* name, const long long* sizes)
+{
+    int bucket;
+
+    fprintf(out, "%s", name);
+    for (bucket = 0; bucket < STATS_SIZE_BUCKETS; bucket++)
+    {
+        if (sizes[bucket] > 0)
+        {
+            fprintf(out, " %lld:%lld", 1ll << bucket, sizes[bucket]);
+        }
+    }
+    fprintf(out, "\n");
+}
+
+/* the summary, counts the last frame first */
+int
+stats_print(struct stats_t* stats, FILE* out)
+{
+    int type;
+    int index;
+    long long nals;
+    long long bytes;
+    static const char* set_names[2] = { "sps", "pps" };
+
+    stats_end_frame(stats);
+    nals = 0;
+    bytes = 0;
+    for (type = 0; type < 32; type++)
+    {
+        nals += stats->nal_count[type];
+        bytes += stats->nal_bytes[type];
+    }
+    fprintf(out, "nals %lld nal_bytes %lld start_code_bytes %lld "
+            "escape_bytes %lld (%.3f%%) escape_errors %lld\n",
+            nals, bytes, stats->start_code_bytes, stats->escape_bytes,
+            bytes > 0 ? 100.0 * stats->escape_bytes / bytes : 0.0,
+            stats->escape_errors);
+    fprintf(out, "type name         count        bytes    min    max    "
+            "avg\n");
+    for (type = 0; type < 32; type++)
+    {
+        if (stats->nal_count[type] > 0)
+        {
+            fprintf(out, "%4d %-11s %6lld %12lld %6d %6d %6lld\n", type,
+                    g_nal_names[type], stats->nal_count[type],
+                    stats->nal_bytes[type], stats->nal_min[type],
+                    stats->nal_max[type],
+                    stats->nal_bytes[type] / stats->nal_count[type]);
+        }
+    }
+    stats_print_sizes(out, "nal_sizes", stats->nal_sizes);
+    fprintf(out, "%s %lld bytes %lld min %lld max %lld avg %lld\n",
+            stats->container ? "frames" : "access_units", stats->frame_count,
+            stats->frame_bytes, stats->frame_min < 0 ? 0 : stats->frame_min,
+            stats->frame_max,
+            stats->frame_count > 0 ? stats->frame_bytes / stats->frame_count :
+                                     0);
+    stats_print_sizes(out, "frame_sizes", stats->frame_sizes);
+    fprintf(out, "idr_frames %lld interval min %lld max %lld avg %.1f\n",
+            stats->idr_frames,
+            stats->idr_interval_min < 0 ? 0 : stats->idr_interval_min,
+            stats->idr_interval_max,
+            stats->idr_intervals > 0 ?
+            (double)stats->idr_interval_sum / stats->idr_intervals : 0.0);
+    for (index = 0; index < 2; index++)
+    {
+        fprintf(out, "%s new %lld same %lld changed %lld res_change %lld "
+                "errors %lld\n", set_names[index],
+                stats->params_events[index][PARAMS_NEW],
+                stats->params_events[index][PARAMS_SAME],
+                stats->params_events[index][PARAMS_CHANGED],
+                stats->params_events[index][PARAMS_RES_CHANGE],
+                stats->params_errors[index]);
+    }
+    fprintf(out, "resolutions %d", stats->res_count);
+    for (index = 0; (index < stats->res_count) && (index < STATS_MAX_RES);
+         index++)
+    {
+        fprintf(out, " %dx%d@%lld", stats->res[index].width,
+                stats->res[index].height, stats->res[index].frame);
+    }
+    fprintf(out, "%s\n", stats->res_count > STATS_MAX_RES ? " ..." : "");
+    return 0;
+}
@@ -0,0 +1,76 @@
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+
+#include "params.h"
+#include "au.h"
+
+#define STATS_SIZE_BUCKETS  32  /* bytes by floor(log2) */
+#define STATS_MAX_RES       16
+
+/* a resolution from an sps, kept when it first shows up or changes */
+struct stats_res_t
+{
+    long long frame;
+    int width;
+    int height;
+};
+
+/* counters for a whole stream, filled a nal at a time with nothing
+   allocated or formatted until stats_print
+   frames are BEEF frames when there is a container, else access units
+   split by au_split_nal as the steppers see them */
+struct stats_t
+{
+    int container;
+    long long nal_count[32];
+    long long nal_bytes[32];
+    int nal_min[32];
+    int nal_max[32];
+    long long nal_sizes[STATS_SIZE_BUCKETS];
+    long long start_code_bytes;
+    long long escape_bytes;     /* emulation_prevention_three_byte */
+    long long escape_errors;    /* nals with a forbidden 0x00000x */
+
+    long long frame_count;
+    long long frame_bytes;
+    long long frame_min;
+    long long frame_max;
+    long long frame_sizes[STATS_SIZE_BUCKETS];
+    long long cur_bytes;        /* of the frame being counted */
+    int cur_idr;
+    int in_frame;
+    struct au_split_t split;    /* without a container */
+
+    long long idr_frames;
+    long long last_idr;         /* frame, -1 before the first */
+    long long idr_interval_min;
+    long long idr_interval_max;
+    long long idr_interval_sum;
+    long long idr_intervals;
+
+    long long params_events[2][4];  /* sps and pps, by PARAMS_ event */
+    long long params_errors[2];
+    int width;                  /* of the last sps */
+    int height;
+    struct stats_res_t res[STATS_MAX_RES];
+    int res_count;              /* every change, the first STATS_MAX_RES
+                                   are kept */
+    struct params_t params;
+};
+
+int
+stats_init(struct stats_t* stats, int container);
+int
+stats_deinit(struct stats_t* stats);
+int
+stats_frame(struct stats_t* stats);
+int
+stats_nal(struct stats_t* stats, char* data, int bytes,
+          int start_code_bytes, int nal_unit_type);
+int
+stats_print(struct stats_t* stats, FILE* out);
+
+#endif
@@ -0,0 +1,349 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "stream.h"
+#include "utils.h"
+#include "beef.h"
+
+#define NAL_STREAM_DATA_BYTES   (256 * 1024)
+#define NAL_STREAM_READ_BYTES   (64 * 1024)
+
+#define STATE_HEADER    0   /* BEEF frame header next */
+#define STATE_FIRST     1   /* looking for the first start code */
+#define STATE_NAL       2   /* start code at code */
+#define STATE_TAIL      3   /* segment has no more nals */
+#define STATE_DONE      4
+
+/* read what fits in the free end of data, makes room first by dropping
+   the handed out bytes or by doubling data
+   returns bytes read, 0 at end of input or -1 on error */
+static int
+nal_stream_fill(struct nal_stream_t* stream)
+{
+    int bytes;
+    long long data_bytes;
+    char* data;
+
+    if (stream->eof)
+    {
+        return 0;
+    }
+    if (stream->data_bytes - stream->end < NAL_STREAM_READ_BYTES)
+    {
+        if (stream->start >= stream->data_bytes / 2)
+        {
+            memmove(stream->data, stream->data + stream->start,
+                    stream->end - stream->start);
+            stream->end -= stream->start;
+            stream->scan -= stream->start;
+            stream->code -= stream->start;
+            stream->frame_end -= stream->start;
+            stream->data_offset += stream->start;
+            stream->start = 0;
+        }
+        else
+        {
+            data_bytes = stream->data_bytes * 2;
+            data = (char*)realloc(stream->data, data_bytes);
+            if (data == NULL)
+            {
+                stream->error = 1;
+                return -1;
+            }
+            stream->data = data;
+            stream->data_bytes = data_bytes;
+        }
+    }
+    for (;;)
+    {
+        bytes = read(stream->fd, stream->data + stream->end,
+                     stream->data_bytes - stream->end);
+        if ((bytes < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        break;
+    }
+    if (bytes < 0)
+    {
+        stream->error = 1;
+        return -1;
+    }
+    if (bytes == 0)
+    {
+        stream->eof = 1;
+        return 0;
+    }
+    stream->end += bytes;
+    return bytes;
+}
+
+/* end of the current frame or of the whole input */
+static long long
+nal_stream_limit(const struct nal_stream_t* stream)
+{
+    if ((stream->format == NAL_STREAM_BEEF) &&
+        (stream->frame_end < stream->end))
+    {
+        return stream->frame_end;
+    }
+    return stream->end;
+}
+
+/* find the next start code at or after scan, reading more as needed,
+   a start code that straddles two reads is found once the second one
+   is in, a zero before 0x000001 that is at or after lo makes it 4 bytes
+   returns 1 with code and code_bytes set, 0 when the segment ends first
+   or -1 on error */
+static int
+nal_stream_find(struct nal_stream_t* stream, long long lo)
+{
+    int start_code_bytes;
+    long long limit;
+    long long code;
+    const char* found;
+
+    lo -= stream->start;
+    for (;;)
+    {
+        limit = nal_stream_limit(stream);
+        found = find_start_code(stream->data + stream->scan,
+                                stream->data + limit, &start_code_bytes);
+        if (found < stream->data + limit)
+        {
+            code = found - stream->data;
+            if (start_code_bytes == 4)
+            {
+                code++;
+            }
+            stream->code_bytes = 3;
+            if ((code > stream->start + lo) && (stream->data[code - 1] == 0))
+            {
+                code--;
+                stream->code_bytes = 4;
+            }
+            stream->code = code;
+            return 1;
+        }
+        if (stream->format == NAL_STREAM_BEEF)
+        {
+            if (stream->end >= stream->frame_end)
+            {
+                return 0;
+            }
+        }
+        if (stream->eof)
+        {
+            if (stream->format == NAL_STREAM_BEEF)
+            {
+                /* payload cut short */
+                stream->error = 1;
+                return -1;
+            }
+            return 0;
+        }
+        /* the last 2 bytes can still start a code */
+        if (limit - 2 > stream->scan)
+        {
+            stream->scan = limit - 2;
+        }
+        /* lo is kept relative to start, fill can move the window */
+        if (nal_stream_fill(stream) < 0)
+        {
+            return -1;
+        }
+    }
+}
+
+/* v1 or v2 frame header, the v2 footer ends the frames */
+static int
+nal_stream_header(struct nal_stream_t* stream)
+{
+    int rv;
+    struct beef_frame_t frame;
+
+    for (;;)
+    {
+        rv = beef_parse_header(stream->data + stream->start,
+                               stream->end - stream->start, &frame);
+        if ((rv != 0) || stream->eof)
+        {
+            break;
+        }
+        if (nal_stream_fill(stream) < 0)
+        {
+            return NAL_STREAM_ERROR;
+        }
+    }
+    if ((stream->end == stream->start) || frame.footer)
+    {
+        stream->state = STATE_DONE;
+        return NAL_STREAM_END;
+    }
+    if (rv < 1)
+    {
+        stream->error = 1;
+        return NAL_STREAM_ERROR;
+    }
+    stream->frame_offset = stream->data_offset + stream->start;
+    stream->start += rv;
+    stream->scan = stream->start;
+    stream->frame_end = stream->start + frame.bytes;
+    stream->version = frame.version;
+    stream->width = frame.width;
+    stream->height = frame.height;
+    stream->frame_bytes = frame.bytes;
+    stream->timestamp_us = frame.timestamp_us;
+    stream->frame_flags = frame.flags;
+    stream->checksum = frame.checksum;
+    stream->crc = 0;
+    stream->frame_count++;
+    stream->state = STATE_FIRST;
+    return NAL_STREAM_FRAME;
+}
+
+/* a v2 payload is checked as it is handed out, start moves to end */
+static void
+nal_stream_consume(struct nal_stream_t* stream, long long end)
+{
+    if (stream->version > 1)
+    {
+        stream->crc = beef_crc32(stream->crc, stream->data + stream->start,
+                                 end - stream->start);
+    }
+    stream->start = end;
+}
+
+/* fd is read until it ends, a file, pipe or stdin, the caller closes it
+   input that starts with "BEEF" is read as BEEF frames, anything else as
+   Annex B */
+int
+nal_stream_init(struct nal_stream_t* stream, int fd)
+{
+    memset(stream, 0, sizeof(struct nal_stream_t));
+    stream->fd = fd;
+    stream->data = (char*)malloc(NAL_STREAM_DATA_BYTES);
+    if (stream->data == NULL)
+    {
+        stream->error = 1;
+        return 1;
+    }
+    stream->data_bytes = NAL_STREAM_DATA_BYTES;
+    while ((stream->end < 4) && !stream->eof)
+    {
+        if (nal_stream_fill(stream) < 0)
+        {
+            return 1;
+        }
+    }
+    stream->format = NAL_STREAM_ANNEXB;
+    stream->state = STATE_FIRST;
+    if ((stream->end >= 4) && ((strncmp(stream->data, "BEEF", 4) == 0) ||
+                               (strncmp(stream->data, "BEF2", 4) == 0)))
+    {
+        stream->format = NAL_STREAM_BEEF;
+        stream->state = STATE_HEADER;
+    }
+    return 0;
+}
+
+int
+nal_stream_deinit(struct nal_stream_t* stream)
+{
+    free(stream->data);
+    memset(stream, 0, sizeof(struct nal_stream_t));
+    return 0;
+}
+
+int
+nal_stream_next(struct nal_stream_t* stream, struct nal_unit_t* nal)
+{
+    int rv;
+    int code_bytes;
+    long long payload;
+    long long end_nal;
+
+    memset(nal, 0, sizeof(struct nal_unit_t));
+    if (stream->error)
+    {
+        return NAL_STREAM_ERROR;
+    }
+    for (;;)
+    {
+        switch (stream->state)
+        {
+            case STATE_HEADER:
+                return nal_stream_header(stream);
+            case STATE_FIRST:
+                stream->scan = stream->start;
+                rv = nal_stream_find(stream, stream->start);
+                if (rv < 0)
+                {
+                    return NAL_STREAM_ERROR;
+                }
+                stream->state = rv ? STATE_NAL : STATE_TAIL;
+                break;
+            case STATE_NAL:
+                /* kept relative to start, find can move the window */
+                payload = stream->code + stream->code_bytes - stream->start;
+                code_bytes = stream->code_bytes;
+                stream->scan = stream->start + payload;
+                rv = nal_stream_find(stream, stream->scan);
+                if (rv < 0)
+                {
+                    return NAL_STREAM_ERROR;
+                }
+                payload += stream->start;
+                end_nal = rv ? stream->code : nal_stream_limit(stream);
+                while ((end_nal > payload) &&
+                       (stream->data[end_nal - 1] == 0))
+                {
+                    end_nal--;
+                }
+                if (end_nal > payload)
+                {
+                    nal->lead = stream->data + stream->start;
+                    nal->lead_bytes = payload - stream->start;
+                    nal->data = stream->data + payload;
+                    nal->bytes = end_nal - payload;
+                    nal->start_code_bytes = code_bytes;
+                    nal->nal_ref_idc = (nal->data[0] >> 5) & 3;
+                    nal->nal_unit_type = nal->data[0] & 0x1F;
+                    nal->stream_offset = stream->data_offset + payload;
+                    nal_stream_consume(stream, end_nal);
+                }
+                if (!rv)
+                {
+                    stream->state = STATE_TAIL;
+                }
+                if (end_nal > payload)
+                {
+                    return NAL_STREAM_NAL;
+                }
+                break;
+            case STATE_TAIL:
+                end_nal = nal_stream_limit(stream);
+                nal->lead = stream->data + stream->start;
+                nal->lead_bytes = end_nal - stream->start;
+                nal_stream_consume(stream, end_nal);
+                if ((stream->version > 1) &&
+                    (stream->crc != stream->checksum))
+                {
+                    stream->error = 1;
+                    return NAL_STREAM_ERROR;
+                }
+                stream->state = STATE_DONE;
+                if (stream->format == NAL_STREAM_BEEF)
+                {
+                    stream->state = STATE_HEADER;
+                }
+                return NAL_STREAM_SEGMENT_END;
+            default:
+                return NAL_STREAM_END;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#define NAL_STREAM_ANNEXB       0
+#define NAL_STREAM_BEEF         1
+
+/* nal_stream_next results, a raw Annex B stream gives
+   NAL ... SEGMENT_END END and a BEEF stream gives
+   FRAME NAL ... SEGMENT_END for each frame then END */
+#define NAL_STREAM_NAL          0
+#define NAL_STREAM_FRAME        1   /* BEEF header in width, height,
+                                       frame_bytes and for v2
+                                       timestamp_us, frame_flags */
+#define NAL_STREAM_SEGMENT_END  2   /* lead holds the bytes after the last
+                                       nal of the frame or stream */
+#define NAL_STREAM_END          3
+#define NAL_STREAM_ERROR        -1  /* also a v2 checksum mismatch */
+
+/* the reader keeps one window of the input in data and reads into its
+   free end, bytes before start are handed out and dropped by moving the
+   rest down once start passes the middle, data only grows when a single
+   nal with its lead does not fit */
+struct nal_stream_t
+{
+    int fd;
+    int format;
+    int state;
+    int eof;
+    int error;
+    char* data;
+    long long data_bytes;   /* allocated */
+    long long start;        /* first byte not handed out */
+    long long end;          /* bytes read into data */
+    long long scan;         /* no start code begins before scan */
+    long long code;         /* start code of the next nal */
+    int code_bytes;
+    long long frame_end;    /* end of the BEEF payload in data */
+    long long data_offset;  /* stream offset of data[0] */
+    long long frame_offset; /* stream offset of the BEEF header */
+    long long frame_count;
+    int version;            /* of the BEEF header */
+    int width;
+    int height;
+    long long frame_bytes;
+    long long timestamp_us; /* BEEF v2 */
+    int frame_flags;        /* BEEF v2 FRAME_FLAG_ */
+    unsigned int checksum;  /* BEEF v2 crc32 of the payload */
+    unsigned int crc;       /* of the payload handed out so far */
+};
+
+/* one nal from nal_stream_next, data and lead point into the stream
+   window and stay valid until the next call */
+struct nal_unit_t
+{
+    char* data;             /* first byte after the start code */
+    int bytes;              /* without trailing_zero_8bits */
+    int start_code_bytes;   /* 3 or 4 */
+    int nal_ref_idc;
+    int nal_unit_type;
+    long long stream_offset;    /* of data */
+    char* lead;             /* everything since the previous nal, trailing
+                               zeros, start code or leading garbage */
+    int lead_bytes;
+};
+
+int
+nal_stream_init(struct nal_stream_t* stream, int fd);
+int
+nal_stream_deinit(struct nal_stream_t* stream);
+int
+nal_stream_next(struct nal_stream_t* stream, struct nal_unit_t* nal);
+
+#endif
@@ -2,183 +2,644 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
-void
-hexdump(const void *p, int len)
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTILS_X86 1
+#endif
+
+/* the widest find_zero_pair to pick, 0 c, 1 sse2, 2 avx2, make check
+   builds lower ones to compare them */
+#ifndef UTILS_SIMD_MAX
+#define UTILS_SIMD_MAX 2
+#endif
+
+#include "utils.h"
+
+typedef long long (*find_zero_pair_proc)(const unsigned char* data,
+                                         long long start, long long end,
+                                         int lo, int hi);
+
+int
+parse_start_code(const char* data, const char* end_data)
+{
+    int bytes = (int)(end_data - data);
+    if (bytes > 2 && data[0] == 0 && data[1] == 0 && data[2] == 1)
+    {
+        return 3;
+    }
+    if (bytes > 3 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1)
+    {
+        return 4;
+    }
+    return 0;
+}
+
+/* byte at a time reference for nal_to_rbsp */
+int
+nal_to_rbsp_c(const char* nal_buf, int* nal_size, char* rbsp_buf, int* rbsp_size)
 {
-    unsigned char *line;
     int i;
-    int thisline;
-    int offset;
+    int j;
+    int count;
+    int lnal_size;
+    int lrbsp_size;
 
-    line = (unsigned char *)p;
-    offset = 0;
+    j = 0;
+    count = 0;
+    lnal_size = *nal_size;
+    lrbsp_size = *rbsp_size;
+    for (i = 0; i < lnal_size; i++)
+    { 
+        /* in NAL unit, 0x000000, 0x000001 or 0x000002 shall not occur at any
+           byte-aligned position */
+        if ((count == 2) && ((nal_buf[i] & 0xFF) < 0x03))
+        {
+            return -1;
+        }
+        if ((count == 2) && ((nal_buf[i] & 0xFF) == 0x03))
+        {
+            /* check the 4th byte after 0x000003, except when cabac_zero_word
+               is used, in which case the last three bytes of this NAL unit
+               must be 0x000003 */
+            if ((i < lnal_size - 1) && ((nal_buf[i + 1] & 0xFF) > 0x03))
+            {
+                return -1;
+            }
+            /* if cabac_zero_word is used, the final byte of this NAL
+               unit(0x03) is discarded, and the last two bytes of RBSP
+               must be 0x0000 */
+            if (i == lnal_size - 1)
+            {
+                break;
+            }
+            i++;
+            count = 0;
+        }
+        if (j >= lrbsp_size)
+        {
+            /* error, not enough space */
+            return -1;
+        }
+        rbsp_buf[j] = nal_buf[i];
+        if (nal_buf[i] == 0x00)
+        {
+            count++;
+        }
+        else
+        {
+            count = 0;
+        }
+        j++;
+    }
+    *nal_size = i;
+    *rbsp_size = j;
+    return j;
+}
 
-    while (offset < len)
-    {
-        printf("%04x ", offset);
-        thisline = len - offset;
+/* first index i, start <= i < end, where data[i - 2] and data[i - 1] are
+   zero and lo <= data[i] <= hi, end if there is none, start >= 2
+   lo 0 hi 3 finds emulation prevention, lo 1 hi 1 finds start codes */
+static long long
+find_zero_pair_c(const unsigned char* data, long long start, long long end,
+                 int lo, int hi)
+{
+    long long index;
 
-        if (thisline > 16)
+    for (index = start; index < end; index++)
+    {
+        if ((data[index - 2] == 0) && (data[index - 1] == 0) &&
+            (data[index] >= lo) && (data[index] <= hi))
         {
-            thisline = 16;
+            return index;
         }
+    }
+    return end;
+}
+
+#if defined(UTILS_X86) && (UTILS_SIMD_MAX > 0)
+
+/* zero pairs a vector at a time, the third byte is only checked when a
+   vector has a pair */
+static long long
+find_zero_pair_sse2(const unsigned char* data, long long start,
+                    long long end, int lo, int hi)
+{
+    long long index;
+    int mask;
+    __m128i zero;
+    __m128i vlo;
+    __m128i vhi;
+    __m128i v0;
+    __m128i v1;
+    __m128i v2;
 
-        for (i = 0; i < thisline; i++)
+    zero = _mm_setzero_si128();
+    vlo = _mm_set1_epi8(lo);
+    vhi = _mm_set1_epi8(hi);
+    for (index = start; index + 16 <= end; index += 16)
+    {
+        v0 = _mm_loadu_si128((const __m128i*)(data + index - 2));
+        v1 = _mm_loadu_si128((const __m128i*)(data + index - 1));
+        v0 = _mm_and_si128(_mm_cmpeq_epi8(v0, zero), _mm_cmpeq_epi8(v1, zero));
+        mask = _mm_movemask_epi8(v0);
+        if (mask == 0)
         {
-            printf("%02x ", line[i]);
+            continue;
         }
+        v2 = _mm_loadu_si128((const __m128i*)(data + index));
+        v1 = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v2, vlo), v2),
+                           _mm_cmpeq_epi8(_mm_min_epu8(v2, vhi), v2));
+        mask &= _mm_movemask_epi8(v1);
+        if (mask != 0)
+        {
+            return index + __builtin_ctz(mask);
+        }
+    }
+    return find_zero_pair_c(data, index, end, lo, hi);
+}
+
+#if (UTILS_SIMD_MAX > 1)
 
-        for (; i < 16; i++)
+__attribute__((target("avx2")))
+static long long
+find_zero_pair_avx2(const unsigned char* data, long long start,
+                    long long end, int lo, int hi)
+{
+    long long index;
+    unsigned int mask;
+    __m256i zero;
+    __m256i vlo;
+    __m256i vhi;
+    __m256i v0;
+    __m256i v1;
+    __m256i v2;
+
+    zero = _mm256_setzero_si256();
+    vlo = _mm256_set1_epi8(lo);
+    vhi = _mm256_set1_epi8(hi);
+    for (index = start; index + 32 <= end; index += 32)
+    {
+        v0 = _mm256_loadu_si256((const __m256i*)(data + index - 2));
+        v1 = _mm256_loadu_si256((const __m256i*)(data + index - 1));
+        v0 = _mm256_and_si256(_mm256_cmpeq_epi8(v0, zero),
+                              _mm256_cmpeq_epi8(v1, zero));
+        mask = _mm256_movemask_epi8(v0);
+        if (mask == 0)
+        {
+            continue;
+        }
+        v2 = _mm256_loadu_si256((const __m256i*)(data + index));
+        v1 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v2, vlo), v2),
+                              _mm256_cmpeq_epi8(_mm256_min_epu8(v2, vhi), v2));
+        mask &= _mm256_movemask_epi8(v1);
+        if (mask != 0)
         {
-            printf("   ");
+            return index + __builtin_ctz(mask);
         }
+    }
+    return find_zero_pair_sse2(data, index, end, lo, hi);
+}
 
-        for (i = 0; i < thisline; i++)
+#endif
+
+#endif
+
+/* picked on first use from the cpu features, threads can pick at the
+   same time so the pointer is only touched atomically */
+static find_zero_pair_proc g_find_zero_pair = NULL;
+
+static long long
+find_zero_pair(const unsigned char* data, long long start, long long end,
+               int lo, int hi)
+{
+    find_zero_pair_proc proc;
+
+    proc = __atomic_load_n(&g_find_zero_pair, __ATOMIC_RELAXED);
+    if (proc == NULL)
+    {
+        proc = find_zero_pair_c;
+#if defined(UTILS_X86) && (UTILS_SIMD_MAX > 0)
+        __builtin_cpu_init();
+        proc = find_zero_pair_sse2;
+#if (UTILS_SIMD_MAX > 1)
+        if (__builtin_cpu_supports("avx2"))
         {
-            printf("%c", (line[i] >= 0x20 && line[i] < 0x7f) ? line[i] : '.');
+            proc = find_zero_pair_avx2;
         }
+#endif
+#endif
+        __atomic_store_n(&g_find_zero_pair, proc, __ATOMIC_RELAXED);
+    }
+    return proc(data, start, end, lo, hi);
+}
+
+static int
+find_escape(const unsigned char* data, int start, int end)
+{
+    return find_zero_pair(data, start, end, 0x00, 0x03);
+}
+
+/* the next 0x000001 at or after data, the returned pointer includes the
+   zero_byte of a 4 byte start code, end_data if there is none */
+const char*
+find_start_code(const char* data, const char* end_data, int* start_code_bytes)
+{
+    long long index;
+    long long bytes;
+    const unsigned char* udata;
 
-        printf("\n");
-        offset += thisline;
-        line += thisline;
+    udata = (const unsigned char*)data;
+    bytes = end_data - data;
+    index = find_zero_pair(udata, 2, bytes, 0x01, 0x01);
+    if (index >= bytes)
+    {
+        *start_code_bytes = 0;
+        return end_data;
+    }
+    index -= 2;
+    if ((index > 0) && (udata[index - 1] == 0))
+    {
+        *start_code_bytes = 4;
+        return data + index - 1;
     }
+    *start_code_bytes = 3;
+    return data + index;
 }
 
 int
-parse_start_code(const char* data, const char* end_data)
+get_nal_bytes(const char* data, const char* end_data)
 {
-    int bytes = (int)(end_data - data);
-    if (bytes > 2 && data[0] == 0 && data[1] == 0 && data[2] == 1)
+    int start_code_bytes;
+
+    return (int)(find_start_code(data, end_data, &start_code_bytes) - data);
+}
+
+/* find the nal that follows the start code at *start_code and move
+   *start_code to the next one, trailing_zero_8bits are not part of a nal
+   and the zero_byte before 0x000001 makes a 4 byte start code
+   returns 0 when the nal has no bytes */
+static int
+scan_next_nal(const char* data, const char* end_data,
+              const char** start_code, int* start_code_bytes,
+              struct nal_loc_t* loc)
+{
+    const char* nal;
+    const char* end_nal;
+
+    nal = *start_code + *start_code_bytes;
+    loc->offset = nal - data;
+    loc->start_code_bytes = *start_code_bytes;
+    *start_code = find_start_code(nal, end_data, start_code_bytes);
+    end_nal = *start_code;
+    while ((end_nal > nal) && (end_nal[-1] == 0))
     {
-        return 3;
+        end_nal--;
     }
-    if (bytes > 3 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1)
+    loc->bytes = end_nal - nal;
+    return loc->bytes > 0;
+}
+
+/* one pass over an Annex B buffer, every non empty nal goes in nals up to
+   max_nals
+   returns the number of nals found, can be more than max_nals */
+int
+scan_nals(const char* data, long long data_bytes, struct nal_loc_t* nals,
+          int max_nals)
+{
+    int count;
+    int start_code_bytes;
+    const char* end_data;
+    const char* start_code;
+    struct nal_loc_t loc;
+
+    count = 0;
+    end_data = data + data_bytes;
+    start_code = find_start_code(data, end_data, &start_code_bytes);
+    while (start_code < end_data)
     {
-        return 4;
+        if (scan_next_nal(data, end_data, &start_code, &start_code_bytes,
+                          &loc))
+        {
+            if (count < max_nals)
+            {
+                nals[count] = loc;
+            }
+            count++;
+        }
     }
-    return 0;
+    return count;
 }
 
+/* index every nal in data in one pass, entries point into data, nothing
+   is copied, the entries array is kept and reused by the next build
+   returns the number of nals or -1 on memory error */
 int
-get_nal_bytes(const char* data, const char* end_data)
+nal_index_build(struct nal_index_t* index, const char* data,
+                long long data_bytes)
 {
-    int bytes = 0;
-    while (data < end_data)
+    int start_code_bytes;
+    int alloc;
+    const char* end_data;
+    const char* start_code;
+    struct nal_loc_t loc;
+    struct nal_entry_t* entry;
+
+    index->count = 0;
+    end_data = data + data_bytes;
+    start_code = find_start_code(data, end_data, &start_code_bytes);
+    while (start_code < end_data)
     {
-        if (end_data - data > 2 && data[0] == 0 && data[1] == 0 && data[2] == 1)
+        if (!scan_next_nal(data, end_data, &start_code, &start_code_bytes,
+                           &loc))
         {
-            return bytes;
+            continue;
         }
-        if (end_data - data > 3 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1)
+        if (index->count >= index->alloc)
         {
-            return bytes;
+            alloc = index->alloc < 64 ? 64 : index->alloc * 2;
+            entry = (struct nal_entry_t*)
+                    realloc(index->nals, alloc * sizeof(struct nal_entry_t));
+            if (entry == NULL)
+            {
+                return -1;
+            }
+            index->nals = entry;
+            index->alloc = alloc;
         }
-        data++;
-        bytes++;
+        entry = index->nals + index->count;
+        entry->offset = loc.offset;
+        entry->bytes = loc.bytes;
+        entry->start_code_bytes = loc.start_code_bytes;
+        entry->nal_ref_idc = (data[loc.offset] >> 5) & 3;
+        entry->nal_unit_type = data[loc.offset] & 0x1F;
+        index->count++;
     }
-    return bytes;
+    return index->count;
 }
 
 int
-rbsp_to_nal(const char* rbsp_buf, int rbsp_size, char* nal_buf, int* nal_size)
+nal_index_deinit(struct nal_index_t* index)
 {
-    int i;
-    int j;
+    free(index->nals);
+    memset(index, 0, sizeof(struct nal_index_t));
+    return 0;
+}
+
+/* number of entries whose nal_unit_type bit is set in type_mask */
+int
+nal_index_count(const struct nal_index_t* index, int type_mask)
+{
+    int jndex;
     int count;
-    int lnal_size;
 
-    j = 0;
     count = 0;
-    lnal_size = *nal_size;
-    for (i = 0; i < rbsp_size ;)
+    for (jndex = 0; jndex < index->count; jndex++)
+    {
+        if (type_mask & (1 << index->nals[jndex].nal_unit_type))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* same result as nal_to_rbsp_c, the clean runs between escapes are moved
+   with memmove so src and dst may be the same buffer */
+static int
+nal_unescape(const unsigned char* src, int* src_bytes,
+             unsigned char* dst, int* dst_bytes)
+{
+    int index;
+    int jndex;
+    int escape;
+    int bytes;
+    int lsrc_bytes;
+    int ldst_bytes;
+
+    index = 0;
+    jndex = 0;
+    escape = 2;
+    lsrc_bytes = *src_bytes;
+    ldst_bytes = *dst_bytes;
+    while (index < lsrc_bytes)
     {
-        if (j >= lnal_size)
+        escape = find_escape(src, escape, lsrc_bytes);
+        bytes = escape - index;
+        if (jndex + bytes > ldst_bytes)
         {
             /* error, not enough space */
             return -1;
         }
-        if ((count == 2) && !(rbsp_buf[i] & 0xFC)) /* HACK 0xFC */
+        memmove(dst + jndex, src + index, bytes);
+        jndex += bytes;
+        index = escape;
+        if (escape >= lsrc_bytes)
         {
-            nal_buf[j] = 0x03;
-            j++;
-            count = 0;
-            continue;
+            break;
         }
-        nal_buf[j] = rbsp_buf[i];
-        if (rbsp_buf[i] == 0x00)
+        /* in NAL unit, 0x000000, 0x000001 or 0x000002 shall not occur at
+           any byte-aligned position */
+        if (src[escape] < 0x03)
         {
-            count++;
+            return -1;
         }
-        else
+        /* check the 4th byte after 0x000003 */
+        if ((escape < lsrc_bytes - 1) && (src[escape + 1] > 0x03))
         {
-            count = 0;
+            return -1;
         }
-        i++;
-        j++;
+        /* cabac_zero_word, the final 0x03 is discarded */
+        if (escape == lsrc_bytes - 1)
+        {
+            break;
+        }
+        /* drop the 0x03, the next two zeros can start after it */
+        index = escape + 1;
+        escape += 3;
     }
-    *nal_size = j;
-    return j;
+    *src_bytes = index;
+    *dst_bytes = jndex;
+    return jndex;
 }
 
 int
 nal_to_rbsp(const char* nal_buf, int* nal_size, char* rbsp_buf, int* rbsp_size)
 {
-    int i;
-    int j;
+    return nal_unescape((const unsigned char*)nal_buf, nal_size,
+                        (unsigned char*)rbsp_buf, rbsp_size);
+}
+
+/* emulation_prevention_three_bytes nal_to_rbsp would drop, found with
+   the same scan but nothing is copied, -1 where it would fail */
+int
+nal_escape_count(const char* nal_buf, int nal_size)
+{
     int count;
-    int lnal_size;
-    int lrbsp_size;
+    int escape;
+    const unsigned char* data;
 
-    j = 0;
+    data = (const unsigned char*)nal_buf;
     count = 0;
-    lnal_size = *nal_size;
-    lrbsp_size = *rbsp_size;
-    for (i = 0; i < lnal_size; i++)
-    { 
-        /* in NAL unit, 0x000000, 0x000001 or 0x000002 shall not occur at any
-           byte-aligned position */
-        if ((count == 2) && (nal_buf[i] < 0x03))
+    escape = 2;
+    for (;;)
+    {
+        escape = find_escape(data, escape, nal_size);
+        if (escape >= nal_size)
         {
-            return -1;
+            break;
         }
-        if ((count == 2) && (nal_buf[i] == 0x03))
+        if ((data[escape] < 0x03) ||
+            ((escape < nal_size - 1) && (data[escape + 1] > 0x03)))
         {
-            /* check the 4th byte after 0x000003, except when cabac_zero_word
-               is used, in which case the last three bytes of this NAL unit
-               must be 0x000003 */
-            if ((i < lnal_size - 1) && (nal_buf[i + 1] > 0x03))
-            {
-                return -1;
-            }
-            /* if cabac_zero_word is used, the final byte of this NAL
-               unit(0x03) is discarded, and the last two bytes of RBSP
-               must be 0x0000 */
-            if (i == lnal_size - 1)
-            {
-                break;
-            }
-            i++;
-            count = 0;
+            return -1;
         }
-        if (j >= lrbsp_size)
+        count++;
+        escape += 3;
+    }
+    return count;
+}
+
+/* unescape in place, returns the rbsp bytes or -1 */
+int
+nal_to_rbsp_inplace(char* data, int data_bytes)
+{
+    int rbsp_bytes;
+
+    rbsp_bytes = data_bytes;
+    return nal_unescape((const unsigned char*)data, &data_bytes,
+                        (unsigned char*)data, &rbsp_bytes);
+}
+
+/* worst case nal bytes for rbsp_size bytes of rbsp, an all zero rbsp
+   needs an emulation_prevention_three_byte after every second byte */
+int
+rbsp_to_nal_max(int rbsp_size)
+{
+    return rbsp_size + rbsp_size / 2;
+}
+
+/* insert 0x03 before any 0x00 to 0x03 byte that follows two zero bytes,
+   and after a final 0x0000, the runs between are copied with memcpy
+   nal_size is in/out, rbsp_to_nal_max(rbsp_size) is always enough */
+int
+rbsp_to_nal(const char* rbsp_buf, int rbsp_size, char* nal_buf, int* nal_size)
+{
+    int index;
+    int jndex;
+    int escape;
+    int last_escape;
+    int bytes;
+    int lnal_size;
+    const unsigned char* rbsp;
+
+    rbsp = (const unsigned char*)rbsp_buf;
+    index = 0;
+    jndex = 0;
+    escape = 2;
+    last_escape = 0;
+    lnal_size = *nal_size;
+    while (index < rbsp_size)
+    {
+        escape = find_escape(rbsp, escape, rbsp_size);
+        bytes = escape - index;
+        if (jndex + bytes > lnal_size)
         {
             /* error, not enough space */
             return -1;
         }
-        rbsp_buf[j] = nal_buf[i];
-        if (nal_buf[i] == 0x00)
+        memcpy(nal_buf + jndex, rbsp_buf + index, bytes);
+        jndex += bytes;
+        index = escape;
+        if (escape >= rbsp_size)
         {
-            count++;
+            break;
         }
-        else
+        if (jndex >= lnal_size)
         {
-            count = 0;
+            return -1;
         }
-        j++;
+        nal_buf[jndex] = 0x03;
+        jndex++;
+        /* the zero count restarts at the escaped byte */
+        last_escape = escape;
+        escape += 2;
     }
-    *nal_size = i;
-    *rbsp_size = j;
-    return j;
+    if ((rbsp_size >= 2) && (rbsp_size - 2 >= last_escape) &&
+        (rbsp[rbsp_size - 1] == 0) && (rbsp[rbsp_size - 2] == 0))
+    {
+        if (jndex >= lnal_size)
+        {
+            return -1;
+        }
+        nal_buf[jndex] = 0x03;
+        jndex++;
+    }
+    *nal_size = jndex;
+    return jndex;
+}
+
+/* 8 bytes a step, only compared in memory so byte order does not
+   matter */
+unsigned long long
+nal_hash(const char* data, int bytes)
+{
+    unsigned long long hash;
+    unsigned long long val;
+
+    hash = 0x9E3779B97F4A7C15ull ^ (unsigned long long)bytes;
+    while (bytes >= 8)
+    {
+        memcpy(&val, data, 8);
+        hash = (hash ^ val) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+        data += 8;
+        bytes -= 8;
+    }
+    val = 0;
+    memcpy(&val, data, bytes);
+    hash = (hash ^ val) * 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 29;
+    return hash;
 }
 
+/* writev until every buffer is out, count is at most 1024 and a short
+   write moves iov along so the caller's array is changed, a signal
+   before anything was written is retried
+   returns 0 or 1 on error */
+int
+write_iov(int fd, struct iovec* iov, int count)
+{
+    long long sent;
+
+    sent = 0;
+    for (;;)
+    {
+        /* drops what was sent and empty buffers */
+        while ((count > 0) && (sent >= (long long)iov->iov_len))
+        {
+            sent -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count < 1)
+        {
+            return 0;
+        }
+        iov->iov_base = (char*)iov->iov_base + sent;
+        iov->iov_len -= sent;
+        sent = writev(fd, iov, count);
+        if ((sent < 0) && (errno == EINTR))
+        {
+            sent = 0;
+            continue;
+        }
+        if (sent < 1)
+        {
+            return 1;
+        }
+    }
+}
@@ -2,15 +2,66 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
-void
-hexdump(const void *p, int len);
+#include <stdio.h>
+
+struct iovec;
+
+struct nal_loc_t
+{
+    long long offset;           /* first byte after the start code */
+    int bytes;                  /* without trailing_zero_8bits */
+    int start_code_bytes;       /* 3 or 4 */
+};
+
+/* compact per nal record from nal_index_build, offset is into the
+   scanned buffer */
+struct nal_entry_t
+{
+    long long offset;
+    int bytes;
+    unsigned char start_code_bytes;
+    unsigned char nal_ref_idc;
+    unsigned char nal_unit_type;
+};
+
+struct nal_index_t
+{
+    struct nal_entry_t* nals;
+    int count;
+    int alloc;
+};
+
 int
 parse_start_code(const char* data, const char* end_data);
+const char*
+find_start_code(const char* data, const char* end_data, int* start_code_bytes);
 int
 get_nal_bytes(const char* data, const char* end_data);
 int
+scan_nals(const char* data, long long data_bytes, struct nal_loc_t* nals,
+          int max_nals);
+int
+nal_index_build(struct nal_index_t* index, const char* data,
+                long long data_bytes);
+int
+nal_index_deinit(struct nal_index_t* index);
+int
+nal_index_count(const struct nal_index_t* index, int type_mask);
+int
+rbsp_to_nal_max(int rbsp_size);
+int
 rbsp_to_nal(const char* rbsp_buf, int rbsp_size, char* nal_buf, int* nal_size);
 int
 nal_to_rbsp(const char* nal_buf, int* nal_size, char* rbsp_buf, int* rbsp_size);
+int
+nal_to_rbsp_c(const char* nal_buf, int* nal_size, char* rbsp_buf, int* rbsp_size);
+int
+nal_to_rbsp_inplace(char* data, int data_bytes);
+int
+nal_escape_count(const char* nal_buf, int nal_size);
+unsigned long long
+nal_hash(const char* data, int bytes);
+int
+write_iov(int fd, struct iovec* iov, int count);
 
 #endif
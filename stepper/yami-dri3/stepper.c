@@ -21,6 +21,11 @@
 
 #include <VideoDecoderCapi.h>
 
+#include "utils.h"
+#include "frame_index.h"
+#include "beef.h"
+#include "au.h"
+
 static Display* g_disp = 0;
 static xcb_connection_t* g_xcb = 0;
 static int g_screenNumber = 0;
@@ -44,64 +49,68 @@ static VAContextID g_vpp_ctx = 0;
 
 #define BUF_BYTES (16 * 1024 * 1024)
 
+static struct au_reader_t g_au;
+static int g_au_ready = 0;
+
 static int
 get_next_frame(int fd, char* data, int* bytes, int* width, int* height)
 {
     int cur_offset;
-    struct _header
-    {
-        char text[4];
-        int width;
-        int height;
-        int bytes_follow;
-    } header;
+    int error;
+    struct beef_frame_t frame;
 
     cur_offset = lseek(fd, 0, SEEK_CUR);
-    if (read(fd, &header, sizeof(header)) != sizeof(header))
-    {
-        return 1;
-    }
-    if (strncmp(header.text, "BEEF", 4) != 0)
+    error = beef_read_header(fd, &frame);
+    if (error == 2)
     {
         printf("not BEEF file\n");
         lseek(fd, cur_offset, SEEK_SET);
         return 2;
     }
-    if (read(fd, data, header.bytes_follow) != header.bytes_follow)
+    if (error != 0)
+    {
+        return 1;
+    }
+    if ((frame.bytes > BUF_BYTES) ||
+        (read(fd, data, frame.bytes) != frame.bytes))
     {
         return 3;
     }
-    printf("width %d height %d bytes_follow %d\n", header.width, header.height, header.bytes_follow);
-    *bytes = header.bytes_follow; 
-    *width = header.width;
-    *height = header.height;
+    if ((frame.version > 1) &&
+        (beef_crc32(0, data, frame.bytes) != frame.checksum))
+    {
+        printf("bad checksum\n");
+        return 3;
+    }
+    printf("width %d height %d bytes_follow %lld\n", frame.width, frame.height, frame.bytes);
+    *bytes = frame.bytes;
+    *width = frame.width;
+    *height = frame.height;
     return 0;
 }
 
+/* raw Annex B, one access unit per call read on from where fd was the
+   first time */
 static int
 get_next_frame_no_beef(int fd, char* data, int* bytes, int* width, int* height)
 {
-    int cur_offset;
-    int readed;
-    int index;
+    long long au_bytes;
 
-    cur_offset = lseek(fd, 0, SEEK_CUR);
-    readed = read(fd, data, BUF_BYTES);
-    if (readed < 1)
-    {
-        return 1;
-    }
-    for (index = 6; index < readed; index++)
+    if (!g_au_ready)
     {
-        if ((data[index - 3] == 0) && (data[index - 2] == 0) &&
-            (data[index - 1] == 0) && (data[index] == 1))
+        if (au_reader_init(&g_au, fd) != 0)
         {
-            *bytes = index - 3;
-            lseek(fd, cur_offset + index - 3, SEEK_SET);
-            return 0;
+            return 1;
         }
+        g_au_ready = 1;
     }
-    *bytes = readed;
+    if (au_reader_next(&g_au, data, BUF_BYTES, &au_bytes) != 0)
+    {
+        return 1;
+    }
+    *bytes = au_bytes;
+    *width = g_au.width;
+    *height = g_au.height;
     return 0;
 }
 
@@ -487,6 +496,7 @@ main(int argc, char** argv)
     XEvent expose;
     XEvent evt;
     int error;
+    struct frame_index_t findex;
     int beef_header;
 
     fd = open(argv[1], O_RDONLY);
@@ -500,6 +510,18 @@ main(int argc, char** argv)
         printf("error opening %s\n", argv[1]);
         return 1;
     }
+    if (argc > 2)
+    {
+        /* start at the idr before the frame given */
+        if ((frame_index_open(&findex, argv[1]) != 0) ||
+            (frame_index_seek(&findex, fd,
+                              frame_index_idr(&findex, atoi(argv[2]))) != 0))
+        {
+            printf("error seeking to frame %s\n", argv[2]);
+            return 1;
+        }
+        frame_index_deinit(&findex);
+    }
     g_disp = XOpenDisplay(NULL);
     if (g_disp == NULL)
     {